@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "frameUtils.h"
+
+#define ATTRIBUTES_JSON_MAX 160                                                                                  // Enough for every key formatAttributesJson() can write
+
+int formatAttributesJson(char* buf, size_t size, const SampleFrame& frame, bool own);
+uint32_t attributesHash(const char* json);
+bool attributesChanged(const char* json);
+void attributesPublished(const char* json);
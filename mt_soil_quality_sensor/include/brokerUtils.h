@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+#define MAX_BROKERS 3
+
+struct BrokerEndpoint {
+  const char* host;                                                                                              // NULL or empty when the slot is not configured
+  uint16_t port;
+  bool psk;                                                                                                      // TLS-PSK with the NVS credentials instead of the certificate chain
+};
+
+struct BrokerHealth {
+  uint32_t latencyMs;                                                                                            // Running average of TLS plus CONNECT on success, 0 until first measured
+  uint8_t successPct;                                                                                            // Running average of the outcome of every attempt
+  uint8_t failures;                                                                                              // Consecutive failed attempts
+  uint8_t skipped;                                                                                               // Ranking rounds an unhealthy broker has been put last since its last try
+};
+
+uint8_t rankBrokers(const BrokerEndpoint* brokers, const bool* usable, uint8_t count, uint8_t* order);
+uint32_t brokerExpectedMs(uint8_t index);
+void brokerResult(uint8_t index, bool success, uint32_t latencyMs);
+const BrokerHealth& brokerHealth(uint8_t index);
+void resetBrokerHealth();
@@ -0,0 +1,51 @@
+#pragma once
+
+// GENERATED by scripts/gen_ca_bundle.py from ROOT_CA in macros.h, do not edit
+#include <stdint.h>
+
+static const uint8_t CA_BUNDLE[] = {
+  0x00, 0x01, 0x00, 0x8B, 0x02, 0x26, 0x30, 0x81, 0x88, 0x31, 0x0B, 0x30, 0x09, 0x06, 0x03, 0x55,
+  0x04, 0x06, 0x13, 0x02, 0x55, 0x53, 0x31, 0x13, 0x30, 0x11, 0x06, 0x03, 0x55, 0x04, 0x08, 0x13,
+  0x0A, 0x4E, 0x65, 0x77, 0x20, 0x4A, 0x65, 0x72, 0x73, 0x65, 0x79, 0x31, 0x14, 0x30, 0x12, 0x06,
+  0x03, 0x55, 0x04, 0x07, 0x13, 0x0B, 0x4A, 0x65, 0x72, 0x73, 0x65, 0x79, 0x20, 0x43, 0x69, 0x74,
+  0x79, 0x31, 0x1E, 0x30, 0x1C, 0x06, 0x03, 0x55, 0x04, 0x0A, 0x13, 0x15, 0x54, 0x68, 0x65, 0x20,
+  0x55, 0x53, 0x45, 0x52, 0x54, 0x52, 0x55, 0x53, 0x54, 0x20, 0x4E, 0x65, 0x74, 0x77, 0x6F, 0x72,
+  0x6B, 0x31, 0x2E, 0x30, 0x2C, 0x06, 0x03, 0x55, 0x04, 0x03, 0x13, 0x25, 0x55, 0x53, 0x45, 0x52,
+  0x54, 0x72, 0x75, 0x73, 0x74, 0x20, 0x52, 0x53, 0x41, 0x20, 0x43, 0x65, 0x72, 0x74, 0x69, 0x66,
+  0x69, 0x63, 0x61, 0x74, 0x69, 0x6F, 0x6E, 0x20, 0x41, 0x75, 0x74, 0x68, 0x6F, 0x72, 0x69, 0x74,
+  0x79, 0x30, 0x82, 0x02, 0x22, 0x30, 0x0D, 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01,
+  0x01, 0x01, 0x05, 0x00, 0x03, 0x82, 0x02, 0x0F, 0x00, 0x30, 0x82, 0x02, 0x0A, 0x02, 0x82, 0x02,
+  0x01, 0x00, 0x80, 0x12, 0x65, 0x17, 0x36, 0x0E, 0xC3, 0xDB, 0x08, 0xB3, 0xD0, 0xAC, 0x57, 0x0D,
+  0x76, 0xED, 0xCD, 0x27, 0xD3, 0x4C, 0xAD, 0x50, 0x83, 0x61, 0xE2, 0xAA, 0x20, 0x4D, 0x09, 0x2D,
+  0x64, 0x09, 0xDC, 0xCE, 0x89, 0x9F, 0xCC, 0x3D, 0xA9, 0xEC, 0xF6, 0xCF, 0xC1, 0xDC, 0xF1, 0xD3,
+  0xB1, 0xD6, 0x7B, 0x37, 0x28, 0x11, 0x2B, 0x47, 0xDA, 0x39, 0xC6, 0xBC, 0x3A, 0x19, 0xB4, 0x5F,
+  0xA6, 0xBD, 0x7D, 0x9D, 0xA3, 0x63, 0x42, 0xB6, 0x76, 0xF2, 0xA9, 0x3B, 0x2B, 0x91, 0xF8, 0xE2,
+  0x6F, 0xD0, 0xEC, 0x16, 0x20, 0x90, 0x09, 0x3E, 0xE2, 0xE8, 0x74, 0xC9, 0x18, 0xB4, 0x91, 0xD4,
+  0x62, 0x64, 0xDB, 0x7F, 0xA3, 0x06, 0xF1, 0x88, 0x18, 0x6A, 0x90, 0x22, 0x3C, 0xBC, 0xFE, 0x13,
+  0xF0, 0x87, 0x14, 0x7B, 0xF6, 0xE4, 0x1F, 0x8E, 0xD4, 0xE4, 0x51, 0xC6, 0x11, 0x67, 0x46, 0x08,
+  0x51, 0xCB, 0x86, 0x14, 0x54, 0x3F, 0xBC, 0x33, 0xFE, 0x7E, 0x6C, 0x9C, 0xFF, 0x16, 0x9D, 0x18,
+  0xBD, 0x51, 0x8E, 0x35, 0xA6, 0xA7, 0x66, 0xC8, 0x72, 0x67, 0xDB, 0x21, 0x66, 0xB1, 0xD4, 0x9B,
+  0x78, 0x03, 0xC0, 0x50, 0x3A, 0xE8, 0xCC, 0xF0, 0xDC, 0xBC, 0x9E, 0x4C, 0xFE, 0xAF, 0x05, 0x96,
+  0x35, 0x1F, 0x57, 0x5A, 0xB7, 0xFF, 0xCE, 0xF9, 0x3D, 0xB7, 0x2C, 0xB6, 0xF6, 0x54, 0xDD, 0xC8,
+  0xE7, 0x12, 0x3A, 0x4D, 0xAE, 0x4C, 0x8A, 0xB7, 0x5C, 0x9A, 0xB4, 0xB7, 0x20, 0x3D, 0xCA, 0x7F,
+  0x22, 0x34, 0xAE, 0x7E, 0x3B, 0x68, 0x66, 0x01, 0x44, 0xE7, 0x01, 0x4E, 0x46, 0x53, 0x9B, 0x33,
+  0x60, 0xF7, 0x94, 0xBE, 0x53, 0x37, 0x90, 0x73, 0x43, 0xF3, 0x32, 0xC3, 0x53, 0xEF, 0xDB, 0xAA,
+  0xFE, 0x74, 0x4E, 0x69, 0xC7, 0x6B, 0x8C, 0x60, 0x93, 0xDE, 0xC4, 0xC7, 0x0C, 0xDF, 0xE1, 0x32,
+  0xAE, 0xCC, 0x93, 0x3B, 0x51, 0x78, 0x95, 0x67, 0x8B, 0xEE, 0x3D, 0x56, 0xFE, 0x0C, 0xD0, 0x69,
+  0x0F, 0x1B, 0x0F, 0xF3, 0x25, 0x26, 0x6B, 0x33, 0x6D, 0xF7, 0x6E, 0x47, 0xFA, 0x73, 0x43, 0xE5,
+  0x7E, 0x0E, 0xA5, 0x66, 0xB1, 0x29, 0x7C, 0x32, 0x84, 0x63, 0x55, 0x89, 0xC4, 0x0D, 0xC1, 0x93,
+  0x54, 0x30, 0x19, 0x13, 0xAC, 0xD3, 0x7D, 0x37, 0xA7, 0xEB, 0x5D, 0x3A, 0x6C, 0x35, 0x5C, 0xDB,
+  0x41, 0xD7, 0x12, 0xDA, 0xA9, 0x49, 0x0B, 0xDF, 0xD8, 0x80, 0x8A, 0x09, 0x93, 0x62, 0x8E, 0xB5,
+  0x66, 0xCF, 0x25, 0x88, 0xCD, 0x84, 0xB8, 0xB1, 0x3F, 0xA4, 0x39, 0x0F, 0xD9, 0x02, 0x9E, 0xEB,
+  0x12, 0x4C, 0x95, 0x7C, 0xF3, 0x6B, 0x05, 0xA9, 0x5E, 0x16, 0x83, 0xCC, 0xB8, 0x67, 0xE2, 0xE8,
+  0x13, 0x9D, 0xCC, 0x5B, 0x82, 0xD3, 0x4C, 0xB3, 0xED, 0x5B, 0xFF, 0xDE, 0xE5, 0x73, 0xAC, 0x23,
+  0x3B, 0x2D, 0x00, 0xBF, 0x35, 0x55, 0x74, 0x09, 0x49, 0xD8, 0x49, 0x58, 0x1A, 0x7F, 0x92, 0x36,
+  0xE6, 0x51, 0x92, 0x0E, 0xF3, 0x26, 0x7D, 0x1C, 0x4D, 0x17, 0xBC, 0xC9, 0xEC, 0x43, 0x26, 0xD0,
+  0xBF, 0x41, 0x5F, 0x40, 0xA9, 0x44, 0x44, 0xF4, 0x99, 0xE7, 0x57, 0x87, 0x9E, 0x50, 0x1F, 0x57,
+  0x54, 0xA8, 0x3E, 0xFD, 0x74, 0x63, 0x2F, 0xB1, 0x50, 0x65, 0x09, 0xE6, 0x58, 0x42, 0x2E, 0x43,
+  0x1A, 0x4C, 0xB4, 0xF0, 0x25, 0x47, 0x59, 0xFA, 0x04, 0x1E, 0x93, 0xD4, 0x26, 0x46, 0x4A, 0x50,
+  0x81, 0xB2, 0xDE, 0xBE, 0x78, 0xB7, 0xFC, 0x67, 0x15, 0xE1, 0xC9, 0x57, 0x84, 0x1E, 0x0F, 0x63,
+  0xD6, 0xE9, 0x62, 0xBA, 0xD6, 0x5F, 0x55, 0x2E, 0xEA, 0x5C, 0xC6, 0x28, 0x08, 0x04, 0x25, 0x39,
+  0xB8, 0x0E, 0x2B, 0xA9, 0xF2, 0x4C, 0x97, 0x1C, 0x07, 0x3F, 0x0D, 0x52, 0xF5, 0xED, 0xEF, 0x2F,
+  0x82, 0x0F, 0x02, 0x03, 0x01, 0x00, 0x01,
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+uint64_t clockNowMs();
+bool clockShouldSync();
+bool clockSync(void (*idle)() = NULL);
+int32_t clockDriftPpm();
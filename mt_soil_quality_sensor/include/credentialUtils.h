@@ -0,0 +1,7 @@
+#pragma once
+
+void loadCredentials();
+const char* getAccessToken();
+const char* getPskIdentity();
+const char* getPskKey();
+bool pskAvailable();
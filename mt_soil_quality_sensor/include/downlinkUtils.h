@@ -0,0 +1,6 @@
+#pragma once
+
+#include <PubSubClient.h>
+
+void downlinkAttach(PubSubClient& client);
+void downlinkAfterPublish(PubSubClient& client, SemaphoreHandle_t serialSemaphore);
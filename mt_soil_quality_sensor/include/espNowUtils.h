@@ -0,0 +1,9 @@
+#pragma once
+
+#include "frameUtils.h"
+
+bool setupEspNow(uint8_t channel, const uint8_t* peerMac);
+bool sendSampleFrame(const uint8_t* peerMac, const SampleFrame& frame);
+bool sendValveCommand(const uint8_t* peerMac, int16_t treeId, bool open);
+bool receiveSampleFrame(SampleFrame& frame, uint8_t* srcMac);
+uint32_t getDroppedFrames();
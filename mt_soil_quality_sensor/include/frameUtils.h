@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FRAME_MAGIC 0x53                                                                                         // 'S', first byte of every sample frame
+#define FRAME_VERSION 1                                                                                          // Of the layout below, a gateway only decodes frames of its own version
+#define FRAME_MAX_PROBES 4                                                                                       // Temperature probes a frame can carry
+#define FRAME_BASE_LEN 24                                                                                        // Size in bytes of an encoded sample frame without probes...
+#define FRAME_PROBE_LEN 3                                                                                        // ...plus this much per probe (depth and temperature)
+#define FRAME_WINDOW_LEN 20                                                                                      // Optional block after the probes, only sent when a window holds more than one sample
+#define FRAME_MAX_LEN (FRAME_BASE_LEN + FRAME_MAX_PROBES * FRAME_PROBE_LEN + FRAME_WINDOW_LEN)
+#define FRAME_JSON_MAX 640                                                                                       // Enough for every key formatTelemetryJson() can write
+#define FRAME_INVALID_TEMP -127.0f                                                                               // Same as DEVICE_DISCONNECTED_C, a probe value that must not be published
+
+// Fault bits carried in "flags", set by the sensor health checks
+#define FRAME_FAULT_TEMP_DISCONNECTED 0x01                                                                       // A probe did not answer or failed its CRC
+#define FRAME_FAULT_TEMP_STUCK 0x02                                                                              // A probe returned its power-on value, the conversion never ran
+#define FRAME_FAULT_TEMP_RANGE 0x04
+#define FRAME_FAULT_TEMP_NOISY 0x08                                                                              // The samples of a probe disagreed too much for the median to be trusted
+#define FRAME_FAULT_MOIST_RANGE 0x10                                                                             // ADC pinned at a rail: probe open, shorted or unplugged
+#define FRAME_FAULT_MOIST_STUCK 0x20
+#define FRAME_FAULT_MOIST_NOISY 0x40
+#define FRAME_FAULT_MOIST (FRAME_FAULT_MOIST_RANGE | FRAME_FAULT_MOIST_STUCK | FRAME_FAULT_MOIST_NOISY)
+
+// Valve bits carried in "valve", set by the irrigation rule of the node
+#define FRAME_VALVE_PRESENT 0x01                                                                                 // The node runs an irrigation rule, without it the other bits mean nothing
+#define FRAME_VALVE_OPEN 0x02
+#define FRAME_VALVE_TIMEOUT 0x04                                                                                 // Closed after IRRIGATION_MAX_OPEN_WAKES without the soil getting wet: no water or a bad probe
+#define FRAME_VALVE_SWITCHES_SHIFT 4                                                                             // High nibble: times the valve switched since the last delivered sample, saturated at 15
+#define FRAME_VALVE_SWITCHES_MAX 15
+
+// Valve command, sent over ESP-NOW to a valve controller when the rule switches
+#define VALVE_COMMAND_MAGIC 0x56                                                                                 // 'V'
+#define VALVE_COMMAND_VERSION 1                                                                                  // Of the command layout, independent of FRAME_VERSION
+#define VALVE_COMMAND_LEN 6                                                                                      // Magic, version, tree, state and CRC
+
+struct WindowSummary {                                                                                           // Aggregates of one value over the samples taken since the last delivered one
+  uint16_t count;                                                                                                // Valid samples in the window, this one included
+  float mean;
+  float stdDev;
+  float min;
+  float max;
+};
+
+struct SampleFrame {
+  int16_t treeId;
+  uint32_t bootCnt;
+  float soilTemp;                                                                                                // ºC, sent as hundredths
+  float soilMoist;                                                                                               // %, sent as hundredths
+  float batVolt;                                                                                                 // V, sent as mV
+  uint8_t flags;                                                                                                 // FRAME_FAULT_* bits, 0 when every sensor looks healthy
+  uint8_t valve;                                                                                                 // FRAME_VALVE_* bits, 0 on a node without an irrigation rule
+  uint64_t tsMs;                                                                                                 // Sampling time in ms since epoch, 0 while the node clock was never set, sent as 48 bits
+  uint8_t probeCount;                                                                                            // Probes listed below, only sent when there is more than one
+  uint8_t probeDepthCm[FRAME_MAX_PROBES];
+  float probeTemp[FRAME_MAX_PROBES];                                                                             // ºC, sent as hundredths
+  WindowSummary tempWindow;                                                                                      // "soilTemp" over the reporting window, only sent when more than one sample was taken
+  WindowSummary moistWindow;                                                                                     // "soilMoist" over the reporting window, same
+};
+
+size_t frameLength(const SampleFrame& frame);
+size_t encodeFrame(const SampleFrame& frame, uint8_t* buf, size_t size);
+bool decodeFrame(const uint8_t* buf, size_t len, SampleFrame& frame);
+int formatFrameJson(char* buf, size_t size, const SampleFrame& frame);
+int formatTelemetryJson(char* buf, size_t size, const SampleFrame& frame);
+size_t encodeValveCommand(int16_t treeId, bool open, uint8_t* buf, size_t size);
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <PubSubClient.h>
+#include "frameUtils.h"
+
+bool gatewayAdd(const SampleFrame& frame);
+bool gatewayShouldFlush();
+bool gatewayFlush(PubSubClient& client, const char* topic, SemaphoreHandle_t serialSemaphore);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include "frameUtils.h"
+
+#define DS18B20_POWER_ON_C 85.0f                                                                                 // Scratchpad reset value, read back when a conversion did not happen
+
+struct SampleQuality {
+  float probeSpreadC[FRAME_MAX_PROBES];                                                                          // Max minus min of the samples behind each probe median
+  uint16_t moistRaw;                                                                                             // Median of the raw ADC readings, before calibration and clamping
+  uint16_t moistSpreadRaw;
+};
+
+uint8_t checkSampleHealth(SampleFrame& frame, const SampleQuality& quality);
+bool healthShouldRetry(uint8_t faults, uint8_t attempt);
+void commitSampleHealth(const SampleFrame& frame, const SampleQuality& quality);
+bool healthShouldSend(const SampleFrame& frame);
+void healthDelivered(const SampleFrame& frame);
+void resetSampleHealth();
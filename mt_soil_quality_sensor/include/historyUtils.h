@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+#include <PubSubClient.h>
+#include "frameUtils.h"
+
+#define HISTORY_PENDING 0x80                                                                                     // In "flags": worth sending and not delivered yet. Left out of the CRC, so it can be cleared in place
+
+struct HistoryRecord {                                                                                           // 16 bytes, the unit of a flash write
+  uint64_t tsMs;                                                                                                 // Sampling time, all ones in an erased slot
+  int16_t soilTemp;                                                                                              // Hundredths of ºC
+  uint16_t soilMoist;                                                                                            // Hundredths of %
+  uint16_t batMv;
+  uint8_t flags;                                                                                                 // FRAME_FAULT_* bits of the sample, plus HISTORY_PENDING
+  uint8_t crc;                                                                                                   // Of the bytes above, a slot torn by a reset is skipped
+};
+
+bool historyAppend(const SampleFrame& frame, bool pending);
+bool historyMarkDelivered();
+uint64_t historyPendingFromMs();
+uint16_t historyReplay(PubSubClient& client, uint64_t fromMs, uint64_t toMs, uint16_t maxRecords, uint32_t deadlineMs, bool pendingOnly,
+                       uint64_t* lastMs, bool* more);
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+#include "frameUtils.h"
+
+void setupIrrigation();
+uint8_t irrigationControl(const SampleFrame& frame);
+void irrigationSendPending(uint8_t channel);
+bool irrigationCommandPending();
+bool irrigationValveOpen();
+void irrigationDelivered();
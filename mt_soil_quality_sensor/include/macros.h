@@ -1,89 +1,291 @@
-#pragma once                                                                                                     // Include the header file only once during the compilation process, even if it is included multiple times in different files
-
-// ===========================================================================================================================================================
-// MACROS (de ser necesarias)
-// ===========================================================================================================================================================
-// T-Beam macros ---------------------------------------------------------------------------------------------------------------------------------------------
-#define LED_PIN 4
-#define BUTTON_PIN GPIO_NUM_38                                                                                   // RTC pin to interrupt deep sleep
-#define SDA_PIN 21
-#define SCL_PIN 22
-#define PMU_IRQ_PIN 35                                                                                           // PEK (PWR) button interrupt pin on T-Beam
-// Serial Monitor macros -------------------------------------------------------------------------------------------------------------------------------------
-#define ENABLE_SERIAL true
-
-#if ENABLE_SERIAL                                                                                                // If set to true, the macros invoke the Serial functions
-  #define Debug(x)    Serial.print(x)
-  #define Debugln(x)  Serial.println(x)
-  #define Debugf(...) Serial.printf(__VA_ARGS__)                                                                 // This only works with ESP32 processors, do not use it for ATMega-based boards
-#else                                                                                                            // If set to false, the macros do not invoke anything and resources are saved
-  #define Debug(x)
-  #define Debugln(x)
-  #define Debugf(...)
-#endif
-// Wi-Fi and MQTT macros -------------------------------------------------------------------------------------------------------------------------------------
-#define WI_FI false
-
-#if WI_FI
-  #define WIFI_SSID "WiFi-Rguez-Moya"
-  #define WIFI_PASSWORD "Trece131313!"
-#else
-  #define WIFI_SSID "Pixel_OF13"
-  #define WIFI_PASSWORD "mynameisjeff"
-#endif
-
-#define MQTT_SERVER "srv-iot.diatel.upm.es"                                                                      // UPM MQTT broker
-#define MQTT_PORT 8883                                                                                           // MQTT broker port
-#define MQTT_TOPIC_PUB "v1/devices/me/telemetry"
-#define MQTT_CLIENT "soil_quaity_sensor_2"
-
-#ifndef ACCESS_TOKEN
-#define ACCESS_TOKEN "UNDEFINED_TOKEN"                                                                           // Unique ThingsBoard device token, MOVED TO plaformio.ini
-#endif
-
-#define ROOT_CA "-----BEGIN CERTIFICATE-----\n" \
-"MIIF3jCCA8agAwIBAgIQAf1tMPyjylGoG7xkDjUDLTANBgkqhkiG9w0BAQwFADCB\n" \
-"iDELMAkGA1UEBhMCVVMxEzARBgNVBAgTCk5ldyBKZXJzZXkxFDASBgNVBAcTC0pl\n" \
-"cnNleSBDaXR5MR4wHAYDVQQKExVUaGUgVVNFUlRSVVNUIE5ldHdvcmsxLjAsBgNV\n" \
-"BAMTJVVTRVJUcnVzdCBSU0EgQ2VydGlmaWNhdGlvbiBBdXRob3JpdHkwHhcNMTAw\n" \
-"MjAxMDAwMDAwWhcNMzgwMTE4MjM1OTU5WjCBiDELMAkGA1UEBhMCVVMxEzARBgNV\n" \
-"BAgTCk5ldyBKZXJzZXkxFDASBgNVBAcTC0plcnNleSBDaXR5MR4wHAYDVQQKExVU\n" \
-"aGUgVVNFUlRSVVNUIE5ldHdvcmsxLjAsBgNVBAMTJVVTRVJUcnVzdCBSU0EgQ2Vy\n" \
-"dGlmaWNhdGlvbiBBdXRob3JpdHkwggIiMA0GCSqGSIb3DQEBAQUAA4ICDwAwggIK\n" \
-"AoICAQCAEmUXNg7D2wiz0KxXDXbtzSfTTK1Qg2HiqiBNCS1kCdzOiZ/MPans9s/B\n" \
-"3PHTsdZ7NygRK0faOca8Ohm0X6a9fZ2jY0K2dvKpOyuR+OJv0OwWIJAJPuLodMkY\n" \
-"tJHUYmTbf6MG8YgYapAiPLz+E/CHFHv25B+O1ORRxhFnRghRy4YUVD+8M/5+bJz/\n" \
-"Fp0YvVGONaanZshyZ9shZrHUm3gDwFA66Mzw3LyeTP6vBZY1H1dat//O+T23LLb2\n" \
-"VN3I5xI6Ta5MirdcmrS3ID3KfyI0rn47aGYBROcBTkZTmzNg95S+UzeQc0PzMsNT\n" \
-"79uq/nROacdrjGCT3sTHDN/hMq7MkztReJVni+49Vv4M0GkPGw/zJSZrM233bkf6\n" \
-"c0Plfg6lZrEpfDKEY1WJxA3Bk1QwGROs0303p+tdOmw1XNtB1xLaqUkL39iAigmT\n" \
-"Yo61Zs8liM2EuLE/pDkP2QKe6xJMlXzzawWpXhaDzLhn4ugTncxbgtNMs+1b/97l\n" \
-"c6wjOy0AvzVVdAlJ2ElYGn+SNuZRkg7zJn0cTRe8yexDJtC/QV9AqURE9JnnV4ee\n" \
-"UB9XVKg+/XRjL7FQZQnmWEIuQxpMtPAlR1n6BB6T1CZGSlCBst6+eLf8ZxXhyVeE\n" \
-"Hg9j1uliutZfVS7qXMYoCAQlObgOK6nyTJccBz8NUvXt7y+CDwIDAQABo0IwQDAd\n" \
-"BgNVHQ4EFgQUU3m/WqorSs9UgOHYm8Cd8rIDZsswDgYDVR0PAQH/BAQDAgEGMA8G\n" \
-"A1UdEwEB/wQFMAMBAf8wDQYJKoZIhvcNAQEMBQADggIBAFzUfA3P9wF9QZllDHPF\n" \
-"Up/L+M+ZBn8b2kMVn54CVVeWFPFSPCeHlCjtHzoBN6J2/FNQwISbxmtOuowhT6KO\n" \
-"VWKR82kV2LyI48SqC/3vqOlLVSoGIG1VeCkZ7l8wXEskEVX/JJpuXior7gtNn3/3\n" \
-"ATiUFJVDBwn7YKnuHKsSjKCaXqeYalltiz8I+8jRRa8YFWSQEg9zKC7F4iRO/Fjs\n" \
-"8PRF/iKz6y+O0tlFYQXBl2+odnKPi4w2r78NBc5xjeambx9spnFixdjQg3IM8WcR\n" \
-"iQycE0xyNN+81XHfqnHd4blsjDwSXWXavVcStkNr/+XeTWYRUc+ZruwXtuhxkYze\n" \
-"Sf7dNXGiFSeUHM9h4ya7b6NnJSFd5t0dCy5oGzuCr+yDZ4XUmFF0sbmZgIn/f3gZ\n" \
-"XHlKYC6SQK5MNyosycdiyA5d9zZbyuAlJQG03RoHnHcAP9Dc1ew91Pq7P8yF1m9/\n" \
-"qS3fuQL39ZeatTXaw2ewh0qpKJ4jjv9cJ2vhsE/zB+4ALtRZh8tSQZXq9EfX7mRB\n" \
-"VXyNWQKV3WKdwrnuWih0hKWbt5DHDAff9Yk2dDLWKMGwsAvgnEzDHNb842m1R0aB\n" \
-"L6KCq9NjRHDEjf8tM7qtj3u1cIiuPhnPQCjY/MiQu12ZIvVS5ljFH4gxQ+6IHdfG\n" \
-"jjxDah2nGN59PRbxYvnKkKj9\n" \
-"-----END CERTIFICATE-----\n"                                                                                    // Certificate for MQTT over TLS on Thingsboard
-
-#ifndef TREE_ID
-#define TREE_ID -1                                                                                               // ID of the tree the sensor is measuring its soil, -1 in here IN CASE platformio.ini DOES NOT HAVE THE DECLARATION
-#endif
-// Deep sleep macros -----------------------------------------------------------------------------------------------------------------------------------------
-#define SLEEP_DURATION_S 30ULL                                                                                   // Sleep time between messages
-// Sensor macros ---------------------------------------------------------------------------------------------------------------------------------------------
-#define ONE_WIRE_PIN 13                                                                                          // Perfectly fine to use as it is a digital I/O
-#define SOIL_MOIST_PIN 32                                                                                        // Very carefully selected not to use a pin that is already being used by Wi-Fi (ADC2 pins), or other peripherals included on the T-Beam
-#define TEMPERATURE_SAMPLES 5
-#define MOISTURE_SAMPLES 5
+#pragma once                                                                                                     // Include the header file only once during the compilation process, even if it is included multiple times in different files
+
+// ===========================================================================================================================================================
+// MACROS (de ser necesarias)
+// ===========================================================================================================================================================
+// T-Beam macros ---------------------------------------------------------------------------------------------------------------------------------------------
+#define LED_PIN 4
+#define BUTTON_PIN GPIO_NUM_38                                                                                   // RTC pin to interrupt deep sleep
+#define SDA_PIN 21
+#define SCL_PIN 22
+#define PMU_IRQ_PIN 35                                                                                           // PEK (PWR) button interrupt pin on T-Beam
+// Serial Monitor macros -------------------------------------------------------------------------------------------------------------------------------------
+#define ENABLE_SERIAL true
+
+#if ENABLE_SERIAL                                                                                                // If set to true, the macros invoke the Serial functions
+  #define Debug(x)    Serial.print(x)
+  #define Debugln(x)  Serial.println(x)
+  #define Debugf(...) Serial.printf(__VA_ARGS__)                                                                 // This only works with ESP32 processors, do not use it for ATMega-based boards
+#else                                                                                                            // If set to false, the macros do not invoke anything and resources are saved
+  #define Debug(x)
+  #define Debugln(x)
+  #define Debugf(...)
+#endif
+// Role macros -----------------------------------------------------------------------------------------------------------------------------------------------
+#define ROLE_NODE 0                                                                                              // Sensor node publishing straight to ThingsBoard over Wi-Fi, TLS and MQTT
+#define ROLE_ESPNOW_NODE 1                                                                                       // Battery sensor node sending compact frames to a gateway over ESP-NOW, no association and no IP
+#define ROLE_UPLINK_NODE 3                                                                                       // Sensor node picking the cheapest working uplink (Wi-Fi MQTT, MQTT-SN, ESP-NOW or LoRa) on every cycle
+#define ROLE_GATEWAY 2                                                                                           // Mains-powered node that receives ESP-NOW frames and forwards them through the ThingsBoard gateway API
+
+#ifndef DEVICE_ROLE
+#define DEVICE_ROLE ROLE_NODE                                                                                    // Overridden per environment in platformio.ini
+#endif
+// Wi-Fi and MQTT macros -------------------------------------------------------------------------------------------------------------------------------------
+#define WI_FI false
+
+#if WI_FI
+  #define WIFI_SSID "WiFi-Rguez-Moya"
+  #define WIFI_PASSWORD "Trece131313!"
+#else
+  #define WIFI_SSID "Pixel_OF13"
+  #define WIFI_PASSWORD "mynameisjeff"
+#endif
+
+#define WIFI_CACHED_TIMEOUT_MS 3000                                                                              // Time to join the AP remembered from the last wake before scanning every channel again
+
+#define MQTT_SERVER "srv-iot.diatel.upm.es"                                                                      // UPM MQTT broker
+#define MQTT_PORT 8883                                                                                           // MQTT broker port
+#define MQTT_SECONDARY_SERVER ""                                                                                 // Second cloud broker to fail over to, empty if there is none
+#define MQTT_SECONDARY_PORT 8883
+#define MQTT_TOPIC_PUB "v1/devices/me/telemetry"
+#define MQTT_TOPIC_ATTRIBUTES "v1/devices/me/attributes"                                                         // Client attributes, published only when they change
+#define MQTT_TOPIC_RPC_REQUEST "v1/devices/me/rpc/request/+"                                                     // Server-side RPCs, answered on MQTT_TOPIC_RPC_RESPONSE plus the request id
+#define MQTT_TOPIC_RPC_RESPONSE "v1/devices/me/rpc/response/"
+#define DEVICE_NAME_PREFIX "soil_quality_sensor_"                                                                // ThingsBoard device of a tree: this and its TREE_ID, whichever way its samples travel
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)                                                                               // Value of a numeric macro as a string literal, e.g. TREE_ID in MQTT_CLIENT
+#if DEVICE_ROLE == ROLE_GATEWAY
+  #define MQTT_CLIENT "sqs_gw"
+#else
+  #define MQTT_CLIENT DEVICE_NAME_PREFIX STRINGIFY(TREE_ID)                                                      // Stable, a broker that keeps sessions keys them on it, and a bridge names the device after it
+#endif
+#define MQTT_PERSISTENT_SESSION true                                                                             // If set to true, CONNECT asks for the session to be kept across wakes. Only helps with a broker that keeps sessions, ThingsBoard keeps none
+#define MQTT_KEEPALIVE_S 30                                                                                      // Only matters while awake, a sensor always disconnects before deep sleep
+#define MQTT_TOPIC_GATEWAY "v1/gateway/telemetry"                                                                // ThingsBoard gateway API, payload keyed by device name
+#define MQTT_TOPIC_GATEWAY_ATTRIBUTES "v1/gateway/attributes"                                                    // Same for the attributes of each device behind the gateway
+#define GATEWAY_DEVICE_NAME DEVICE_NAME_PREFIX "%d"                                                              // Device name the gateway publishes each TREE_ID under
+#define GATEWAY_MAX_SAMPLES 32                                                                                   // Samples the gateway can hold between two publications
+#define GATEWAY_MAX_DEVICES 32                                                                                   // Devices whose attributes the gateway remembers having published
+#define GATEWAY_FLUSH_COUNT 16                                                                                   // Publish as soon as this many samples are waiting...
+#define GATEWAY_FLUSH_BYTES 1024                                                                                 // ...or the JSON would grow past this size (also the MQTT buffer size of the gateway)...
+#define GATEWAY_FLUSH_MS 10000                                                                                   // ...or the oldest waiting sample is this old
+#define NTP_SERVER "pool.ntp.org"                                                                                // The gateway stays synchronised, a sensor only asks every CLOCK_SYNC_EVERY_WAKES wakes
+#define CLOCK_SYNC_EVERY_WAKES 120                                                                               // The RTC keeps the time through deep sleep in between, corrected by the drift measured at each sync
+#define CLOCK_SYNC_TIMEOUT_MS 1500                                                                               // Longest wait for the SNTP reply, the sample is stamped from the RTC anyway
+
+#ifndef ACCESS_TOKEN
+#define ACCESS_TOKEN "UNDEFINED_TOKEN"                                                                           // Unique ThingsBoard device token, MOVED TO plaformio.ini
+#endif
+
+#define ROOT_CA "-----BEGIN CERTIFICATE-----\n" \
+"MIIF3jCCA8agAwIBAgIQAf1tMPyjylGoG7xkDjUDLTANBgkqhkiG9w0BAQwFADCB\n" \
+"iDELMAkGA1UEBhMCVVMxEzARBgNVBAgTCk5ldyBKZXJzZXkxFDASBgNVBAcTC0pl\n" \
+"cnNleSBDaXR5MR4wHAYDVQQKExVUaGUgVVNFUlRSVVNUIE5ldHdvcmsxLjAsBgNV\n" \
+"BAMTJVVTRVJUcnVzdCBSU0EgQ2VydGlmaWNhdGlvbiBBdXRob3JpdHkwHhcNMTAw\n" \
+"MjAxMDAwMDAwWhcNMzgwMTE4MjM1OTU5WjCBiDELMAkGA1UEBhMCVVMxEzARBgNV\n" \
+"BAgTCk5ldyBKZXJzZXkxFDASBgNVBAcTC0plcnNleSBDaXR5MR4wHAYDVQQKExVU\n" \
+"aGUgVVNFUlRSVVNUIE5ldHdvcmsxLjAsBgNVBAMTJVVTRVJUcnVzdCBSU0EgQ2Vy\n" \
+"dGlmaWNhdGlvbiBBdXRob3JpdHkwggIiMA0GCSqGSIb3DQEBAQUAA4ICDwAwggIK\n" \
+"AoICAQCAEmUXNg7D2wiz0KxXDXbtzSfTTK1Qg2HiqiBNCS1kCdzOiZ/MPans9s/B\n" \
+"3PHTsdZ7NygRK0faOca8Ohm0X6a9fZ2jY0K2dvKpOyuR+OJv0OwWIJAJPuLodMkY\n" \
+"tJHUYmTbf6MG8YgYapAiPLz+E/CHFHv25B+O1ORRxhFnRghRy4YUVD+8M/5+bJz/\n" \
+"Fp0YvVGONaanZshyZ9shZrHUm3gDwFA66Mzw3LyeTP6vBZY1H1dat//O+T23LLb2\n" \
+"VN3I5xI6Ta5MirdcmrS3ID3KfyI0rn47aGYBROcBTkZTmzNg95S+UzeQc0PzMsNT\n" \
+"79uq/nROacdrjGCT3sTHDN/hMq7MkztReJVni+49Vv4M0GkPGw/zJSZrM233bkf6\n" \
+"c0Plfg6lZrEpfDKEY1WJxA3Bk1QwGROs0303p+tdOmw1XNtB1xLaqUkL39iAigmT\n" \
+"Yo61Zs8liM2EuLE/pDkP2QKe6xJMlXzzawWpXhaDzLhn4ugTncxbgtNMs+1b/97l\n" \
+"c6wjOy0AvzVVdAlJ2ElYGn+SNuZRkg7zJn0cTRe8yexDJtC/QV9AqURE9JnnV4ee\n" \
+"UB9XVKg+/XRjL7FQZQnmWEIuQxpMtPAlR1n6BB6T1CZGSlCBst6+eLf8ZxXhyVeE\n" \
+"Hg9j1uliutZfVS7qXMYoCAQlObgOK6nyTJccBz8NUvXt7y+CDwIDAQABo0IwQDAd\n" \
+"BgNVHQ4EFgQUU3m/WqorSs9UgOHYm8Cd8rIDZsswDgYDVR0PAQH/BAQDAgEGMA8G\n" \
+"A1UdEwEB/wQFMAMBAf8wDQYJKoZIhvcNAQEMBQADggIBAFzUfA3P9wF9QZllDHPF\n" \
+"Up/L+M+ZBn8b2kMVn54CVVeWFPFSPCeHlCjtHzoBN6J2/FNQwISbxmtOuowhT6KO\n" \
+"VWKR82kV2LyI48SqC/3vqOlLVSoGIG1VeCkZ7l8wXEskEVX/JJpuXior7gtNn3/3\n" \
+"ATiUFJVDBwn7YKnuHKsSjKCaXqeYalltiz8I+8jRRa8YFWSQEg9zKC7F4iRO/Fjs\n" \
+"8PRF/iKz6y+O0tlFYQXBl2+odnKPi4w2r78NBc5xjeambx9spnFixdjQg3IM8WcR\n" \
+"iQycE0xyNN+81XHfqnHd4blsjDwSXWXavVcStkNr/+XeTWYRUc+ZruwXtuhxkYze\n" \
+"Sf7dNXGiFSeUHM9h4ya7b6NnJSFd5t0dCy5oGzuCr+yDZ4XUmFF0sbmZgIn/f3gZ\n" \
+"XHlKYC6SQK5MNyosycdiyA5d9zZbyuAlJQG03RoHnHcAP9Dc1ew91Pq7P8yF1m9/\n" \
+"qS3fuQL39ZeatTXaw2ewh0qpKJ4jjv9cJ2vhsE/zB+4ALtRZh8tSQZXq9EfX7mRB\n" \
+"VXyNWQKV3WKdwrnuWih0hKWbt5DHDAff9Yk2dDLWKMGwsAvgnEzDHNb842m1R0aB\n" \
+"L6KCq9NjRHDEjf8tM7qtj3u1cIiuPhnPQCjY/MiQu12ZIvVS5ljFH4gxQ+6IHdfG\n" \
+"jjxDah2nGN59PRbxYvnKkKj9\n" \
+"-----END CERTIFICATE-----\n"                                                                                    // Certificate for MQTT over TLS on Thingsboard
+
+#ifndef FIRMWARE_VERSION
+#define FIRMWARE_VERSION __DATE__ " " __TIME__                                                                   // Published as an attribute, so every new build is announced once. Set it in platformio.ini for releases
+#endif
+
+#ifndef TREE_ID
+  #if DEVICE_ROLE != ROLE_GATEWAY && defined(ARDUINO)                                                            // The host tools share these headers and take the tree from each frame
+    #error "TREE_ID is not set in platformio.ini: it names the device, its MQTT client and its frames"           // A sensor built without it would publish as "soil_quality_sensor_-1", shared by every such build
+  #endif
+  #define TREE_ID -1                                                                                             // The gateway measures no tree, it forwards the TREE_ID of each frame
+#endif
+// ESP-NOW macros --------------------------------------------------------------------------------------------------------------------------------------------
+#define ESPNOW_CHANNEL 1                                                                                         // Nodes transmit on this channel, it must match the channel of the AP the gateway is associated to
+#define ESPNOW_GATEWAY_MAC {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}                                                  // Broadcast by default, set the gateway STA MAC to get link-layer ACKs and retries
+#define ESPNOW_SEND_RETRIES 3
+#define ESPNOW_SEND_TIMEOUT_MS 50                                                                                // Time to wait for the send callback of each attempt
+
+#ifndef ESPNOW_LOOPBACK
+  #ifdef ARDUINO
+    #define ESPNOW_LOOPBACK false                                                                                // If set to true, frames are looped back in memory instead of going over the air
+  #else
+    #define ESPNOW_LOOPBACK true                                                                                 // Host builds have no radio, so both roles talk through the in-memory loopback
+  #endif
+#endif
+// Uplink macros ---------------------------------------------------------------------------------------------------------------------------------------------
+#define UPLINK_MAX_LATENCY_MS 10000                                                                              // Uplinks expected to be slower than this are not considered
+#define UPLINK_MAX_FAILURES 3                                                                                    // Consecutive failed cycles before an uplink is considered down...
+#define UPLINK_RETRY_CYCLES 10                                                                                   // ...and then only probed again once every this many cycles
+#define UPLINK_WIFI_TIMEOUT_MS 8000                                                                              // Bounded association time for the MQTT uplink, so other uplinks still get their turn
+// Cost model: rough figures for the T-Beam at 3.3 V, meant to be refined with a power analyser
+#define COST_MQTT_CONNECT_UJ 800000.0f                                                                           // ~2 s of association, DHCP, TLS handshake and MQTT CONNECT at ~120 mA
+#define COST_MQTT_BYTE_UJ 5.0f
+#define COST_MQTT_LATENCY_MS 2500
+#define COST_ESPNOW_CONNECT_UJ 24000.0f                                                                          // ~60 ms of radio start-up and channel set at ~120 mA
+#define COST_ESPNOW_BYTE_UJ 2.0f                                                                                 // 1 Mbps, so well under a microsecond per bit of air time
+#define COST_ESPNOW_LATENCY_MS 100
+#define COST_LORA_CONNECT_UJ 15000.0f                                                                            // LDO2 power-up, SX1276 init, preamble and header air time
+#define COST_LORA_BYTE_UJ 530.0f                                                                                 // ~1.6 ms of air time per byte at SF7/125 kHz with ~100 mA of TX current at 17 dBm
+#define COST_LORA_LATENCY_MS 200
+#define COST_MQTTSN_CONNECT_UJ 400000.0f                                                                         // ~1 s of association and DHCP at ~120 mA, no TCP and no TLS handshake
+#define COST_MQTTSN_BYTE_UJ 5.0f
+#define COST_MQTTSN_LATENCY_MS 1200
+// MQTT-SN macros --------------------------------------------------------------------------------------------------------------------------------------------
+#define MQTTSN_UPLINK false                                                                                      // Set to true where an MQTT-SN gateway listens, e.g. tools/mqttsn_gateway.cpp
+#define MQTTSN_GATEWAY "192.168.1.2"
+#define MQTTSN_PORT 1884
+#define MQTTSN_TOPIC_ID 1                                                                                        // Predefined topic id the gateway maps to MQTT_TOPIC_PUB, the payload is the binary sample frame
+#define MQTTSN_QOS 1                                                                                             // 1: CONNECT and PUBLISH, each confirmed by the gateway. -1: a single PUBLISH datagram, no confirmation at all
+#define MQTTSN_ACK_TIMEOUT_MS 300                                                                                // Time to wait for CONNACK or PUBACK...
+#define MQTTSN_RETRIES 3                                                                                         // ...before the datagram is sent again, up to this many times
+// LoRa macros -----------------------------------------------------------------------------------------------------------------------------------------------
+#define LORA_UPLINK false                                                                                        // Set to true where a LoRa receiver listens for the frames
+#define LORA_SCK_PIN 5                                                                                           // SX1276 wiring on the T-Beam v1.1
+#define LORA_MISO_PIN 19
+#define LORA_MOSI_PIN 27
+#define LORA_CS_PIN 18
+#define LORA_RST_PIN 23
+#define LORA_DIO0_PIN 26
+#define LORA_FREQUENCY 868E6                                                                                     // EU868 band
+#define LORA_SPREADING_FACTOR 7
+#define LORA_TX_POWER 17                                                                                         // dBm
+#define LORA_SYNC_WORD 0x12                                                                                      // Private network sync word, not LoRaWAN
+// TLS macros ------------------------------------------------------------------------------------------------------------------------------------------------
+#define TLS_PINNING true                                                                                         // If set to true, the broker certificate is checked against a cached SHA-256 fingerprint instead of validating the whole chain
+#define TLS_CA_BUNDLE true                                                                                       // If set to true, the chain is validated against CA_BUNDLE (ROOT_CA preparsed at build time) before falling back to parsing the PEM
+#define TLS_PSK false                                                                                            // If set to true, MQTT_PSK_SERVER joins the broker list, reached with TLS-PSK (symmetric crypto only) whenever a PSK is provisioned
+#define MQTT_PSK_SERVER "192.168.1.2"                                                                            // Local broker or gateway with a PSK listener, see tools/mosquitto_psk.conf
+#define MQTT_PSK_PORT 8884
+
+#ifndef PSK_IDENTITY
+#define PSK_IDENTITY ""                                                                                          // Set both in platformio.ini, e.g. -D PSK_IDENTITY=\"soil_quality_sensor_0\" -D PSK_KEY=\"<32 to 64 hex digits>\",
+#endif
+#ifndef PSK_KEY
+#define PSK_KEY ""                                                                                               // ...they are stored in NVS on the first boot, like ACCESS_TOKEN, so later builds may leave them out
+#endif
+
+#define TLS_PIN_MAX_WAKES 100                                                                                    // Number of wakes a cached fingerprint is trusted before a full chain validation against ROOT_CA is forced again
+// Broker failover macros ------------------------------------------------------------------------------------------------------------------------------------
+#define BROKER_AWAKE_BUDGET_MS 12000                                                                             // Time a battery node spends trying brokers on one wake before giving up until the next
+#define BROKER_ROUND_BUDGET_MS 20000                                                                             // Same for one round of a mains-powered role, which waits 5 s and starts another
+#define BROKER_CONNECT_TIMEOUT_S 5                                                                               // TCP connect and TLS handshake of one attempt, so a dead host cannot eat the whole budget
+#define BROKER_PRIOR_LATENCY_MS 3000                                                                             // Assumed connect time of a broker not measured yet
+#define BROKER_MAX_FAILURES 3                                                                                    // Consecutive failed attempts before a broker is ranked last...
+#define BROKER_RETRY_CYCLES 10                                                                                   // ...and then only tried again, first of all, once every this many rounds
+// Downlink macros -------------------------------------------------------------------------------------------------------------------------------------------
+#define DOWNLINK_EVERY 10                                                                                        // A listen window for RPCs and shared attributes after every this many publications...
+#define DOWNLINK_WINDOW_MS 2000                                                                                  // ...kept open this long. Both can be changed from ThingsBoard ("downlinkEvery", "downlinkWindowMs")
+#define DOWNLINK_WINDOW_MAX_MS 30000                                                                             // Upper bound of a window set from ThingsBoard, so a typo cannot drain the battery
+#define DOWNLINK_QUEUE_LEN 4                                                                                     // Messages handled per wake, later ones are dropped
+#define DOWNLINK_TOPIC_MAX 64
+#define DOWNLINK_PAYLOAD_MAX 192
+// History macros --------------------------------------------------------------------------------------------------------------------------------------------
+#define HISTORY_ENABLED true                                                                                     // If set to true, every timestamped sample is also appended to flash, sent or not, for backfilling gaps on request
+#define HISTORY_PARTITION "history"                                                                              // Data partition used as a raw ring of 4 KB segments, see partitions.csv. 1.4 MB: ~30 days at 30 s
+#define HISTORY_BATCH_BYTES 4096                                                                                 // Largest telemetry message of a replay, streamed so it does not need the MQTT buffer
+#define HISTORY_RPC_MAX_RECORDS 960                                                                              // Samples replayed per "getHistory" call, 8 h at 30 s. The answer says where to continue from
+// Outbox macros ---------------------------------------------------------------------------------------------------------------------------------------------
+#define OUTBOX_AWAKE_BUDGET_MS 8000                                                                              // Awake time since boot after which no more backlog is sent, and a node that could not deliver its sample gives up and sleeps
+#define OUTBOX_BACKLOG_CHUNK 240                                                                                 // Samples replayed from the flash history per round, streamed in HISTORY_BATCH_BYTES messages
+#define ALARM_TEMP_MIN_C 0.0f                                                                                    // "soilTemperature" under this raises the frost alarm...
+#define ALARM_TEMP_MAX_C 35.0f                                                                                   // ...and over this the heat one
+#define ALARM_TEMP_HYSTERESIS_C 0.5f                                                                             // An alarm only clears this far back inside its limit, so a value sitting on the limit does not flood the broker
+#define ALARM_MOIST_MIN 15.0f                                                                                    // "soilMoisture" in % under this raises the dry alarm...
+#define ALARM_MOIST_MAX 95.0f                                                                                    // ...and over this the waterlogged one
+#define ALARM_MOIST_HYSTERESIS 2.0f
+// Dual prediction macros ------------------------------------------------------------------------------------------------------------------------------------
+#ifndef PREDICTION_REPORTING
+#define PREDICTION_REPORTING false                                                                               // If set to true, a sample is only sent when the shared trend model mispredicts it, see tools/predict_reconstruct.cpp
+#endif
+#define PREDICT_TEMP_TOLERANCE_C 0.3f                                                                            // Largest prediction error the dashboard may show for "soilTemperature"...
+#define PREDICT_MOIST_TOLERANCE 1.5f                                                                             // ...and for "soilMoisture", in %
+#define PREDICT_HEARTBEAT_WAKES 20                                                                               // A sample is sent after this many suppressed wakes anyway, so silence never means a dead sensor for long
+#define PREDICT_STEP_MS (SLEEP_DURATION_S * 1000ULL)                                                             // Time axis of the model: the slot of the sleep grid a sample was taken in, from its "ts"
+// Deep sleep macros -----------------------------------------------------------------------------------------------------------------------------------------
+#define SLEEP_DURATION_S 30ULL                                                                                   // Period between messages, the time spent awake is taken out of the sleep
+#define QUIET_WAKES 3                                                                                            // Samples in a row within the deltas below before the sleep is stretched...
+#define QUIET_SKIP_SLOTS 3                                                                                       // ...over this many more slots of the grid, nothing is measured during them
+#define QUIET_TEMP_DELTA_C 0.25f                                                                                 // Send-on-delta thresholds: a sample that moved more than this is not quiet
+#define QUIET_MOIST_DELTA 1.0f                                                                                   // %
+// Button fast path macros -----------------------------------------------------------------------------------------------------------------------------------
+#define BUTTON_TEMPERATURE_SAMPLES 1                                                                             // A button wake takes one sample of each sensor at the lowest resolution...
+#define BUTTON_MOISTURE_SAMPLES 1
+#define BUTTON_MAX_LATENCY_MS 1500                                                                               // ...and, on the multi-uplink node, only considers uplinks expected to deliver within this
+// Sensor macros ---------------------------------------------------------------------------------------------------------------------------------------------
+#define ONE_WIRE_PIN 13                                                                                          // Perfectly fine to use as it is a digital I/O
+#define SOIL_MOIST_PIN 32                                                                                        // Very carefully selected not to use a pin that is already being used by Wi-Fi (ADC2 pins), or other peripherals included on the T-Beam
+#define TEMPERATURE_SAMPLES 5
+#define TEMP_PROBES_MAX 4                                                                                        // DS18B20 probes handled on ONE_WIRE_PIN, no more than FRAME_MAX_PROBES
+#define TEMP_PROBE_DEPTHS_CM {10, 30, 60, 90}                                                                    // Depth of each probe, in the order of TEMP_PROBE_ROMS, or of ascending ROM codes without it
+#ifndef TEMP_PROBE_ROMS
+#define TEMP_PROBE_ROMS {}                                                                                       // ROM code of the probe at each depth as printed at boot, set per node in platformio.ini, e.g. {{0x28, 0xFF, 0x64, 0x1E, 0x0F, 0x5C, 0x3A, 0x91}, ...}. Left empty, depths go by ascending ROM code, which a replaced probe reshuffles
+#endif
+#define TEMP_RESOLUTION_MIN 9                                                                                    // Bits: 9 bit = 0.5 ºC in ~94 ms, 10 = 0.25 ºC, 11 = 0.125 ºC, 12 bit = 0.0625 ºC in ~750 ms
+#define TEMP_RESOLUTION_DEFAULT 11                                                                               // Used while readings move but are away from the region of interest
+#define TEMP_RESOLUTION_MAX 12
+#define TEMP_ROI_MIN_C -2.0f                                                                                     // Region of interest: around freezing, where frost detection needs full resolution
+#define TEMP_ROI_MAX_C 4.0f
+#define TEMP_ROI_MARGIN_C 1.5f                                                                                   // Full resolution is already used this close to the region of interest
+#define TEMP_STABLE_DELTA_C 0.25f                                                                                // A probe changing less than this between wakes is considered stable...
+#define TEMP_STABLE_WAKES 5                                                                                      // ...and after this many stable wakes in a row, the lowest resolution is used
+#define TEMP_LOW_BATT_V 3.5f                                                                                     // Below this battery voltage, the lowest resolution is used unless in the region of interest
+#define TEMP_CONVERSION_TIMEOUT_MS 800                                                                           // A 12-bit conversion takes 750 ms at most
+#define MOISTURE_SAMPLES 5
+// Sensor power macros ---------------------------------------------------------------------------------------------------------------------------------------
+// Off by default: the deployed nodes feed both sensors from the 3V3 pin, AXP192 DCDC1, which also feeds the OLED and has no per-sensor switch.
+// The other AXP192 outputs do not reach the header. Wire a sensor's VCC to a free GPIO, e.g. 14 or 25 on the T-Beam, and set it per node in platformio.ini
+#ifndef TEMP_RAIL_GPIO
+#define TEMP_RAIL_GPIO -1                                                                                        // -1 if the DS18B20 probes are fed from the 3V3 pin, or the GPIO that feeds them
+#endif
+#define TEMP_RAIL_WARMUP_MS 5                                                                                    // Time from power-up to a reliable presence pulse
+#ifndef MOIST_RAIL_GPIO
+#define MOIST_RAIL_GPIO -1                                                                                       // Same for the FC-38, a GPIO can source its few mA and switches it on its own
+#endif
+#define MOIST_RAIL_WARMUP_MS 20                                                                                  // Time for the FC-38 divider and comparator to settle before the ADC reads it
+#ifndef OLED_ON_DCDC1
+#define OLED_ON_DCDC1 false                                                                                      // true on a board with the OLED fitted: DCDC1 then stays on and the sensors on it are never switched
+#endif
+#define DCDC1_SWITCHED (DEVICE_ROLE != ROLE_GATEWAY && !OLED_ON_DCDC1)                                           // The mains-powered gateway keeps the 3V3 pin up like the original firmware did
+// Sensor health macros --------------------------------------------------------------------------------------------------------------------------------------
+#define HEALTH_TEMP_MIN_C -20.0f                                                                                 // Soil readings outside this range are treated as a faulty probe
+#define HEALTH_TEMP_MAX_C 60.0f
+#define HEALTH_TEMP_MAX_SPREAD_C 2.0f                                                                            // Largest difference allowed between the samples of one probe in a wake
+#define HEALTH_MOIST_RAW_MIN 16                                                                                  // ADC counts, readings at the rails mean an open or shorted FC-38
+#define HEALTH_MOIST_RAW_MAX 4080
+#define HEALTH_MOIST_MAX_SPREAD_RAW 50                                                                           // Largest difference in ADC counts allowed between the moisture samples of a wake
+#define HEALTH_STUCK_WAKES 10                                                                                    // A live resistive probe always shows some ADC noise, this many perfectly flat identical wakes means it is stuck
+#define HEALTH_MAX_RETRIES 2                                                                                     // Extra acquisitions per wake when a new fault shows up, a fault that survives them is not retried again
+#define HEALTH_REPORT_WAKES 20                                                                                   // When nothing valid can be sent, the radio is only used to report the faults once every this many wakes
+// Irrigation macros -----------------------------------------------------------------------------------------------------------------------------------------
+#define IRRIGATION_RULE false                                                                                    // If set to true, the node opens a valve itself on dry soil, before and whatever the network does
+#define IRRIGATION_OPEN_BELOW 30.0f                                                                              // "soilMoisture" in % under which the valve opens...
+#define IRRIGATION_CLOSE_ABOVE 40.0f                                                                             // ...and above which it closes again, the gap keeps it from chattering around one threshold
+#define IRRIGATION_MAX_OPEN_WAKES 20                                                                             // Wakes the valve may stay open, then it closes and stays closed until the soil reads wet once
+#define IRRIGATION_VALVE_GPIO -1                                                                                 // -1 if no valve is wired to the node, or the GPIO driving its relay or MOSFET
+#define IRRIGATION_VALVE_ACTIVE_HIGH true
+#define IRRIGATION_ESPNOW false                                                                                  // If set to true, the valve state is also sent to an ESP-NOW valve controller...
+#define IRRIGATION_PEER_MAC {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}                                                 // ...at this MAC, on ESPNOW_CHANNEL on an ESP-NOW node and on the AP channel once associated
 // MACROS END ================================================================================================================================================
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// MQTT-SN 1.2 MESSAGE TYPES, ONLY THE ONES A SENSOR AND ITS GATEWAY EXCHANGE
+#define MQTTSN_CONNECT 0x04
+#define MQTTSN_CONNACK 0x05
+#define MQTTSN_PUBLISH 0x0C
+#define MQTTSN_PUBACK 0x0D
+#define MQTTSN_DISCONNECT 0x18
+
+// PUBLISH AND CONNECT FLAGS
+#define MQTTSN_FLAG_QOS_M1 0x60                                                                                  // QoS -1: no connection, no reply, a single datagram
+#define MQTTSN_FLAG_QOS_0 0x00
+#define MQTTSN_FLAG_QOS_1 0x20
+#define MQTTSN_FLAG_CLEAN_SESSION 0x04
+#define MQTTSN_FLAG_TOPIC_PREDEFINED 0x01                                                                        // Topic id agreed beforehand with the gateway, no REGISTER exchange
+
+#define MQTTSN_RC_ACCEPTED 0x00
+#define MQTTSN_HEADER_LEN 2                                                                                      // Short form (length, type), every message here stays under 256 bytes
+#define MQTTSN_PUBLISH_OVERHEAD 7                                                                                // Header, flags, topic id and message id in front of the data
+
+size_t mqttSnConnect(uint8_t* buf, size_t size, const char* clientId, uint16_t keepAliveS);
+size_t mqttSnPublish(uint8_t* buf, size_t size, uint8_t flags, uint16_t topicId, uint16_t msgId, const uint8_t* data, size_t len);
+size_t mqttSnConnack(uint8_t* buf, size_t size, uint8_t returnCode);
+size_t mqttSnPuback(uint8_t* buf, size_t size, uint16_t topicId, uint16_t msgId, uint8_t returnCode);
+size_t mqttSnDisconnect(uint8_t* buf, size_t size);
+
+size_t mqttSnParse(const uint8_t* buf, size_t len, uint8_t* type);
+bool mqttSnParsePublish(const uint8_t* buf, size_t len, uint8_t* flags, uint16_t* topicId, uint16_t* msgId, const uint8_t** data, size_t* dataLen);
+bool mqttSnParsePuback(const uint8_t* buf, size_t len, uint16_t* topicId, uint16_t* msgId, uint8_t* returnCode);
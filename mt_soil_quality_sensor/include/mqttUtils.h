@@ -1,7 +1,12 @@
-#pragma once
-
-#include <PubSubClient.h>
-#include <WiFiClientSecure.h>
-
-void connectToMQTT(PubSubClient& client, WiFiClientSecure &clientSecure, const char* rootCa, const char* mqttServer, const uint16_t mqttPort);
-void reconnectToMQTT(PubSubClient& client, const char* clientId, const char* token, SemaphoreHandle_t serialSemaphore);
+#pragma once
+
+#include <PubSubClient.h>
+#include <WiFiClientSecure.h>
+#include "frameUtils.h"
+
+void connectToMQTT(PubSubClient& client, WiFiClientSecure &clientSecure, const char* rootCa, const char* mqttServer, const uint16_t mqttPort);
+bool connectToBroker(PubSubClient& client, const char* clientId, const char* token, uint32_t budgetMs, SemaphoreHandle_t serialSemaphore);
+bool tryConnectToMQTT(PubSubClient& client, const char* clientId, const char* token, SemaphoreHandle_t serialSemaphore);
+void reconnectToMQTT(PubSubClient& client, const char* clientId, const char* token, SemaphoreHandle_t serialSemaphore);
+void disconnectFromMQTT(PubSubClient& client, SemaphoreHandle_t serialSemaphore);
+bool publishAttributes(PubSubClient& client, const SampleFrame& frame, SemaphoreHandle_t serialSemaphore);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+#include <PubSubClient.h>
+#include "frameUtils.h"
+
+// Alarm bits of the "alarms" telemetry key
+#define ALARM_FROST 0x01
+#define ALARM_HEAT 0x02
+#define ALARM_DRY 0x04
+#define ALARM_WATERLOGGED 0x08
+#define ALARM_SENSOR 0x10                                                                                        // Any FRAME_FAULT_* bit
+#define ALARM_VALVE 0x20                                                                                         // FRAME_VALVE_TIMEOUT
+
+enum OutboxLane : uint8_t {                                                                                      // Highest priority first
+  LANE_ALARM,                                                                                                    // A change in the active alarms, tiny and sent before anything else
+  LANE_LIVE,                                                                                                     // The sample of this wake
+  LANE_BACKLOG,                                                                                                  // Samples of earlier wakes that never got through, replayed from the flash history
+  LANE_COUNT
+};
+
+uint8_t outboxAlarms(const SampleFrame& frame);
+bool outboxAlarmPending(const SampleFrame& frame);
+bool outboxSendLive(PubSubClient& client, const SampleFrame& frame, SemaphoreHandle_t serialSemaphore);
+uint16_t outboxDrainBacklog(PubSubClient& client, const SampleFrame& frame, SemaphoreHandle_t serialSemaphore);
+void outboxMissed(const SampleFrame& frame);
+bool outboxBacklogPending();
+void outboxDelivered(const SampleFrame& frame);
@@ -1,6 +1,16 @@
-#pragma once
-
-#include <axp20x.h>
-
-void setupPower(AXP20X_Class& axp192, const uint8_t pmuIRQPin, void (*isr)());
+#pragma once
+
+#include <axp20x.h>
+
+enum SensorRail : uint8_t {
+  RAIL_TEMPERATURE,                                                                                              // DS18B20 probes
+  RAIL_MOISTURE,                                                                                                 // FC-38 probe, corrodes by electrolysis for as long as it is powered
+  RAIL_COUNT
+};
+
+void setupPower(AXP20X_Class& axp192, const uint8_t pmuIRQPin, void (*isr)());
+void setupSensorRails(AXP20X_Class& axp192);
+void sensorRailOn(SensorRail rail);
+void sensorRailWaitReady(SensorRail rail);
+void sensorRailOff(SensorRail rail);
 void pekThreadRoutine(volatile bool* pekPressedFlag, AXP20X_Class& axp192, SemaphoreHandle_t serialSemaphore);
\ No newline at end of file
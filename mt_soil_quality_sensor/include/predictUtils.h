@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+#include "frameUtils.h"
+
+#define PREDICT_TREND_SHIFT 8                                                                                    // "trend" is kept in 1/256 of a hundredth per slot
+
+struct Predictor {                                                                                               // Integer only, so the sensor and the host reconstruct exactly the same series
+  int32_t level;                                                                                                 // Hundredths of the unit, last value delivered
+  int32_t trend;                                                                                                 // Smoothed slope between delivered values, see PREDICT_TREND_SHIFT
+  uint32_t step;                                                                                                 // Slot of the last value delivered, see "predictStep()"
+  bool valid;
+};
+
+int32_t predictToHundredths(float value);
+uint32_t predictStep(uint64_t tsMs);
+int32_t predictAt(const Predictor& model, uint32_t step);
+void predictUpdate(Predictor& model, uint32_t step, int32_t value);
+
+bool predictionShouldSend(const SampleFrame& frame);
+void predictionDelivered(const SampleFrame& frame);
@@ -0,0 +1,7 @@
+#pragma once
+
+#ifdef ARDUINO
+  #include <esp_attr.h>                                                                                          // RTC_DATA_ATTR
+#else
+  #define RTC_DATA_ATTR                                                                                          // Host builds have no RTC memory
+#endif
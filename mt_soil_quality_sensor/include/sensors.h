@@ -1,5 +1,10 @@
-#pragma once
-
-void initSensors();
-float getMedianTemperatureC(uint8_t samples);
-float getMedianSoilMoisture(uint8_t samples);
\ No newline at end of file
+#pragma once
+
+#include <stdint.h>
+
+void initSensors();
+uint8_t selectTemperatureResolution(float batVolt);
+uint8_t selectFastTemperatureResolution();
+uint8_t getMedianTemperaturesC(float* temps, uint8_t maxProbes, uint8_t samples, float* spreads);
+uint8_t getProbeDepthCm(uint8_t probe);
+float getMedianSoilMoisture(uint8_t samples, uint16_t* raw, uint16_t* spreadRaw);
\ No newline at end of file
@@ -1,4 +1,7 @@
-#pragma once
-
-void sleep_interrupt(gpio_num_t gpio, uint8_t mode);
-void sleep_seconds(uint64_t seconds);
\ No newline at end of file
+#pragma once
+
+void sleep_interrupt(gpio_num_t gpio, uint8_t mode);
+void sleep_period(uint64_t seconds);
+int32_t sleep_wake_lag_ms();
+void sleep_skip_slots(uint8_t slots);
+bool sleep_button_wake();
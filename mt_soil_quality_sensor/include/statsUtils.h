@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include "frameUtils.h"
+
+struct RunningStats {                                                                                            // Welford accumulator: constant space whatever the number of samples
+  uint16_t count;
+  float mean;
+  float m2;                                                                                                      // Sum of squared differences from the current mean
+  float min;
+  float max;
+};
+
+void statsReset(RunningStats& stats);
+void statsAdd(RunningStats& stats, float value);
+WindowSummary statsSummary(const RunningStats& stats);
+
+void windowAddSample(SampleFrame& frame);
+void windowReset();
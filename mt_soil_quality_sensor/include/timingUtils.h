@@ -0,0 +1,18 @@
+#pragma once
+
+#include <Arduino.h>
+
+enum TimingPhase : uint8_t {
+  PHASE_TLS_FULL,                                                                                                // TCP + TLS handshake validating the whole broker chain against ROOT_CA
+  PHASE_TLS_PINNED,                                                                                              // TCP + TLS handshake checking only the cached certificate fingerprint
+  PHASE_TLS_BUNDLE,                                                                                              // TCP + TLS handshake validating the chain against the preparsed CA_BUNDLE, no PEM parsing
+  PHASE_TLS_PSK,                                                                                                 // TCP + TLS-PSK handshake with the local broker, no certificates and no public-key operations
+  PHASE_MQTT_CONNECT,                                                                                            // MQTT CONNECT/CONNACK once the TLS session is up
+  PHASE_TEMP_CONVERSION,                                                                                         // One simultaneous DS18B20 conversion, its length depends on the resolution
+  PHASE_COUNT
+};
+
+void phaseStart(TimingPhase phase);
+uint32_t phaseEnd(TimingPhase phase);
+void phaseSaved(TimingPhase phase, uint32_t savedUs);
+void printPhaseTimings(SemaphoreHandle_t serialSemaphore);
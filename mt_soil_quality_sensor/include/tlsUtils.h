@@ -0,0 +1,6 @@
+#pragma once
+
+#include <WiFiClientSecure.h>
+
+void setupTLS(WiFiClientSecure& clientSecure, const char* rootCa, const char* host, const uint16_t port, const bool psk);
+bool connectTLS(SemaphoreHandle_t serialSemaphore);
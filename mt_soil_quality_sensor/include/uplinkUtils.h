@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "frameUtils.h"
+
+#define MAX_UPLINKS 4
+
+struct UplinkCost {
+  float connectUj;                                                                                               // Energy to bring the link up: association, handshake, radio start-up... (µJ)
+  float perByteUj;                                                                                               // Energy per payload byte actually sent (µJ)
+  uint32_t latencyMs;                                                                                            // Expected time from send() to delivery
+};
+
+class Uplink {
+  public:
+    virtual ~Uplink() {}
+    virtual const char* name() const = 0;
+    virtual UplinkCost cost() const = 0;
+    virtual size_t payloadSize(const SampleFrame& frame) const = 0;                                              // Bytes this uplink would put on air for the frame
+    virtual bool available() = 0;                                                                                // Cheap check, must not bring the link up
+    virtual bool send(const SampleFrame& frame) = 0;
+    virtual void end() {}                                                                                        // Power the link down before deep sleep
+
+    float estimateUj(const SampleFrame& frame) const {
+      UplinkCost c = cost();
+      return c.connectUj + c.perByteUj * payloadSize(frame);
+    }
+};
+
+// SIMULATED UPLINK: NO RADIO AT ALL, SO THE POLICY CAN BE EXERCISED ON THE HOST
+class SimUplink : public Uplink {
+  public:
+    SimUplink(const char* name, UplinkCost cost, size_t frameBytes) : simName(name), simCost(cost), simBytes(frameBytes) {}
+    const char* name() const override { return simName; }
+    UplinkCost cost() const override { return simCost; }
+    size_t payloadSize(const SampleFrame&) const override { return simBytes; }
+    bool available() override { return up; }
+    bool send(const SampleFrame& frame) override;
+
+    bool up = true;                                                                                              // What available() reports
+    bool delivers = true;                                                                                        // What send() returns
+    uint32_t sent = 0;                                                                                           // Successful sends
+    uint32_t attempts = 0;
+    SampleFrame last = {};
+
+  private:
+    const char* simName;
+    UplinkCost simCost;
+    size_t simBytes;
+};
+
+Uplink* selectUplink(Uplink* const* uplinks, uint8_t count, const SampleFrame& frame, uint32_t maxLatencyMs);
+Uplink* sendWithPolicy(Uplink* const* uplinks, uint8_t count, const SampleFrame& frame, uint32_t maxLatencyMs);
+void resetUplinkHealth();
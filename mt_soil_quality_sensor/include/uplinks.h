@@ -0,0 +1,80 @@
+#pragma once
+
+#include <PubSubClient.h>
+#include <WiFiUdp.h>
+#include <axp20x.h>
+#include "uplinkUtils.h"
+
+// WI-FI + TLS + MQTT STRAIGHT TO THINGSBOARD, THE ORIGINAL PATH
+class MqttUplink : public Uplink {
+  public:
+    MqttUplink(PubSubClient& client, const char* ssid, const char* password, const char* clientId, const char* token, SemaphoreHandle_t serialSemaphore);
+    const char* name() const override { return "mqtt"; }
+    UplinkCost cost() const override;
+    size_t payloadSize(const SampleFrame& frame) const override;
+    bool available() override;
+    bool send(const SampleFrame& frame) override;
+    void end() override;
+    uint16_t drainBacklog(const SampleFrame& frame);
+
+  private:
+    PubSubClient& mqttClient;
+    const char* wifiSsid;
+    const char* wifiPassword;
+    const char* mqttClientId;
+    const char* mqttToken;
+    SemaphoreHandle_t semaphore;
+};
+
+// WI-FI + MQTT-SN OVER UDP TO A LOCAL GATEWAY, THE SAMPLE TRAVELS AS ONE BINARY FRAME IN ONE DATAGRAM
+class MqttSnUplink : public Uplink {
+  public:
+    MqttSnUplink(const char* ssid, const char* password, const char* clientId) : wifiSsid(ssid), wifiPassword(password), snClientId(clientId) {}
+    const char* name() const override { return "mqttsn"; }
+    UplinkCost cost() const override;
+    size_t payloadSize(const SampleFrame& frame) const override;
+    bool available() override;
+    bool send(const SampleFrame& frame) override;
+    void end() override;
+
+  private:
+    bool exchange(const uint8_t* msg, size_t len, uint8_t replyType, uint8_t* reply, size_t* replyLen);
+
+    const char* wifiSsid;
+    const char* wifiPassword;
+    const char* snClientId;
+    WiFiUDP udp;
+    bool ready = false;
+};
+
+// ESP-NOW TO A GATEWAY, NO ASSOCIATION AND NO IP
+class EspNowUplink : public Uplink {
+  public:
+    EspNowUplink(const uint8_t* peerMac, uint8_t channel) : gatewayMac(peerMac), espNowChannel(channel) {}
+    const char* name() const override { return "espnow"; }
+    UplinkCost cost() const override;
+    size_t payloadSize(const SampleFrame& frame) const override { return frameLength(frame); }
+    bool available() override;
+    bool send(const SampleFrame& frame) override;
+
+  private:
+    const uint8_t* gatewayMac;
+    uint8_t espNowChannel;
+    bool ready = false;
+};
+
+// RAW LORA FRAME THROUGH THE T-BEAM SX1276, POWERED FROM THE AXP192 LDO2 ONLY WHILE IT IS USED
+class LoraUplink : public Uplink {
+  public:
+    LoraUplink(AXP20X_Class& axp192) : pmu(axp192) {}
+    const char* name() const override { return "lora"; }
+    UplinkCost cost() const override;
+    size_t payloadSize(const SampleFrame& frame) const override { return frameLength(frame); }
+    bool available() override;
+    bool send(const SampleFrame& frame) override;
+    void end() override;
+
+  private:
+    AXP20X_Class& pmu;
+    bool ready = false;
+};
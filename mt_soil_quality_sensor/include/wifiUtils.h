@@ -1,4 +1,6 @@
-#pragma once
-
-void connectToWiFi(bool stateLED, AXP20X_Class& axp192, const char* ssid, const char* password, const uint8_t ledPin, const uint8_t pmuIRQPin);
-void reconnectToWiFi(bool stateLED, const char* ssid, const char* password, uint8_t ledPin, SemaphoreHandle_t serialSemaphore);
\ No newline at end of file
+#pragma once
+
+void beginWiFi(const char* ssid, const char* password);
+bool pollWiFi(const char* ssid, const char* password, uint32_t startMs);
+bool connectToWiFi(bool stateLED, AXP20X_Class& axp192, const char* ssid, const char* password, const uint8_t ledPin, const uint8_t pmuIRQPin, uint32_t timeoutMs);
+bool reconnectToWiFi(bool stateLED, const char* ssid, const char* password, uint8_t ledPin, SemaphoreHandle_t serialSemaphore, uint32_t timeoutMs);
\ No newline at end of file
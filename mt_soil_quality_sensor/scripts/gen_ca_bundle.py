@@ -0,0 +1,99 @@
+# Converts ROOT_CA in include/macros.h into include/caBundle.h, a certificate bundle in the format WiFiClientSecure::setCACertBundle() expects:
+# a big-endian certificate count, then per certificate the lengths of its subject name and public key followed by both in DER. The subject and the
+# public key are all the handshake needs from a trust anchor, so the ESP32 no longer base64-decodes and X.509-parses the PEM on every connection.
+#
+# Runs before every PlatformIO build (extra_scripts = pre:...) and only rewrites the header when ROOT_CA changed. It can also be run by hand:
+#   python scripts/gen_ca_bundle.py
+import base64
+import os
+import re
+import struct
+
+def read_root_ca(path):
+    """PEM text of the ROOT_CA macro, joined from its string literal continuation lines."""
+    with open(path, encoding="utf-8") as f:
+        text = f.read()
+    match = re.search(r"#define ROOT_CA (.*?-----END CERTIFICATE-----\\n\")", text, re.S)
+    if match is None:
+        raise RuntimeError("ROOT_CA not found in " + path)
+    return "".join(re.findall(r'"((?:[^"\\]|\\.)*)"', match.group(1))).replace("\\n", "\n")
+
+
+def pem_to_der(pem):
+    body = re.search(r"-----BEGIN CERTIFICATE-----(.*?)-----END CERTIFICATE-----", pem, re.S).group(1)
+    return base64.b64decode("".join(body.split()))
+
+
+def der_element(data, offset):
+    """(tag, start of the whole element, start of its content, end) of the DER element at offset."""
+    tag = data[offset]
+    length = data[offset + 1]
+    content = offset + 2
+    if length & 0x80:
+        count = length & 0x7F
+        length = int.from_bytes(data[content:content + count], "big")
+        content += count
+    return tag, offset, content, content + length
+
+
+def subject_and_key(der):
+    """Raw DER of the subject Name and of the SubjectPublicKeyInfo in a certificate."""
+    _, _, cert, _ = der_element(der, 0)                                          # Certificate
+    _, _, tbs, tbs_end = der_element(der, cert)                                  # TBSCertificate
+    fields = []
+    offset = tbs
+    while offset < tbs_end:
+        tag, start, _, end = der_element(der, offset)
+        if tag != 0xA0:                                                          # Optional [0] version, not counted
+            fields.append(der[start:end])
+        offset = end
+    # serialNumber, signature, issuer, validity, subject, subjectPublicKeyInfo, ...
+    return fields[4], fields[5]
+
+
+def bundle(certs):
+    certs = sorted(certs, key=lambda c: c[0])                                    # Looked up by subject with a binary search
+    out = struct.pack(">H", len(certs))
+    for subject, key in certs:
+        out += struct.pack(">HH", len(subject), len(key)) + subject + key
+    return out
+
+
+def render(data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("  " + ", ".join("0x%02X" % b for b in data[i:i + 16]) + ",")
+    return ("#pragma once\n"
+            "\n"
+            "// GENERATED by scripts/gen_ca_bundle.py from ROOT_CA in macros.h, do not edit\n"
+            "#include <stdint.h>\n"
+            "\n"
+            "static const uint8_t CA_BUNDLE[] = {\n" + "\n".join(lines) + "\n};\n")
+
+
+def project_dir():
+    """PlatformIO runs the script through SCons, which may not define __file__, so its env is asked first."""
+    try:
+        Import("env")                                                            # noqa: F821, only defined when PlatformIO runs the script
+        return env["PROJECT_DIR"]                                                # noqa: F821
+    except NameError:
+        return os.path.dirname(os.path.dirname(os.path.abspath(__file__)))      # Run by hand
+
+
+def generate():
+    include_dir = os.path.join(project_dir(), "include")
+    macros_h = os.path.join(include_dir, "macros.h")
+    bundle_h = os.path.join(include_dir, "caBundle.h")
+    subject, key = subject_and_key(pem_to_der(read_root_ca(macros_h)))
+    text = render(bundle([(subject, key)]))
+    old = None
+    if os.path.exists(bundle_h):
+        with open(bundle_h, encoding="utf-8", newline="") as f:
+            old = f.read().replace("\r\n", "\n")
+    if old != text:
+        with open(bundle_h, "w", encoding="utf-8", newline="\r\n") as f:
+            f.write(text)
+        print("gen_ca_bundle: wrote " + bundle_h)
+
+
+generate()
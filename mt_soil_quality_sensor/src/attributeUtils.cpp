@@ -0,0 +1,66 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <stdio.h>
+#include <stdarg.h>
+#include "attributeUtils.h"                                                                                      // Plain C++ on purpose: the gateways on the host name devices the same way
+#include "macros.h"
+#include "rtcMemory.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+static RTC_DATA_ATTR uint32_t publishedHash = 0;                                                                 // Hash of the last attributes ThingsBoard acknowledged, 0 after a power-on or an OTA reboot
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+static int appendf(char* buf, size_t size, int len, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  bool room = buf != NULL && (size_t)len < size;
+  len += vsnprintf(room ? buf + len : NULL, room ? size - len : 0, format, args);
+  va_end(args);
+  return len;
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// ATTRIBUTE FUNCTIONS
+// ===========================================================================================================================================================
+// FORMAT THE FIELDS THAT DO NOT CHANGE BETWEEN WAKES AS A CLIENT ATTRIBUTES OBJECT, RETURNS LIKE "snprintf"
+// "own" ADDS WHAT ONLY THE SENSOR ITSELF KNOWS (FIRMWARE, ROLE, PERIOD), A GATEWAY ONLY KNOWS WHAT THE FRAME CARRIES
+int formatAttributesJson(char* buf, size_t size, const SampleFrame& frame, bool own) {
+  int len = appendf(buf, size, 0, "{\"treeId\":%d", frame.treeId);
+
+  if (own) {
+    len = appendf(buf, size, len, ",\"firmware\":\"%s\",\"role\":%d,\"periodS\":%lu", FIRMWARE_VERSION, DEVICE_ROLE, (unsigned long)SLEEP_DURATION_S);
+  }
+
+  len = appendf(buf, size, len, ",\"probeDepthsCm\":\"");                                                        // Only the probes that answered, so a dead one shows up here as well as in the faults
+  for (uint8_t i = 0; i < frame.probeCount && i < FRAME_MAX_PROBES; i++) {
+    len = appendf(buf, size, len, i == 0 ? "%u" : ",%u", frame.probeDepthCm[i]);
+  }
+  return appendf(buf, size, len, "\"}");
+}
+
+// FNV-1A, ONLY TO NOTICE A CHANGE: A COLLISION MEANS ONE MISSED UPDATE UNTIL THE NEXT CHANGE OR REBOOT
+uint32_t attributesHash(const char* json) {
+  uint32_t hash = 2166136261UL;
+  for (const char* p = json; *p != '\0'; p++) {
+    hash = (hash ^ (uint8_t)*p) * 16777619UL;
+  }
+  return hash != 0 ? hash : 1;                                                                                   // 0 is kept for "never published"
+}
+
+bool attributesChanged(const char* json) {
+  return attributesHash(json) != publishedHash;
+}
+
+// ONLY ONCE THE BROKER TOOK THEM, SO A FAILED PUBLICATION IS SENT AGAIN ON THE NEXT WAKE
+void attributesPublished(const char* json) {
+  publishedHash = attributesHash(json);
+}
+// ATTRIBUTE FUNCTIONS END ===================================================================================================================================
@@ -0,0 +1,103 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <string.h>
+#include "brokerUtils.h"                                                                                         // Plain C++ on purpose: the ranking is also built and tested on the host
+#include "macros.h"
+#include "rtcMemory.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+static RTC_DATA_ATTR BrokerHealth health[MAX_BROKERS];                                                           // Per endpoint slot, survives deep sleep so every wake starts with the fastest broker
+static RTC_DATA_ATTR bool healthInit = false;
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+static void initHealth() {
+  if (healthInit) return;
+  for (uint8_t i = 0; i < MAX_BROKERS; i++) health[i] = {0, 100, 0, 0};                                          // Optimistic until proven otherwise, so every broker gets tried
+  healthInit = true;
+}
+
+// SAME RULE AS THE UPLINKS: TOO MANY FAILURES IN A ROW AND THE BROKER IS ONLY TRIED AGAIN EVERY "BROKER_RETRY_CYCLES"
+static bool healthy(uint8_t index) {
+  return health[index].failures < BROKER_MAX_FAILURES;
+}
+
+// THE RETRY CYCLE OF AN UNHEALTHY BROKER ELAPSED: IT GOES FIRST FOR ONE ATTEMPT, ITS DEPRESSED SCORE WOULD KEEP IT OUT OF THE BUDGET OTHERWISE
+static bool retryDue(uint8_t index) {
+  return !healthy(index) && health[index].skipped >= BROKER_RETRY_CYCLES;
+}
+
+// RANK OF A BROKER BEFORE ITS SCORE IS LOOKED AT: A RETRY THAT IS DUE, THEN THE HEALTHY ONES, THEN THE OTHER UNHEALTHY ONES
+static uint8_t tier(uint8_t index) {
+  return retryDue(index) ? 0 : healthy(index) ? 1 : 2;
+}
+
+// EXPECTED TIME TO A CONNECTED SESSION: ONE ATTEMPT TAKES "latencyMs" AND ONLY "successPct" OF THEM WORK
+static uint32_t score(uint8_t index) {
+  uint32_t pct = health[index].successPct > 5 ? health[index].successPct : 5;                                    // Floor, so a broken broker still has a finite cost and keeps its rank
+  return brokerExpectedMs(index) * 100 / pct;
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// RANKING FUNCTIONS
+// ===========================================================================================================================================================
+// ORDER THE USABLE BROKERS: ONE WHOSE RETRY IS DUE, HEALTHY ONES BY EXPECTED TIME TO CONNECT, THEN THE UNHEALTHY ONES. TIES KEEP THE LIST ORDER
+// RETURNS HOW MANY INDEXES WERE WRITTEN TO "order"
+uint8_t rankBrokers(const BrokerEndpoint* brokers, const bool* usable, uint8_t count, uint8_t* order) {
+  uint8_t n = 0;
+
+  initHealth();
+  for (uint8_t i = 0; i < count && i < MAX_BROKERS; i++) {
+    if (!usable[i] || brokers[i].host == NULL || brokers[i].host[0] == '\0') continue;
+    if (!retryDue(i) && !healthy(i)) health[i].skipped++;                                                        // Count the round towards the next retry
+
+    uint8_t pos = n++;
+    while (pos > 0) {                                                                                            // Insertion sort, three entries at most
+      uint8_t prev = order[pos - 1];
+      bool before = tier(i) != tier(prev) ? tier(i) < tier(prev) : score(i) < score(prev);
+      if (!before) break;
+      order[pos] = prev;
+      pos--;
+    }
+    order[pos] = i;
+  }
+  return n;
+}
+
+// WHAT ONE ATTEMPT IS EXPECTED TO TAKE, FOR THE AWAKE-TIME BUDGET
+uint32_t brokerExpectedMs(uint8_t index) {
+  initHealth();
+  return health[index].latencyMs != 0 ? health[index].latencyMs : BROKER_PRIOR_LATENCY_MS;
+}
+
+void brokerResult(uint8_t index, bool success, uint32_t latencyMs) {
+  BrokerHealth& h = health[index];
+
+  initHealth();
+  h.successPct = h.successPct - (h.successPct >> 2) + (success ? 25 : 0);                                        // 1/4 running average, a few failures are enough to demote a broker
+  h.skipped = 0;
+  if (!success) {
+    if (h.failures < 255) h.failures++;
+    return;
+  }
+  h.failures = 0;
+  h.latencyMs = h.latencyMs == 0 ? latencyMs : h.latencyMs - (h.latencyMs >> 2) + (latencyMs >> 2);              // Failed attempts say nothing about the latency, often they are just timeouts
+}
+
+const BrokerHealth& brokerHealth(uint8_t index) {
+  initHealth();
+  return health[index];
+}
+
+void resetBrokerHealth() {
+  healthInit = false;
+  initHealth();
+}
+// RANKING FUNCTIONS END =====================================================================================================================================
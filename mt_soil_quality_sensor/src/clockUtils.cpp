@@ -0,0 +1,84 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
+#include <sys/time.h>
+#include <esp_sntp.h>
+#include "clockUtils.h"
+#include "macros.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+#define MIN_VALID_EPOCH_S 1600000000UL                                                                           // Anything earlier means the clock was never set since the last power-on
+#define MAX_DRIFT_PPM 50000                                                                                      // 5 %, a larger error is a clock that was reset, not drift
+#define MIN_DRIFT_SPAN_MS 600000ULL                                                                              // Syncs closer than 10 min apart are too short to measure drift against the SNTP jitter
+
+static RTC_DATA_ATTR uint64_t syncEpochMs = 0;                                                                   // Time of the last SNTP sync, 0 if there was none since the power-on
+static RTC_DATA_ATTR int32_t driftPpm = 0;                                                                       // How fast the RTC ran against SNTP between the last syncs, positive when it ran ahead
+static bool syncAttempted = false;                                                                               // Not in RTC memory: one try per boot, however often the publication is retried
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// CLOCK FUNCTIONS
+// ===========================================================================================================================================================
+// SYSTEM TIME AS KEPT BY THE RTC, WHICH ESP-IDF CARRIES THROUGH DEEP SLEEP. 0 IF IT WAS NEVER SET
+static uint64_t rtcEpochMs(){
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  if((uint32_t)tv.tv_sec < MIN_VALID_EPOCH_S) return 0;
+  return (uint64_t)tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
+}
+
+// WALL-CLOCK TIME IN MS SINCE EPOCH, WITH THE MEASURED DRIFT TAKEN OUT OF WHAT THE RTC ACCUMULATED SINCE THE LAST SYNC. 0 WHILE UNKNOWN
+uint64_t clockNowMs(){
+  uint64_t now = rtcEpochMs();
+  if(now == 0 || syncEpochMs == 0 || now < syncEpochMs) return now;
+
+  int64_t correctionMs = (int64_t)(now - syncEpochMs) * driftPpm / 1000000;
+  return now - correctionMs;
+}
+
+// EVERY CLOCK_SYNC_EVERY_WAKES WAKES, OR RIGHT AWAY WHILE THE TIME IS UNKNOWN. THE WAKES ARE COUNTED IN TIME, SO SKIPPED WAKES COUNT TOO
+bool clockShouldSync(){
+  if(syncAttempted) return false;
+  uint64_t now = rtcEpochMs();
+  return syncEpochMs == 0 || now < syncEpochMs || now - syncEpochMs >= CLOCK_SYNC_EVERY_WAKES * SLEEP_DURATION_S * 1000ULL;
+}
+
+// ONE SNTP EXCHANGE, WI-FI MUST BE UP. THE GAP BETWEEN THE RTC TIME AND THE SNTP ONE OVER THE SPAN SINCE THE LAST SYNC IS THE DRIFT OF THE RTC
+// "idle" IS CALLED WHILE WAITING FOR THE REPLY, E.G. TO KEEP AN MQTT CONNECTION SERVICED FOR UP TO CLOCK_SYNC_TIMEOUT_MS
+bool clockSync(void (*idle)()){
+  syncAttempted = true;
+  uint64_t keptMs = rtcEpochMs();                                                                                // Uncorrected, the drift is measured on what the RTC alone did
+  uint32_t keptAt = millis();
+
+  sntp_set_sync_status(SNTP_SYNC_STATUS_RESET);
+  configTime(0, 0, NTP_SERVER);                                                                                  // UTC, ThingsBoard takes "ts" in ms since epoch
+  while(sntp_get_sync_status() != SNTP_SYNC_STATUS_COMPLETED){
+    if(millis() - keptAt > CLOCK_SYNC_TIMEOUT_MS){
+      sntp_stop();
+      return false;
+    }
+    if(idle != NULL) idle();
+    delay(10);
+  }
+  sntp_stop();                                                                                                   // No periodic polling, the next sync is decided by "clockShouldSync()"
+
+  uint64_t actualMs = rtcEpochMs();
+  if(keptMs != 0 && syncEpochMs != 0 && actualMs - syncEpochMs >= MIN_DRIFT_SPAN_MS){
+    int64_t errorMs = (int64_t)(keptMs + (millis() - keptAt)) - (int64_t)actualMs;
+    int64_t ppm = errorMs * 1000000 / (int64_t)(actualMs - syncEpochMs);
+    if(ppm > -MAX_DRIFT_PPM && ppm < MAX_DRIFT_PPM){
+      driftPpm = driftPpm == 0 ? (int32_t)ppm : (driftPpm + (int32_t)ppm) / 2;                                   // Smoothed, the RC oscillator also moves with temperature
+    }
+  }
+  syncEpochMs = actualMs;
+  return true;
+}
+
+int32_t clockDriftPpm(){
+  return driftPpm;
+}
+// CLOCK FUNCTIONS END =======================================================================================================================================
@@ -0,0 +1,85 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
+#include <Preferences.h>                                                                                         // Key-value store in the NVS partition, survives power-off and OTA updates
+#include "credentialUtils.h"
+#include "macros.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+#define NVS_NAMESPACE "creds"
+#define PLACEHOLDER_TOKEN "UNDEFINED_TOKEN"                                                                      // Default ACCESS_TOKEN in macros.h, never worth storing
+
+static char accessToken[64] = ACCESS_TOKEN;
+static char pskIdentity[64] = "";
+static char pskKey[65] = "";                                                                                     // Hex string, up to 32 bytes of key as WiFiClientSecure expects it
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// A KEY HAS AN EVEN NUMBER OF HEX DIGITS, 16 TO 32 BYTES SO IT IS NOT TRIVIAL TO GUESS
+static bool validPskKey(const char* key) {
+  size_t len = strlen(key);
+  if (len < 32 || len > 64 || (len % 2) != 0) return false;
+  for (size_t i = 0; i < len; i++) {
+    if (!isxdigit((unsigned char)key[i])) return false;
+  }
+  return true;
+}
+
+// BUILD-TIME VALUE IF ONE WAS GIVEN (AND STORED FOR THE NEXT FIRMWARE), THE NVS ONE OTHERWISE
+static void loadOne(Preferences& prefs, const char* name, const char* buildValue, char* value, size_t size) {
+  if (buildValue[0] != '\0') {
+    char stored[65] = "";
+    prefs.getString(name, stored, sizeof(stored));
+    if (strcmp(stored, buildValue) != 0) prefs.putString(name, buildValue);                                      // Only written when it changed, NVS has a limited number of erase cycles
+    strlcpy(value, buildValue, size);
+  } else {
+    prefs.getString(name, value, size);
+  }
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// CREDENTIAL FUNCTIONS
+// ===========================================================================================================================================================
+// PROVISIONING: VALUES IN platformio.ini ARE COPIED INTO NVS, SO A LATER BUILD WITHOUT THEM (E.G. THE SAME OTA IMAGE FOR EVERY TREE) STILL FINDS THEM
+void loadCredentials() {
+  Preferences prefs;
+  if (!prefs.begin(NVS_NAMESPACE, false)) {
+    Debugln(F("NVS not available, using the build-time credentials"));
+    return;
+  }
+
+  loadOne(prefs, "token", strcmp(ACCESS_TOKEN, PLACEHOLDER_TOKEN) != 0 ? ACCESS_TOKEN : "", accessToken, sizeof(accessToken));
+  if (accessToken[0] == '\0') strlcpy(accessToken, ACCESS_TOKEN, sizeof(accessToken));
+  loadOne(prefs, "pskId", PSK_IDENTITY, pskIdentity, sizeof(pskIdentity));
+  loadOne(prefs, "pskKey", PSK_KEY, pskKey, sizeof(pskKey));
+  prefs.end();
+
+  if (pskKey[0] != '\0' && !validPskKey(pskKey)) {
+    Debugln(F("Stored PSK key is not 16 to 32 bytes of hex, PSK mode disabled"));
+    pskKey[0] = '\0';
+  }
+}
+
+const char* getAccessToken() {
+  return accessToken;
+}
+
+const char* getPskIdentity() {
+  return pskIdentity;
+}
+
+const char* getPskKey() {
+  return pskKey;
+}
+
+bool pskAvailable() {
+  return pskIdentity[0] != '\0' && pskKey[0] != '\0';
+}
+// CREDENTIAL FUNCTIONS END ==================================================================================================================================
@@ -0,0 +1,141 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
+#include <PubSubClient.h>
+#include "downlinkUtils.h"
+#include "historyUtils.h"
+#include "macros.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+#define RPC_REQUEST_PREFIX "v1/devices/me/rpc/request/"
+
+struct DownlinkMessage {
+  char topic[DOWNLINK_TOPIC_MAX];
+  char payload[DOWNLINK_PAYLOAD_MAX];
+};
+
+static RTC_DATA_ATTR uint16_t listenEvery = DOWNLINK_EVERY;                                                      // Both can be changed from ThingsBoard through shared attributes or the "setDownlink" RPC
+static RTC_DATA_ATTR uint32_t listenWindowMs = DOWNLINK_WINDOW_MS;
+static RTC_DATA_ATTR uint16_t publishCount = 0;                                                                  // Publications since the last listen window
+
+static DownlinkMessage queue[DOWNLINK_QUEUE_LEN];                                                                // Filled by the callback, emptied in one batch after the window
+static uint8_t queued = 0;
+static uint8_t dropped = 0;
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// INTEGER VALUE OF "key" ANYWHERE IN A FLAT JSON OBJECT, NO JSON LIBRARY NEEDED FOR THE FEW KEYS UNDERSTOOD HERE
+static bool jsonInt(const char* json, const char* key, long long* value) {
+  char pattern[40];
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+  const char* p = strstr(json, pattern);
+  if (p == NULL) return false;
+
+  char* end;
+  *value = strtoll(p + strlen(pattern), &end, 10);                                                               // 64 bits, "ts" values in ms do not fit a long
+  return end != p + strlen(pattern);
+}
+
+static bool jsonStringIs(const char* json, const char* key, const char* expected) {
+  char pattern[64];
+  snprintf(pattern, sizeof(pattern), "\"%s\":\"%s\"", key, expected);
+  return strstr(json, pattern) != NULL;
+}
+
+// SETTINGS FROM A SHARED ATTRIBUTES UPDATE OR THE PARAMETERS OF AN RPC, OUT OF RANGE VALUES ARE CLAMPED
+static void applySettings(const char* json) {
+  long long value;
+  if (jsonInt(json, "downlinkEvery", &value)) listenEvery = constrain(value, 1, 1000);
+  if (jsonInt(json, "downlinkWindowMs", &value)) listenWindowMs = constrain(value, 0, DOWNLINK_WINDOW_MAX_MS);
+}
+
+static void receive(char* topic, uint8_t* payload, unsigned int length) {
+  if (queued == DOWNLINK_QUEUE_LEN || strlen(topic) >= DOWNLINK_TOPIC_MAX || length >= DOWNLINK_PAYLOAD_MAX) {
+    dropped++;                                                                                                   // QoS 1 was acknowledged already, ThingsBoard will not resend it
+    return;
+  }
+  DownlinkMessage& message = queue[queued++];
+  strcpy(message.topic, topic);
+  memcpy(message.payload, payload, length);
+  message.payload[length] = '\0';
+}
+
+// ON EVERY WINDOW: THINGSBOARD KEEPS NO MQTT SESSION, AND ANY BROKER DROPS THE SUBSCRIPTIONS ON A RESTART OR WHEN THE SESSION EXPIRES
+static bool subscribe(PubSubClient& client) {
+  return client.subscribe(MQTT_TOPIC_RPC_REQUEST, 1) && client.subscribe(MQTT_TOPIC_ATTRIBUTES, 1);
+}
+
+// ANSWER ONE RPC ON ITS RESPONSE TOPIC, THE REQUEST ID BEING THE LAST LEVEL OF THE REQUEST TOPIC
+static void answerRpc(PubSubClient& client, const DownlinkMessage& message) {
+  char topic[DOWNLINK_TOPIC_MAX + 8];
+  char response[96];
+
+  snprintf(topic, sizeof(topic), MQTT_TOPIC_RPC_RESPONSE "%s", message.topic + strlen(RPC_REQUEST_PREFIX));
+  if (jsonStringIs(message.payload, "method", "setDownlink")) {
+    applySettings(message.payload);
+  }
+  if (jsonStringIs(message.payload, "method", "setDownlink") || jsonStringIs(message.payload, "method", "getDownlink")) {
+    snprintf(response, sizeof(response), "{\"downlinkEvery\":%u,\"downlinkWindowMs\":%lu}", listenEvery, (unsigned long)listenWindowMs);
+  } else if (jsonStringIs(message.payload, "method", "getHistory")) {                                            // {"from":ms,"to":ms}, replayed as telemetry before the answer
+    long long fromMs = 0, toMs = INT64_MAX;
+    uint64_t lastMs;
+    bool more;
+    jsonInt(message.payload, "from", &fromMs);
+    jsonInt(message.payload, "to", &toMs);
+    if (fromMs < 0 || toMs < fromMs) {
+      snprintf(response, sizeof(response), "{\"error\":\"bad range\"}");
+    } else {
+      uint16_t sent = historyReplay(client, fromMs, toMs, HISTORY_RPC_MAX_RECORDS, 0, false, &lastMs, &more);    // "more" only when a matching record was left out
+      snprintf(response, sizeof(response), "{\"records\":%u,\"lastTs\":%llu,\"more\":%s}", sent, (unsigned long long)lastMs, more ? "true" : "false");
+    }
+  } else if (jsonStringIs(message.payload, "method", "ping")) {
+    snprintf(response, sizeof(response), "{\"uptimeMs\":%lu}", (unsigned long)millis());
+  } else {
+    snprintf(response, sizeof(response), "{\"error\":\"unknown method\"}");
+  }
+  client.publish(topic, response);
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// DOWNLINK FUNCTIONS
+// ===========================================================================================================================================================
+// SET RIGHT AFTER THE CLIENT IS CREATED. WITH MQTT_PERSISTENT_SESSION AND A BROKER THAT KEEPS SESSIONS, WHAT IT QUEUED WHILE ASLEEP ARRIVES ON CONNECT
+void downlinkAttach(PubSubClient& client) {
+  client.setCallback(receive);
+}
+
+// EVERY "listenEvery" PUBLICATIONS, STAY CONNECTED FOR "listenWindowMs" TO COLLECT RPCS AND SHARED ATTRIBUTE UPDATES.
+// WHATEVER ARRIVED IS THEN HANDLED IN ONE BATCH, SO THE AWAKE TIME IS BOUNDED AND THE COMMAND LATENCY PREDICTABLE
+void downlinkAfterPublish(PubSubClient& client, SemaphoreHandle_t serialSemaphore) {
+  if (++publishCount >= listenEvery && listenWindowMs > 0 && subscribe(client)) {
+    publishCount = 0;
+    uint32_t start = millis();
+    while (millis() - start < listenWindowMs && client.connected()) {
+      client.loop();
+      vTaskDelay(pdMS_TO_TICKS(10));
+    }
+  } else {
+    client.loop();                                                                                               // Outside the window, only what the session delivered on connect
+  }
+
+  if (queued == 0 && dropped == 0) return;
+  if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+    Debugf("Downlink: %u messages, %u dropped\n", queued, dropped);
+    xSemaphoreGive(serialSemaphore);
+  }
+
+  for (uint8_t i = 0; i < queued; i++) {
+    if (strncmp(queue[i].topic, RPC_REQUEST_PREFIX, strlen(RPC_REQUEST_PREFIX)) == 0) answerRpc(client, queue[i]);
+    else if (strcmp(queue[i].topic, MQTT_TOPIC_ATTRIBUTES) == 0) applySettings(queue[i].payload);
+  }
+  queued = 0;
+  dropped = 0;
+}
+// DOWNLINK FUNCTIONS END ====================================================================================================================================
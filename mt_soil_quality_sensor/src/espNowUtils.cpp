@@ -0,0 +1,204 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <string.h>
+#include "macros.h"
+#include "espNowUtils.h"
+
+#if !ESPNOW_LOOPBACK
+  #include <Arduino.h>                                                                                           // Library for PlatformIO to use the Arduino environment
+  #include <WiFi.h>
+  #include <esp_now.h>
+  #include <esp_wifi.h>
+#endif
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+#define RX_QUEUE_LEN 16                                                                                          // Frames buffered between the receive callback and the gateway task
+
+struct RxSlot {
+  uint8_t mac[6];
+  uint8_t len;
+  uint8_t data[FRAME_MAX_LEN];
+};
+
+static uint32_t droppedFrames = 0;                                                                               // Frames lost because the queue was full or they failed to decode
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+#if ESPNOW_LOOPBACK
+// ===========================================================================================================================================================
+// LOOPBACK BACKEND: FRAMES SENT ARE QUEUED IN MEMORY AND RECEIVED BY THE SAME PROCESS
+// ===========================================================================================================================================================
+static RxSlot loopbackQueue[RX_QUEUE_LEN];
+static uint8_t loopbackHead = 0, loopbackCount = 0;
+
+bool setupEspNow(uint8_t channel, const uint8_t* peerMac) {
+  (void)channel;                                                                                                 // No radio, no channel and no peer to register
+  (void)peerMac;
+  loopbackHead = 0;
+  loopbackCount = 0;
+  return true;
+}
+
+bool sendSampleFrame(const uint8_t* peerMac, const SampleFrame& frame) {
+  static const uint8_t selfMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};                                        // Locally administered address standing in for the node
+  (void)peerMac;                                                                                                 // Every frame lands in the one local queue
+  if (loopbackCount == RX_QUEUE_LEN) {
+    droppedFrames++;
+    return false;
+  }
+
+  RxSlot& slot = loopbackQueue[(loopbackHead + loopbackCount) % RX_QUEUE_LEN];
+  memcpy(slot.mac, selfMac, sizeof(slot.mac));
+  slot.len = encodeFrame(frame, slot.data, sizeof(slot.data));
+  if (slot.len == 0) return false;
+  loopbackCount++;
+  return true;
+}
+
+bool sendValveCommand(const uint8_t* peerMac, int16_t treeId, bool open) {
+  (void)peerMac;
+  (void)treeId;
+  (void)open;
+  return true;                                                                                                   // No valve controller on the host, the command is taken as delivered
+}
+
+bool receiveSampleFrame(SampleFrame& frame, uint8_t* srcMac) {
+  while (loopbackCount > 0) {
+    RxSlot& slot = loopbackQueue[loopbackHead];
+    loopbackHead = (loopbackHead + 1) % RX_QUEUE_LEN;
+    loopbackCount--;
+
+    if (decodeFrame(slot.data, slot.len, frame)) {
+      if (srcMac) memcpy(srcMac, slot.mac, sizeof(slot.mac));
+      return true;
+    }
+    droppedFrames++;
+  }
+  return false;
+}
+// LOOPBACK BACKEND END ======================================================================================================================================
+#else
+// ===========================================================================================================================================================
+// ESP-NOW BACKEND
+// ===========================================================================================================================================================
+static QueueHandle_t rxQueue = NULL;
+static volatile bool sendDone = false;
+static volatile bool sendOk = false;
+
+// CALLBACKS, THEY RUN IN THE WI-FI TASK SO THEY ONLY MOVE DATA AROUND
+static void onEspNowSent(const uint8_t* mac, esp_now_send_status_t status) {
+  sendOk = (status == ESP_NOW_SEND_SUCCESS);
+  sendDone = true;
+}
+
+static void onEspNowReceived(const uint8_t* mac, const uint8_t* data, int len) {
+  RxSlot slot;
+  if (len < FRAME_BASE_LEN || len > FRAME_MAX_LEN) {                                                             // Not one of ours
+    droppedFrames++;
+    return;
+  }
+
+  memcpy(slot.mac, mac, sizeof(slot.mac));
+  slot.len = len;
+  memcpy(slot.data, data, len);
+  if (xQueueSend(rxQueue, &slot, 0) != pdTRUE) droppedFrames++;                                                  // Never block the Wi-Fi task
+}
+
+// SETUP ESP-NOW. A NODE PASSES THE GATEWAY MAC AND A CHANNEL, THE GATEWAY PASSES NULL AND 0 TO STAY ON ITS AP CHANNEL
+// ONCE UP, LATER CALLS ONLY ADD THEIR PEER: THE RADIO STAYS ON THE CHANNEL OF THE FIRST ONE UNTIL WI-FI IS TURNED OFF
+bool setupEspNow(uint8_t channel, const uint8_t* peerMac) {
+  static bool started = false;
+  if (started && WiFi.getMode() == WIFI_OFF) {                                                                   // An uplink turned the radio off, ESP-NOW went with it
+    esp_now_deinit();
+    started = false;
+  }
+
+  if (!started && WiFi.status() != WL_CONNECTED) {
+    WiFi.mode(WIFI_STA);                                                                                         // The radio must be up, but there is no need to associate
+    if (channel != 0) {
+      esp_wifi_set_promiscuous(true);                                                                            // Channel can only be forced on an unassociated STA this way
+      esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+      esp_wifi_set_promiscuous(false);
+    }
+  }
+
+  if (!started) {
+    if (esp_now_init() != ESP_OK) {
+      Debugln(F("ESP-NOW init failed"));
+      return false;
+    }
+    if (rxQueue == NULL) rxQueue = xQueueCreate(RX_QUEUE_LEN, sizeof(RxSlot));
+    esp_now_register_send_cb(onEspNowSent);
+    esp_now_register_recv_cb(onEspNowReceived);
+    started = true;
+  }
+
+  if (peerMac != NULL && !esp_now_is_peer_exist(peerMac)) {
+    esp_now_peer_info_t peer = {};
+    memcpy(peer.peer_addr, peerMac, ESP_NOW_ETH_ALEN);
+    peer.channel = channel;
+    peer.ifidx = WIFI_IF_STA;
+    peer.encrypt = false;
+    if (esp_now_add_peer(&peer) != ESP_OK) {
+      Debugln(F("ESP-NOW peer could not be added"));
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// SEND ONE BUFFER, WAITING FOR THE MAC-LEVEL ACK AND RETRYING A BOUNDED NUMBER OF TIMES
+static bool sendWithRetries(const uint8_t* peerMac, const uint8_t* buf, size_t len) {
+  for (uint8_t attempt = 0; attempt < ESPNOW_SEND_RETRIES; attempt++) {
+    sendDone = false;
+    sendOk = false;
+    if (esp_now_send(peerMac, buf, len) != ESP_OK) continue;
+
+    uint32_t start = millis();
+    while (!sendDone && millis() - start < ESPNOW_SEND_TIMEOUT_MS) {
+      delay(1);
+    }
+    if (sendOk) return true;                                                                                     // Broadcast frames always report success, as there is no ACK to wait for
+  }
+  return false;
+}
+
+bool sendSampleFrame(const uint8_t* peerMac, const SampleFrame& frame) {
+  uint8_t buf[FRAME_MAX_LEN];
+  size_t len = encodeFrame(frame, buf, sizeof(buf));
+  if (len == 0) return false;
+  return sendWithRetries(peerMac, buf, len);
+}
+
+// THE VALVE CONTROLLER IS JUST ANOTHER PEER, SO THE NODE NEEDS NO ASSOCIATION TO DRIVE IT
+bool sendValveCommand(const uint8_t* peerMac, int16_t treeId, bool open) {
+  uint8_t buf[VALVE_COMMAND_LEN];
+  size_t len = encodeValveCommand(treeId, open, buf, sizeof(buf));
+  if (len == 0) return false;
+  return sendWithRetries(peerMac, buf, len);
+}
+
+// POP ONE FRAME RECEIVED BY THE CALLBACK, IF ANY
+bool receiveSampleFrame(SampleFrame& frame, uint8_t* srcMac) {
+  RxSlot slot;
+  if (rxQueue == NULL) return false;
+
+  while (xQueueReceive(rxQueue, &slot, 0) == pdTRUE) {
+    if (decodeFrame(slot.data, slot.len, frame)) {
+      if (srcMac) memcpy(srcMac, slot.mac, sizeof(slot.mac));
+      return true;
+    }
+    droppedFrames++;
+  }
+  return false;
+}
+// ESP-NOW BACKEND END =======================================================================================================================================
+#endif
+
+uint32_t getDroppedFrames() {
+  return droppedFrames;
+}
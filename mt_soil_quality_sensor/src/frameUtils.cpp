@@ -0,0 +1,220 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <math.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include "frameUtils.h"                                                                                          // Plain C++ on purpose: the codec has to build on the host as well as on the ESP32
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// CRC-8 (DALLAS/MAXIM POLYNOMIAL, SAME AS THE ONEWIRE BUS)
+static uint8_t crc8(const uint8_t* data, size_t len) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < len; i++) {
+    uint8_t inbyte = data[i];
+    for (uint8_t j = 0; j < 8; j++) {
+      uint8_t mix = (crc ^ inbyte) & 0x01;
+      crc >>= 1;
+      if (mix) crc ^= 0x8C;
+      inbyte >>= 1;
+    }
+  }
+  return crc;
+}
+
+// LITTLE-ENDIAN WRITERS AND READERS, SO THE LAYOUT DOES NOT DEPEND ON THE COMPILER PADDING OR THE HOST ENDIANNESS
+static void put16(uint8_t* p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+  put16(p, v & 0xFFFF);
+  put16(p + 2, v >> 16);
+}
+
+static uint16_t get16(const uint8_t* p) {
+  return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return (uint32_t)get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+// "snprintf" AT OFFSET "len" THAT KEEPS COUNTING WHEN "buf" IS NULL OR FULL, RETURNS THE NEW TOTAL LENGTH
+static int appendf(char* buf, size_t size, int len, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  bool room = buf != NULL && (size_t)len < size;
+  len += vsnprintf(room ? buf + len : NULL, room ? size - len : 0, format, args);
+  va_end(args);
+  return len;
+}
+
+static int32_t scale(float value, float factor, int32_t lo, int32_t hi) {
+  long v = lroundf(value * factor);
+  return v < lo ? lo : (v > hi ? hi : v);                                                                        // Saturate instead of wrapping around
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// CODEC FUNCTIONS
+// ===========================================================================================================================================================
+// NUMBER OF PROBES ACTUALLY ENCODED: A SINGLE PROBE IS ALREADY "soilTemp", SO IT COSTS NOTHING EXTRA
+static uint8_t encodedProbes(const SampleFrame& frame) {
+  if (frame.probeCount < 2) return 0;
+  return frame.probeCount > FRAME_MAX_PROBES ? FRAME_MAX_PROBES : frame.probeCount;
+}
+
+// THE WINDOW BLOCK ONLY TRAVELS WHEN SOME SAMPLES WERE NOT DELIVERED, A SINGLE SAMPLE IS ITS OWN MEAN
+static bool encodedWindow(const SampleFrame& frame) {
+  return frame.tempWindow.count > 1 || frame.moistWindow.count > 1;
+}
+
+size_t frameLength(const SampleFrame& frame) {
+  return FRAME_BASE_LEN + encodedProbes(frame) * FRAME_PROBE_LEN + (encodedWindow(frame) ? FRAME_WINDOW_LEN : 0);
+}
+
+// COUNT, MEAN, STANDARD DEVIATION, MIN AND MAX, ALL IN HUNDREDTHS
+static void putWindow(uint8_t* p, const WindowSummary& window) {
+  put16(p, window.count);
+  put16(p + 2, (uint16_t)(int16_t)scale(window.mean, 100.0f, INT16_MIN, INT16_MAX));
+  put16(p + 4, (uint16_t)scale(window.stdDev, 100.0f, 0, UINT16_MAX));
+  put16(p + 6, (uint16_t)(int16_t)scale(window.min, 100.0f, INT16_MIN, INT16_MAX));
+  put16(p + 8, (uint16_t)(int16_t)scale(window.max, 100.0f, INT16_MIN, INT16_MAX));
+}
+
+static void getWindow(const uint8_t* p, WindowSummary& window) {
+  window.count = get16(p);
+  window.mean = (int16_t)get16(p + 2) / 100.0f;
+  window.stdDev = get16(p + 4) / 100.0f;
+  window.min = (int16_t)get16(p + 6) / 100.0f;
+  window.max = (int16_t)get16(p + 8) / 100.0f;
+}
+
+// ENCODE A SAMPLE INTO "buf", RETURNS THE NUMBER OF BYTES WRITTEN OR 0 IF IT DOES NOT FIT
+size_t encodeFrame(const SampleFrame& frame, uint8_t* buf, size_t size) {
+  uint8_t probes = encodedProbes(frame);
+  size_t len = frameLength(frame);
+  if (size < len) return 0;
+
+  buf[0] = FRAME_MAGIC;
+  buf[1] = FRAME_VERSION;
+  put16(buf + 2, (uint16_t)frame.treeId);
+  put32(buf + 4, frame.bootCnt);
+  put16(buf + 8, (uint16_t)(int16_t)scale(frame.soilTemp, 100.0f, INT16_MIN, INT16_MAX));
+  put16(buf + 10, (uint16_t)scale(frame.soilMoist, 100.0f, 0, UINT16_MAX));
+  put16(buf + 12, (uint16_t)scale(frame.batVolt, 1000.0f, 0, UINT16_MAX));
+  buf[14] = frame.flags;
+  buf[15] = probes;
+  buf[16] = frame.valve;
+  put32(buf + 17, (uint32_t)frame.tsMs);
+  put16(buf + 21, (uint16_t)(frame.tsMs >> 32));
+  for (uint8_t i = 0; i < probes; i++) {
+    uint8_t* p = buf + 23 + i * FRAME_PROBE_LEN;
+    p[0] = frame.probeDepthCm[i];
+    put16(p + 1, (uint16_t)(int16_t)scale(frame.probeTemp[i], 100.0f, INT16_MIN, INT16_MAX));
+  }
+  if (encodedWindow(frame)) {
+    uint8_t* p = buf + 23 + probes * FRAME_PROBE_LEN;
+    putWindow(p, frame.tempWindow);
+    putWindow(p + FRAME_WINDOW_LEN / 2, frame.moistWindow);
+  }
+  buf[len - 1] = crc8(buf, len - 1);
+
+  return len;
+}
+
+// DECODE A SAMPLE, REJECTING ANYTHING WITH A WRONG SIZE, MAGIC, VERSION OR CRC
+bool decodeFrame(const uint8_t* buf, size_t len, SampleFrame& frame) {
+  if (len < FRAME_BASE_LEN || buf[0] != FRAME_MAGIC || buf[1] != FRAME_VERSION) return false;
+  size_t probesLen = FRAME_BASE_LEN + buf[15] * FRAME_PROBE_LEN;
+  if (buf[15] > FRAME_MAX_PROBES || (len != probesLen && len != probesLen + FRAME_WINDOW_LEN)) return false;
+  if (crc8(buf, len - 1) != buf[len - 1]) return false;
+
+  frame.treeId = (int16_t)get16(buf + 2);
+  frame.bootCnt = get32(buf + 4);
+  frame.soilTemp = (int16_t)get16(buf + 8) / 100.0f;
+  frame.soilMoist = get16(buf + 10) / 100.0f;
+  frame.batVolt = get16(buf + 12) / 1000.0f;
+  frame.flags = buf[14];
+  frame.probeCount = buf[15];
+  frame.valve = buf[16];
+  frame.tsMs = get32(buf + 17) | ((uint64_t)get16(buf + 21) << 32);
+  for (uint8_t i = 0; i < frame.probeCount; i++) {
+    const uint8_t* p = buf + 23 + i * FRAME_PROBE_LEN;
+    frame.probeDepthCm[i] = p[0];
+    frame.probeTemp[i] = (int16_t)get16(p + 1) / 100.0f;
+  }
+  frame.tempWindow = {};
+  frame.moistWindow = {};
+  if (len > probesLen) {
+    getWindow(buf + probesLen - 1, frame.tempWindow);                                                            // The window block sits between the probes and the CRC
+    getWindow(buf + probesLen - 1 + FRAME_WINDOW_LEN / 2, frame.moistWindow);
+  }
+
+  return true;
+}
+
+// FORMAT A SAMPLE AS THE TELEMETRY JSON OBJECT THINGSBOARD EXPECTS, RETURNS LIKE "snprintf"
+// WINDOW AGGREGATES OF ONE KEY, E.G. "soilMoistureMean", ONLY WHEN THE WINDOW HOLDS MORE THAN THE SAMPLE ITSELF
+static int appendWindow(char* buf, size_t size, int len, const char* key, const WindowSummary& window) {
+  if (window.count < 2) return len;
+  return appendf(buf, size, len, ",\"%sMean\":%.2f,\"%sStd\":%.2f,\"%sMin\":%.2f,\"%sMax\":%.2f,\"%sCount\":%u",
+                 key, window.mean, key, window.stdDev, key, window.min, key, window.max, key, window.count);
+}
+
+// VALUES FLAGGED AS FAULTY ARE LEFT OUT, SO THE DASHBOARD AGGREGATES NEVER SEE THEM, AND THE FAULT BITS ARE SENT INSTEAD
+// ONLY WHAT CHANGES BETWEEN WAKES, "treeId" AND THE OTHER STATIC FIELDS ARE PUBLISHED AS ATTRIBUTES, SEE "formatAttributesJson()"
+int formatFrameJson(char* buf, size_t size, const SampleFrame& frame) {
+  int len = appendf(buf, size, 0, "{\"bootCnt\":%lu", (unsigned long)frame.bootCnt);
+
+  if (frame.soilTemp != FRAME_INVALID_TEMP) len = appendf(buf, size, len, ",\"soilTemperature\":%4.2f", frame.soilTemp);
+  if (!(frame.flags & FRAME_FAULT_MOIST)) len = appendf(buf, size, len, ",\"soilMoisture\":%5.2f", frame.soilMoist);
+  len = appendf(buf, size, len, ",\"batVoltage\":%4.3f", frame.batVolt);
+
+  for (uint8_t i = 0; i < encodedProbes(frame); i++) {                                                           // One key per depth, e.g. "soilTemperature_30cm"
+    if (frame.probeTemp[i] == FRAME_INVALID_TEMP) continue;
+    len = appendf(buf, size, len, ",\"soilTemperature_%ucm\":%4.2f", frame.probeDepthCm[i], frame.probeTemp[i]);
+  }
+
+  len = appendWindow(buf, size, len, "soilTemperature", frame.tempWindow);
+  len = appendWindow(buf, size, len, "soilMoisture", frame.moistWindow);
+
+  if (frame.flags != 0) len = appendf(buf, size, len, ",\"sensorFaults\":%u", frame.flags);
+
+  if (frame.valve & FRAME_VALVE_PRESENT) {                                                                       // The action was already taken on the node, this only reports it
+    uint8_t switches = frame.valve >> FRAME_VALVE_SWITCHES_SHIFT;
+    len = appendf(buf, size, len, ",\"valveOpen\":%u", (frame.valve & FRAME_VALVE_OPEN) ? 1 : 0);
+    if (switches != 0) len = appendf(buf, size, len, ",\"valveSwitches\":%u", switches);
+    if (frame.valve & FRAME_VALVE_TIMEOUT) len = appendf(buf, size, len, ",\"valveTimeout\":1");
+  }
+  return appendf(buf, size, len, "}");
+}
+
+// SAME AS "formatFrameJson()", WRAPPED AS {"ts":...,"values":{...}} WHEN THE SAMPLING TIME IS KNOWN, SO A LATE OR REPLAYED SAMPLE KEEPS ITS OWN TIME
+int formatTelemetryJson(char* buf, size_t size, const SampleFrame& frame) {
+  if (frame.tsMs == 0) return formatFrameJson(buf, size, frame);
+
+  int len = appendf(buf, size, 0, "{\"ts\":%llu,\"values\":", (unsigned long long)frame.tsMs);
+  bool room = buf != NULL && (size_t)len < size;
+  len += formatFrameJson(room ? buf + len : NULL, room ? size - len : 0, frame);
+  return appendf(buf, size, len, "}");
+}
+
+// ENCODE A VALVE COMMAND INTO "buf", RETURNS THE NUMBER OF BYTES WRITTEN OR 0 IF IT DOES NOT FIT
+size_t encodeValveCommand(int16_t treeId, bool open, uint8_t* buf, size_t size) {
+  if (size < VALVE_COMMAND_LEN) return 0;
+
+  buf[0] = VALVE_COMMAND_MAGIC;
+  buf[1] = VALVE_COMMAND_VERSION;
+  put16(buf + 2, (uint16_t)treeId);
+  buf[4] = open ? 1 : 0;
+  buf[5] = crc8(buf, VALVE_COMMAND_LEN - 1);
+
+  return VALVE_COMMAND_LEN;
+}
+// CODEC FUNCTIONS END =======================================================================================================================================
@@ -0,0 +1,158 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
+#include <PubSubClient.h>
+#include <sys/time.h>
+#include "gatewayUtils.h"
+#include "attributeUtils.h"
+#include "macros.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+#define MIN_VALID_EPOCH_S 1600000000UL                                                                           // Anything earlier means SNTP has not set the clock yet
+
+struct AnnouncedDevice {
+  int16_t treeId;
+  uint32_t hash;                                                                                                 // Of the attributes last published for it, 0 for a free slot
+};
+
+static SampleFrame pending[GATEWAY_MAX_SAMPLES];                                                                 // "tsMs" is the sampling time of the node, or the reception time if the node clock was not set
+static uint16_t pendingCount = 0;
+static size_t pendingBytes = 2;                                                                                  // Upper bound of the JSON size, starting with the outer braces
+static uint32_t oldestMs = 0;                                                                                    // millis() when the first sample of the current batch arrived
+static bool flushFailed = false;                                                                                 // The last publish failed, so the next one waits for "failedMs + GATEWAY_FLUSH_MS"
+static uint32_t failedMs = 0;
+static char payload[GATEWAY_FLUSH_BYTES + 1];
+static AnnouncedDevice announced[GATEWAY_MAX_DEVICES];                                                           // Not in RTC memory: the gateway never sleeps, a reboot announces every device again
+static uint8_t announcedNext = 0;                                                                                // Slot recycled when the table is full
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+static uint64_t nowEpochMs() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  if ((uint32_t)tv.tv_sec < MIN_VALID_EPOCH_S) return 0;
+  return (uint64_t)tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
+}
+
+// AFTER A FAILED PUBLISH THE BATCH WAITS GATEWAY_FLUSH_MS, INSTEAD OF BEING RETRIED (AND LOGGED) ON EVERY LOOP OF THE GATEWAY TASK
+static bool backingOff() {
+  if (flushFailed && millis() - failedMs < GATEWAY_FLUSH_MS) return true;
+  flushFailed = false;
+  return false;
+}
+
+// PUBLISH THE ATTRIBUTES OF A DEVICE BEHIND THE GATEWAY IF THEY CHANGED SINCE IT WAS LAST ANNOUNCED: {"name":{"treeId":3,...}}
+static bool announceDevice(PubSubClient& client, const SampleFrame& frame, SemaphoreHandle_t serialSemaphore) {
+  char attributesStr[ATTRIBUTES_JSON_MAX];
+  char message[ATTRIBUTES_JSON_MAX + 40];
+  AnnouncedDevice* slot = NULL;
+
+  formatAttributesJson(attributesStr, sizeof(attributesStr), frame, false);                                      // The frame does not carry the firmware or the period of the node
+  uint32_t hash = attributesHash(attributesStr);
+  for (uint8_t i = 0; i < GATEWAY_MAX_DEVICES && slot == NULL; i++) {
+    if (announced[i].hash != 0 && announced[i].treeId == frame.treeId) slot = &announced[i];
+  }
+  if (slot != NULL && slot->hash == hash) return true;
+
+  snprintf(message, sizeof(message), "{\"" GATEWAY_DEVICE_NAME "\":%s}", frame.treeId, attributesStr);
+  if (!client.publish(MQTT_TOPIC_GATEWAY_ATTRIBUTES, message)) return false;                                     // Tried again with the next batch of this tree
+
+  if (slot == NULL) {
+    slot = &announced[announcedNext];
+    announcedNext = (announcedNext + 1) % GATEWAY_MAX_DEVICES;
+  }
+  *slot = {frame.treeId, hash};
+  if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+    Debugln(message);
+    xSemaphoreGive(serialSemaphore);
+  }
+  return true;
+}
+
+// SIZE THE SAMPLE ADDS TO THE PAYLOAD IN THE WORST CASE, I.E. WHEN IT OPENS ITS OWN DEVICE GROUP: ,"name":[sample]
+static size_t sampleCost(const SampleFrame& frame) {
+  char name[32];
+  int nameLen = snprintf(name, sizeof(name), GATEWAY_DEVICE_NAME, frame.treeId);
+  return formatTelemetryJson(NULL, 0, frame) + nameLen + 6;
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// BATCHING FUNCTIONS
+// ===========================================================================================================================================================
+// QUEUE A SAMPLE, RETURNS FALSE IF THE BATCH IS FULL (BY COUNT OR SIZE) AND MUST BE FLUSHED FIRST
+bool gatewayAdd(const SampleFrame& frame) {
+  SampleFrame sample = frame;
+  if (sample.tsMs == 0) sample.tsMs = nowEpochMs();                                                              // Reception time, the best there is for a node that never synchronised
+  size_t cost = sampleCost(sample);
+
+  if (pendingCount == GATEWAY_MAX_SAMPLES || pendingBytes + cost > GATEWAY_FLUSH_BYTES) return false;
+
+  if (pendingCount == 0) oldestMs = millis();
+  pending[pendingCount++] = sample;
+  pendingBytes += cost;
+  return true;
+}
+
+// FLUSH POLICY: ENOUGH SAMPLES, ENOUGH BYTES OR THE OLDEST SAMPLE HAS WAITED LONG ENOUGH
+bool gatewayShouldFlush() {
+  if (pendingCount == 0 || backingOff()) return false;
+  if (pendingCount >= GATEWAY_FLUSH_COUNT) return true;
+  if (pendingBytes >= GATEWAY_FLUSH_BYTES * 3 / 4) return true;                                                  // Close to full, one more typical sample might not fit
+  return millis() - oldestMs >= GATEWAY_FLUSH_MS;
+}
+
+// PUBLISH EVERY QUEUED SAMPLE AS ONE GATEWAY API MESSAGE, GROUPED BY DEVICE NAME: {"tree A":[s1,s2],"tree B":[s3]}
+bool gatewayFlush(PubSubClient& client, const char* topic, SemaphoreHandle_t serialSemaphore) {
+  bool grouped[GATEWAY_MAX_SAMPLES] = {false};
+  size_t len = 0;
+
+  if (pendingCount == 0) return true;
+  if (backingOff()) return false;                                                                                // Also when called because the batch is full: the new frame is dropped, not the batch
+
+  payload[len++] = '{';
+  for (uint16_t i = 0; i < pendingCount; i++) {
+    if (grouped[i]) continue;
+
+    announceDevice(client, pending[i], serialSemaphore);                                                         // Once per tree, so the batch itself only carries measurements
+    if (len > 1) payload[len++] = ',';
+    len += snprintf(payload + len, sizeof(payload) - len, "\"" GATEWAY_DEVICE_NAME "\":[", pending[i].treeId);
+
+    for (uint16_t j = i; j < pendingCount; j++) {                                                                // Every later sample of the same tree goes into the same array, oldest first
+      if (grouped[j] || pending[j].treeId != pending[i].treeId) continue;
+      if (j != i) payload[len++] = ',';
+      len += formatTelemetryJson(payload + len, sizeof(payload) - len, pending[j]);                              // With "ts" when known, so several samples of a device do not collapse into one
+      grouped[j] = true;
+    }
+    payload[len++] = ']';
+  }
+  payload[len++] = '}';
+  payload[len] = '\0';                                                                                           // "pendingBytes" is an upper bound of "len", so the buffer is never overrun
+
+  if (!client.publish(topic, payload)) {                                                                         // Keep the batch, it is retried GATEWAY_FLUSH_MS later
+    flushFailed = true;
+    failedMs = millis();
+    if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+      Debugf("Failed to publish batch of %u samples\n", pendingCount);
+      xSemaphoreGive(serialSemaphore);
+    }
+    return false;
+  }
+
+  if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+    Debugf("Published batch of %u samples (%u bytes)\n", pendingCount, (unsigned)len);
+    Debugln(payload);
+    xSemaphoreGive(serialSemaphore);
+  }
+
+  pendingCount = 0;
+  pendingBytes = 2;
+  return true;
+}
+// BATCHING FUNCTIONS END ====================================================================================================================================
@@ -0,0 +1,93 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include "healthUtils.h"                                                                                         // Plain C++ on purpose: the checks are also built and tested on the host
+#include "macros.h"
+#include "rtcMemory.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+static RTC_DATA_ATTR uint8_t persistentFaults = 0;                                                               // Faults that survived every retry of the last wake, they are not retried again until they clear
+static RTC_DATA_ATTR uint16_t lastMoistRaw = 0;
+static RTC_DATA_ATTR uint8_t flatMoistWakes = 0;                                                                 // Wakes in a row with perfectly flat and identical moisture readings
+static RTC_DATA_ATTR uint8_t lastSentFlags = 0;
+static RTC_DATA_ATTR uint8_t silentWakes = 0;                                                                    // Wakes since the last delivered sample
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HEALTH FUNCTIONS
+// ===========================================================================================================================================================
+// FAULTS OF ONE TEMPERATURE PROBE, CHECKED FROM THE MOST TO THE LEAST SEVERE
+static uint8_t checkProbe(float tempC, float spreadC) {
+  if (tempC == FRAME_INVALID_TEMP) return FRAME_FAULT_TEMP_DISCONNECTED;
+  if (tempC == DS18B20_POWER_ON_C) return FRAME_FAULT_TEMP_STUCK;
+  if (tempC < HEALTH_TEMP_MIN_C || tempC > HEALTH_TEMP_MAX_C) return FRAME_FAULT_TEMP_RANGE;
+  if (spreadC > HEALTH_TEMP_MAX_SPREAD_C) return FRAME_FAULT_TEMP_NOISY;
+  return 0;
+}
+
+// FAULTS OF THE MOISTURE PROBE, STUCK NEEDS THE READINGS OF THE PREVIOUS WAKES
+static uint8_t checkMoisture(const SampleQuality& quality) {
+  if (quality.moistRaw < HEALTH_MOIST_RAW_MIN || quality.moistRaw > HEALTH_MOIST_RAW_MAX) return FRAME_FAULT_MOIST_RANGE;
+  if (quality.moistSpreadRaw == 0 && quality.moistRaw == lastMoistRaw && flatMoistWakes + 1 >= HEALTH_STUCK_WAKES) return FRAME_FAULT_MOIST_STUCK;
+  if (quality.moistSpreadRaw > HEALTH_MOIST_MAX_SPREAD_RAW) return FRAME_FAULT_MOIST_NOISY;
+  return 0;
+}
+
+// CHECK A FRESH SAMPLE: SETS ITS FAULT FLAGS AND MARKS EVERY FAULTY TEMPERATURE AS INVALID, RETURNS THE FLAGS
+uint8_t checkSampleHealth(SampleFrame& frame, const SampleQuality& quality) {
+  uint8_t faults = (frame.probeCount == 0) ? FRAME_FAULT_TEMP_DISCONNECTED : 0;
+
+  for (uint8_t i = 0; i < frame.probeCount && i < FRAME_MAX_PROBES; i++) {
+    uint8_t probeFaults = checkProbe(frame.probeTemp[i], quality.probeSpreadC[i]);
+    if (probeFaults) frame.probeTemp[i] = FRAME_INVALID_TEMP;
+    faults |= probeFaults;
+  }
+  frame.soilTemp = (frame.probeCount > 0) ? frame.probeTemp[0] : FRAME_INVALID_TEMP;
+
+  frame.flags = faults | checkMoisture(quality);
+  return frame.flags;
+}
+
+// ONLY FAULTS THAT WERE NOT THERE ON THE LAST WAKE ARE WORTH SAMPLING AGAIN, A DEAD PROBE SHOULD NOT COST EXTRA CONVERSIONS EVERY WAKE
+bool healthShouldRetry(uint8_t faults, uint8_t attempt) {
+  return (faults & ~persistentFaults) != 0 && attempt < HEALTH_MAX_RETRIES;
+}
+
+// CALL ONCE PER WAKE WITH THE FINAL SAMPLE, UPDATES THE STATE THE NEXT WAKE IS CHECKED AGAINST
+void commitSampleHealth(const SampleFrame& frame, const SampleQuality& quality) {
+  persistentFaults = frame.flags;
+
+  bool flat = (quality.moistSpreadRaw == 0 && quality.moistRaw == lastMoistRaw);
+  flatMoistWakes = flat ? (flatMoistWakes < 255 ? flatMoistWakes + 1 : 255) : 0;
+  lastMoistRaw = quality.moistRaw;
+  if (silentWakes < 255) silentWakes++;
+}
+
+// WHETHER THE SAMPLE IS WORTH THE RADIO: ANY VALID VALUE, A CHANGE IN THE FAULTS SINCE THE LAST DELIVERED ONE, OR A PERIODIC FAULT REPORT
+bool healthShouldSend(const SampleFrame& frame) {
+  bool anyValid = !(frame.flags & FRAME_FAULT_MOIST);
+
+  for (uint8_t i = 0; i < frame.probeCount && i < FRAME_MAX_PROBES; i++) {
+    if (frame.probeTemp[i] != FRAME_INVALID_TEMP) anyValid = true;
+  }
+
+  return anyValid || frame.flags != lastSentFlags || silentWakes >= HEALTH_REPORT_WAKES;
+}
+
+// THE SAMPLE REACHED THE SERVER, ITS FAULTS ARE THE ONES THE NEXT SAMPLES ARE COMPARED WITH
+void healthDelivered(const SampleFrame& frame) {
+  lastSentFlags = frame.flags;
+  silentWakes = 0;
+}
+
+void resetSampleHealth() {
+  persistentFaults = 0;
+  lastMoistRaw = 0;
+  flatMoistWakes = 0;
+  lastSentFlags = 0;
+  silentWakes = 0;
+}
+// HEALTH FUNCTIONS END ======================================================================================================================================
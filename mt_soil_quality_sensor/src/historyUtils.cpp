@@ -0,0 +1,265 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
+#include <esp_partition.h>
+#include <math.h>
+#include "historyUtils.h"
+#include "macros.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+// Log-structured store: the partition is a ring of segments, one flash sector each, written append-only. A segment starts with a header holding a sequence
+// number, so the newest one is found after a power-on, and its first record is the sparse time index used to skip whole segments in a range query.
+#define SEGMENT_BYTES 4096                                                                                       // One erase sector
+#define SEGMENT_MAGIC 0x31485153UL                                                                               // "SQH1"
+#define SEGMENT_SLOTS ((SEGMENT_BYTES - sizeof(SegmentHeader)) / sizeof(HistoryRecord))
+#define RECORD_INVALID_TEMP INT16_MIN                                                                            // "soilTemp" of a sample without a valid probe, 0 ºC is a perfectly valid reading
+
+struct SegmentHeader {
+  uint32_t magic;
+  uint32_t seq;                                                                                                  // Grows by one per segment opened, the largest one is the head
+  uint32_t reserved[2];
+};
+
+static_assert(sizeof(HistoryRecord) == 16 && sizeof(SegmentHeader) == 16, "A segment must hold a whole number of records after its header");
+static_assert((FRAME_FAULT_MOIST | FRAME_FAULT_TEMP_DISCONNECTED | FRAME_FAULT_TEMP_STUCK | FRAME_FAULT_TEMP_RANGE | FRAME_FAULT_TEMP_NOISY) < HISTORY_PENDING,
+              "HISTORY_PENDING must not collide with a fault bit");
+
+struct PendingSlot {                                                                                             // A record of the batch being built, cleared once the batch is published
+  size_t offset;
+  uint8_t flags;
+};
+
+static const esp_partition_t* partition = NULL;
+static RTC_DATA_ATTR uint32_t headSeq = 0;                                                                       // 0 until the head was found, e.g. after a power-on
+static RTC_DATA_ATTR uint16_t headSegment = 0;
+static RTC_DATA_ATTR uint16_t headSlot = 0;                                                                      // Next free slot of the head segment
+static size_t lastOffset = SIZE_MAX;                                                                             // Record appended on this wake, SIZE_MAX until then
+static uint64_t pendingFromMs = 0;                                                                               // Oldest HISTORY_PENDING record found by the power-on scan, 0 if none or on a wake from deep sleep
+static char batch[HISTORY_BATCH_BYTES];
+static PendingSlot batchPending[HISTORY_BATCH_BYTES / 48];                                                       // The shortest record takes ~50 bytes of a batch
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// CRC-8 (DALLAS/MAXIM POLYNOMIAL), THE SAME AS THE SAMPLE FRAMES
+static uint8_t crc8(const uint8_t* data, size_t len) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < len; i++) {
+    uint8_t inbyte = data[i];
+    for (uint8_t j = 0; j < 8; j++) {
+      uint8_t mix = (crc ^ inbyte) & 0x01;
+      crc >>= 1;
+      if (mix) crc ^= 0x8C;
+      inbyte >>= 1;
+    }
+  }
+  return crc;
+}
+
+static uint16_t segmentCount() {
+  return partition->size / SEGMENT_BYTES;
+}
+
+static size_t slotOffset(uint16_t segment, uint16_t slot) {
+  return (size_t)segment * SEGMENT_BYTES + sizeof(SegmentHeader) + (size_t)slot * sizeof(HistoryRecord);
+}
+
+static bool readHeader(uint16_t segment, SegmentHeader& header) {
+  return esp_partition_read(partition, (size_t)segment * SEGMENT_BYTES, &header, sizeof(header)) == ESP_OK && header.magic == SEGMENT_MAGIC;
+}
+
+// OVER EVERY BYTE BUT ITSELF, WITH HISTORY_PENDING AS IF IT WERE CLEAR
+static uint8_t recordCrc(const HistoryRecord& record) {
+  HistoryRecord copy = record;
+  copy.flags &= ~HISTORY_PENDING;
+  return crc8((const uint8_t*)&copy, sizeof(copy) - 1);
+}
+
+// A SLOT HOLDS A RECORD WHEN IT IS NOT ERASED AND ITS CRC MATCHES
+static bool readRecord(uint16_t segment, uint16_t slot, HistoryRecord& record) {
+  if (esp_partition_read(partition, slotOffset(segment, slot), &record, sizeof(record)) != ESP_OK) return false;
+  return record.tsMs != UINT64_MAX && record.crc == recordCrc(record);
+}
+
+// FLASH PROGRAMMING ONLY CLEARS BITS, SO THE FLAGS BYTE CAN BE WRITTEN AGAIN WITHOUT HISTORY_PENDING AND NO ERASE
+static bool clearPending(size_t offset, uint8_t flags) {
+  uint8_t cleared = flags & ~HISTORY_PENDING;
+  return esp_partition_write(partition, offset + offsetof(HistoryRecord, flags), &cleared, 1) == ESP_OK;
+}
+
+static bool openSegment(uint16_t segment, uint32_t seq) {
+  SegmentHeader header = {SEGMENT_MAGIC, seq, {UINT32_MAX, UINT32_MAX}};
+  if (esp_partition_erase_range(partition, (size_t)segment * SEGMENT_BYTES, SEGMENT_BYTES) != ESP_OK) return false;
+  if (esp_partition_write(partition, (size_t)segment * SEGMENT_BYTES, &header, sizeof(header)) != ESP_OK) return false;
+
+  headSeq = seq;
+  headSegment = segment;
+  headSlot = 0;
+  return true;
+}
+
+// OLDEST RECORD STILL WAITING TO BE DELIVERED, 0 IF NONE. READS THE WHOLE RING, SO ONLY ONCE AFTER A POWER-ON
+static uint64_t findOldestPending() {
+  for (uint16_t n = 1; n <= segmentCount(); n++) {                                                               // Oldest segment first, the head last
+    uint16_t segment = (headSegment + n) % segmentCount();
+    SegmentHeader header;
+    HistoryRecord record;
+    if (!readHeader(segment, header) || header.seq > headSeq) continue;
+
+    for (uint16_t slot = 0; slot < SEGMENT_SLOTS; slot++) {
+      if (segment == headSegment && slot >= headSlot) break;
+      if (readRecord(segment, slot, record) && (record.flags & HISTORY_PENDING)) return record.tsMs;
+    }
+  }
+  return 0;
+}
+
+// FIND THE PARTITION AND, AFTER A POWER-ON, THE HEAD: THE SEGMENT WITH THE LARGEST SEQUENCE NUMBER AND ITS FIRST ERASED SLOT
+static bool mount() {
+  if (partition == NULL) {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, HISTORY_PARTITION);
+    if (partition == NULL || segmentCount() < 2) {
+      partition = NULL;
+      return false;
+    }
+  }
+  if (headSeq != 0) return true;                                                                                 // Kept in RTC memory, no scan on a wake from deep sleep
+
+  SegmentHeader header;
+  for (uint16_t i = 0; i < segmentCount(); i++) {
+    if (readHeader(i, header) && header.seq >= headSeq) {
+      headSeq = header.seq;
+      headSegment = i;
+    }
+  }
+  if (headSeq == 0) return openSegment(0, 1);                                                                    // Blank or foreign partition
+
+  HistoryRecord record;
+  for (headSlot = 0; headSlot < SEGMENT_SLOTS; headSlot++) {
+    if (esp_partition_read(partition, slotOffset(headSegment, headSlot), &record, sizeof(record)) != ESP_OK) return false;
+    if (record.tsMs == UINT64_MAX) break;                                                                        // A torn slot is not erased either, it is skipped like a full one
+  }
+  pendingFromMs = findOldestPending();                                                                           // The backlog start was kept in RTC memory, lost with it
+  return true;
+}
+
+// SAME KEYS AS THE LIVE TELEMETRY, SO A BACKFILLED SAMPLE LANDS ON THE SAME CHARTS. FAULTY VALUES ARE LEFT OUT THE SAME WAY
+static int formatRecord(char* buf, size_t size, const HistoryRecord& record) {
+  int len = snprintf(buf, size, "{\"ts\":%llu,\"values\":{", (unsigned long long)record.tsMs);
+  if (record.soilTemp != RECORD_INVALID_TEMP) len += snprintf(buf + len, size - len, "\"soilTemperature\":%4.2f,", record.soilTemp / 100.0f);
+  if (!(record.flags & FRAME_FAULT_MOIST)) len += snprintf(buf + len, size - len, "\"soilMoisture\":%5.2f,", record.soilMoist / 100.0f);
+  if (record.flags & ~HISTORY_PENDING) len += snprintf(buf + len, size - len, "\"sensorFaults\":%u,", record.flags & ~HISTORY_PENDING);
+  return len + snprintf(buf + len, size - len, "\"batVoltage\":%4.3f}}", record.batMv / 1000.0f);                // Always there, so no key ends with a dangling comma
+}
+
+// STREAMED WITH "beginPublish()", SO A BATCH CAN BE MUCH LARGER THAN THE MQTT BUFFER. THEN ITS PENDING RECORDS ARE DELIVERED
+static bool publishBatch(PubSubClient& client, size_t len, uint8_t pendingCount) {
+  batch[len++] = ']';
+  if (!client.beginPublish(MQTT_TOPIC_PUB, len, false) || client.write((const uint8_t*)batch, len) != len || !client.endPublish()) return false;
+
+  for (uint8_t i = 0; i < pendingCount; i++) clearPending(batchPending[i].offset, batchPending[i].flags);
+  return true;
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HISTORY FUNCTIONS
+// ===========================================================================================================================================================
+// APPEND ONE SAMPLE. ONLY TIMESTAMPED ONES: WITHOUT "ts" A SAMPLE COULD NOT BE FOUND BY A RANGE QUERY. THE OLDEST SEGMENT IS ERASED WHEN THE RING IS FULL.
+// "pending" FOR A SAMPLE THAT IS WORTH SENDING: IT STAYS IN THE BACKLOG UNTIL "historyMarkDelivered()" OR A REPLAY. SUPPRESSED ONES ARE NEVER REPLAYED AS BACKLOG
+bool historyAppend(const SampleFrame& frame, bool pending) {
+  if (!HISTORY_ENABLED || frame.tsMs == 0 || !mount()) return false;
+
+  if (headSlot >= SEGMENT_SLOTS && !openSegment((headSegment + 1) % segmentCount(), headSeq + 1)) return false;
+
+  HistoryRecord record;
+  record.tsMs = frame.tsMs;
+  record.soilTemp = frame.soilTemp == FRAME_INVALID_TEMP ? RECORD_INVALID_TEMP : (int16_t)lroundf(frame.soilTemp * 100.0f);
+  record.soilMoist = (uint16_t)lroundf(frame.soilMoist * 100.0f);
+  record.batMv = (uint16_t)lroundf(frame.batVolt * 1000.0f);
+  record.flags = frame.flags | (pending ? HISTORY_PENDING : 0);
+  record.crc = recordCrc(record);
+
+  lastOffset = slotOffset(headSegment, headSlot);
+  bool written = esp_partition_write(partition, lastOffset, &record, sizeof(record)) == ESP_OK;
+  headSlot++;                                                                                                    // Even on failure: a half-programmed slot cannot be written again
+  if (!written) lastOffset = SIZE_MAX;
+  return written;
+}
+
+// THE SAMPLE APPENDED ON THIS WAKE WAS DELIVERED LIVE, IT IS NOT PART OF ANY BACKLOG
+bool historyMarkDelivered() {
+  HistoryRecord record;
+  if (lastOffset == SIZE_MAX || partition == NULL) return false;
+  if (esp_partition_read(partition, lastOffset, &record, sizeof(record)) != ESP_OK || !(record.flags & HISTORY_PENDING)) return false;
+  return clearPending(lastOffset, record.flags);
+}
+
+// WHERE THE BACKLOG STARTS AFTER A POWER-ON, WHEN THE RTC COPY OF THE CALLER IS GONE. 0 WITH NO BACKLOG IN FLASH OR ON A WAKE FROM DEEP SLEEP
+uint64_t historyPendingFromMs() {
+  if (!HISTORY_ENABLED || !mount()) return 0;
+  return pendingFromMs;
+}
+
+// PUBLISH THE STORED SAMPLES IN [fromMs, toMs] AS TELEMETRY ARRAYS, OLDEST FIRST AND AT MOST "maxRecords" OF THEM, ONLY THE HISTORY_PENDING ONES WITH
+// "pendingOnly". NO NEW BATCH IS STARTED PAST "millis()" "deadlineMs", 0 FOR NONE. RETURNS HOW MANY, 0 IF A BATCH COULD NOT BE PUBLISHED. "lastMs" IS THE LAST
+// ONE SENT, TO CONTINUE FROM, AND "more" TELLS WHETHER A MATCHING SAMPLE WAS LEFT OUT. A PENDING SAMPLE IS DELIVERED ONCE ITS BATCH IS PUBLISHED, WHICHEVER
+// QUERY SENT IT. THINGSBOARD KEEPS ONE VALUE PER KEY AND "ts", SO OVERLAPS ARE HARMLESS
+uint16_t historyReplay(PubSubClient& client, uint64_t fromMs, uint64_t toMs, uint16_t maxRecords, uint32_t deadlineMs, bool pendingOnly,
+                       uint64_t* lastMs, bool* more) {
+  uint16_t sent = 0;
+  size_t len = 0;
+  uint8_t pendingCount = 0;
+  bool done = false;
+  char item[160];
+  *lastMs = 0;
+  *more = false;
+  if (!HISTORY_ENABLED || !mount()) return 0;
+
+  for (uint16_t n = 1; n <= segmentCount() && !done && !*more; n++) {                                           // Oldest segment first, the head last
+    uint16_t segment = (headSegment + n) % segmentCount();
+    SegmentHeader header;
+    HistoryRecord record;
+    if (!readHeader(segment, header) || header.seq > headSeq) continue;
+    if (segment != headSegment && readRecord((segment + 1) % segmentCount(), 0, record) && record.tsMs < fromMs) continue; // Sparse index: the next segment starts before the range, so this whole one is older
+
+    for (uint16_t slot = 0; slot < SEGMENT_SLOTS; slot++) {
+      if (segment == headSegment && slot >= headSlot) break;
+      if (!readRecord(segment, slot, record) || record.tsMs < fromMs) continue;
+      done = record.tsMs > toMs;                                                                                 // Past the range, and so is every later record
+      if (done) break;
+      if (pendingOnly && !(record.flags & HISTORY_PENDING)) continue;
+      *more = sent == maxRecords || (sent == 0 && deadlineMs != 0 && millis() > deadlineMs);                     // One more sample matches but does not fit
+      if (*more) break;
+
+      int itemLen = formatRecord(item, sizeof(item), record);
+      if (len + itemLen + 2 > sizeof(batch) || pendingCount == sizeof(batchPending) / sizeof(batchPending[0])) { // Room for the separator and the closing bracket
+        if (!publishBatch(client, len, pendingCount)) {
+          *more = true;
+          return 0;
+        }
+        len = 0;
+        pendingCount = 0;
+        *more = deadlineMs != 0 && millis() > deadlineMs;                                                        // Checked per batch, so the overshoot is one batch at most
+        if (*more) break;
+      }
+      batch[len] = (len == 0) ? '[' : ',';
+      memcpy(batch + len + 1, item, itemLen);
+      len += itemLen + 1;
+      if (record.flags & HISTORY_PENDING) batchPending[pendingCount++] = {slotOffset(segment, slot), record.flags};
+      sent++;
+      *lastMs = record.tsMs;
+    }
+  }
+  if (len > 0 && !publishBatch(client, len, pendingCount)) {
+    *more = true;
+    return 0;
+  }
+  return sent;
+}
+// HISTORY FUNCTIONS END =====================================================================================================================================
@@ -0,0 +1,104 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
+#include <driver/gpio.h>                                                                                         // Pad hold, so the valve keeps its state through deep sleep
+#include "macros.h"
+#include "irrigationUtils.h"
+#include "espNowUtils.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+static RTC_DATA_ATTR bool valveOpen = false;                                                                     // Closed after a power-on, whatever it was before
+static RTC_DATA_ATTR uint8_t openWakes = 0;                                                                      // Wakes in a row the valve has been open
+static RTC_DATA_ATTR bool timedOut = false;                                                                      // Closed by IRRIGATION_MAX_OPEN_WAKES, cleared once the soil reads wet
+static RTC_DATA_ATTR uint8_t switches = 0;                                                                       // Times the valve switched since the last delivered sample
+static RTC_DATA_ATTR bool commandPending = false;                                                                // The valve controller has not acknowledged the current state yet
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// RULE FUNCTIONS
+// ===========================================================================================================================================================
+// THRESHOLDS WITH HYSTERESIS ON THE MOISTURE MEDIAN. A FAULTY PROBE CLOSES THE VALVE: FLOODING ON A BAD READING IS WORSE THAN A LATE WATERING
+static bool ruleWantsOpen(const SampleFrame& frame){
+  if(frame.flags & FRAME_FAULT_MOIST) return false;
+  if(frame.soilMoist > IRRIGATION_CLOSE_ABOVE){
+    timedOut = false;
+    return false;
+  }
+  if(timedOut) return false;
+  if(valveOpen && openWakes >= IRRIGATION_MAX_OPEN_WAKES){                                                       // Still dry after all this water: empty tank, broken pipe or a probe out of the soil
+    timedOut = true;
+    return false;
+  }
+  if(frame.soilMoist < IRRIGATION_OPEN_BELOW) return true;
+  return valveOpen;                                                                                              // Between both thresholds nothing changes
+}
+
+// THE LEVEL IS WRITTEN BEFORE THE PAD IS RELEASED AND DRIVEN, SO A VALVE THAT STAYS OPEN SEES NO GLITCH ON A WAKE
+static void driveValve(bool open){
+  if(IRRIGATION_VALVE_GPIO < 0) return;
+  gpio_num_t pin = (gpio_num_t)IRRIGATION_VALVE_GPIO;
+
+  digitalWrite(IRRIGATION_VALVE_GPIO, open == IRRIGATION_VALVE_ACTIVE_HIGH ? HIGH : LOW);
+  gpio_hold_dis(pin);
+  pinMode(IRRIGATION_VALVE_GPIO, OUTPUT);
+  gpio_hold_en(pin);                                                                                             // Latched until the next write, deep sleep included
+}
+// RULE FUNCTIONS END ========================================================================================================================================
+
+// ===========================================================================================================================================================
+// IRRIGATION FUNCTIONS
+// ===========================================================================================================================================================
+// PUT THE VALVE BACK IN THE STATE OF THE LAST WAKE, ONCE PER BOOT BEFORE ANY SAMPLE
+void setupIrrigation(){
+  if(!IRRIGATION_RULE || IRRIGATION_VALVE_GPIO < 0) return;
+  gpio_deep_sleep_hold_en();                                                                                     // Without it, digital pads float as soon as the chip sleeps
+  driveValve(valveOpen);
+}
+
+// EVALUATE THE RULE ON A FRESH SAMPLE AND ACT ON IT RIGHT AWAY, BEFORE ANY NETWORK IS TOUCHED. RETURNS THE FRAME_VALVE_* BITS FOR THE FRAME
+// THE ACTION ITSELF NEVER WAITS FOR THE SERVER: IT LEARNS ABOUT IT FROM THE NEXT DELIVERED SAMPLE. THE ESP-NOW COMMAND WAITS FOR "irrigationSendPending()"
+uint8_t irrigationControl(const SampleFrame& frame){
+  if(!IRRIGATION_RULE) return 0;
+
+  bool open = ruleWantsOpen(frame);
+  if(open != valveOpen){
+    valveOpen = open;
+    if(switches < FRAME_VALVE_SWITCHES_MAX) switches++;
+    commandPending = IRRIGATION_ESPNOW;
+    driveValve(valveOpen);
+    Debugf("Moisture %.2f %%: valve %s\n", frame.soilMoist, valveOpen ? "opened" : "closed");
+  }
+  openWakes = valveOpen ? (openWakes < 255 ? openWakes + 1 : 255) : 0;
+
+  return FRAME_VALVE_PRESENT | (valveOpen ? FRAME_VALVE_OPEN : 0) | (timedOut ? FRAME_VALVE_TIMEOUT : 0)
+         | (switches << FRAME_VALVE_SWITCHES_SHIFT);
+}
+
+// SEND THE COMMAND THE VALVE CONTROLLER HAS NOT ACKNOWLEDGED YET. "channel" IS THE ONE ITS ESP-NOW USES, 0 WHILE ASSOCIATED TO THE AP SO THE
+// COMMAND GOES OUT ON THE AP CHANNEL. ESP-NOW IS ONLY INITIALISED ONCE PER BOOT, THE CONTROLLER IS ONE MORE PEER
+void irrigationSendPending(uint8_t channel){
+  static const uint8_t peerMac[6] = IRRIGATION_PEER_MAC;
+  if(!commandPending) return;
+  commandPending = !(setupEspNow(channel, peerMac) && sendValveCommand(peerMac, TREE_ID, valveOpen));            // Sent again on the next wakes until the controller acknowledges it
+  if(commandPending) Debugln(F("Valve command not acknowledged"));
+}
+
+// A COMMAND STILL WAITING IS WORTH WAKING THE RADIO FOR, EVEN IF THE SAMPLE IS NOT
+bool irrigationCommandPending(){
+  return commandPending;
+}
+
+// AN OPEN VALVE NEEDS EVERY WAKE TO CLOSE IT ON TIME, NO SLOT OF THE GRID MAY BE SKIPPED
+bool irrigationValveOpen(){
+  return valveOpen;
+}
+
+// THE SWITCHES REACHED THE SERVER, THE NEXT ONES ARE COUNTED FROM ZERO
+void irrigationDelivered(){
+  switches = 0;
+}
+// IRRIGATION FUNCTIONS END ==================================================================================================================================
@@ -1,193 +1,505 @@
-/* ***********************************************************************************************************************************************************
-SOIL QUALITY SENSOR: this file includes the main code for the soil quality sensor used in Daniel Rodriguez Moya's Master Thesis. It sends data to ThingsBoard
-via MQTT at a fixed frequency, measuring soil temperature and moisture using a DS18B20 and a FC-38, respectively.
-*********************************************************************************************************************************************************** */
-
-// ===========================================================================================================================================================
-// LIBRARY INCLUSION
-// ===========================================================================================================================================================
-#include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
-// Wi-Fi and MQTT libs ---------------------------------------------------------------------------------------------------------------------------------------
-#include <WiFi.h>                                                                                                // Library to connect to Wi-Fi
-#include <WiFiClientSecure.h>                                                                                    // Library to add TLS certificates to MQTT connection
-#include <PubSubClient.h>                                                                                        // Library to connect to a MQTT broker
-// ArduinoOTA libs -------------------------------------------------------------------------------------------------------------------------------------------
-#include <ESPmDNS.h>
-#include <WiFiUdp.h>
-#include <ArduinoOTA.h>
-// I2C libs --------------------------------------------------------------------------------------------------------------------------------------------------
-#include <Wire.h>
-#include <axp20x.h>                                                                                              // Library for the PMU AXP192
-// Config libs -----------------------------------------------------------------------------------------------------------------------------------------------
-#include "macros.h"
-#include "mqttUtils.h"
-#include "otaUtils.h"
-#include "wifiUtils.h"
-#include "sleepUtils.h"
-#include "powerUtils.h"
-// Sensors libs ----------------------------------------------------------------------------------------------------------------------------------------------
-#include "sensors.h"
-// LIBRARIES INCLUSION END ===================================================================================================================================
-
-// ===========================================================================================================================================================
-// CONSTRUCTORES DE OBJETOS DE CLASE DE LIBRERIA, VARIABLES GLOBALES, CONSTANTES...
-// ===========================================================================================================================================================
-static WiFiClientSecure secureClient;                                                                            // Object of the Wi-Fi library
-static PubSubClient mqttClient(secureClient);                                                                    // Object of the MQTT library
-static AXP20X_Class axp;
-// CONSTRUCTORES END =========================================================================================================================================
-
-// ===========================================================================================================================================================
-// GLOBAL VARIABLES
-// ===========================================================================================================================================================
-// Variables -------------------------------------------------------------------------------------------------------------------------------------------------
-static bool ledState = LOW;
-static volatile bool pekPressed = false;
-static RTC_DATA_ATTR uint32_t bootCount = 1;                                                                     // Boot counter must be stored in the RTC memory so it survives deep sleep, but not power-off
-// GLOBAL VARIABLES END ======================================================================================================================================
-
-// ===========================================================================================================================================================
-// ISR
-// ===========================================================================================================================================================
-static void IRAM_ATTR handlePMUIRQ() {
-  pekPressed = true;
-}
-// ISR END ===================================================================================================================================================
-
-// ===========================================================================================================================================================
-// FREERTOS ELEMENTS
-// ===========================================================================================================================================================
-// Task handles ----------------------------------------------------------------------------------------------------------------------------------------------
-static TaskHandle_t MQTTTaskHandle = NULL, PEKTaskHandle = NULL;
-// Semaphore -------------------------------------------------------------------------------------------------------------------------------------------------
-static SemaphoreHandle_t semaphoreSerial = NULL;
-// Tasks -----------------------------------------------------------------------------------------------------------------------------------------------------
-static void MQTTTask(void*);
-static void PEKTask(void*);
-// FREERTOS ELEMENTS END =====================================================================================================================================
-
-// ===========================================================================================================================================================
-// THREADS
-// ===========================================================================================================================================================
-// MQTT thread -----------------------------------------------------------------------------------------------------------------------------------------------
-static void MQTTTask(void *pvParameters){
-  while(true) {
-    ArduinoOTA.handle();                                                                                           // If a new version is available, download and install it
-
-    if(!mqttClient.connected()){                                                                                   // If no connection
-      reconnectToMQTT(mqttClient, MQTT_CLIENT, ACCESS_TOKEN, semaphoreSerial);                                     // Call reconnect function
-    }
-    mqttClient.loop();                                                                                             // Main MQTT function. It must run at the highest frequency and never be blocked
-
-    if(WiFi.status() != WL_CONNECTED){
-      reconnectToWiFi(ledState, WIFI_SSID, WIFI_PASSWORD, LED_PIN, semaphoreSerial);                               // Connect to Wi-Fi during the execution of the thread
-    }else{                                                                                                         // Check WiFi connection status
-      // MQTT Pub ----------------------------------------------------------------------------------------------------------------------------------------------
-      char dataStr[256];                                                                                           // A string is created to save a JSON containing the variables and values to be published with a size of 256 characters
-      // Sensor readings ---------------------------------------------------------------------------------------------------------------------------------------
-      // float soilTemp = random(1000, 4500) / 100.0f;                                                                // Simulated measurements
-      float soilMoist = 94.47;
-      float soilTemp = getMedianTemperatureC(TEMPERATURE_SAMPLES);                                                 // Real measurements, iterated 5 times to get the median and so more robust data
-      // float soilMoist = getMedianSoilMoisture(MOISTURE_SAMPLES);
-      // Sensor readings END -----------------------------------------------------------------------------------------------------------------------------------
-      axp.setPowerOutPut(AXP192_DCDC1, AXP202_OFF);                                                                // Turn off the sensors after measurements have been taken
-
-      float batVolt = (axp.getBattVoltage()) / 1000.0f;                                                            // Read battery voltage in mV and convert it to V
-
-      sprintf(dataStr, "{\"treeId\":%u,\"bootCnt\":%lu,\"soilTemperature\":%4.2f,\"soilMoisture\":%5.2f,\"batVoltage\":%4.3f}",
-              TREE_ID, (unsigned long)bootCount, soilTemp, soilMoist, batVolt);                                    // 'sprintf' C++ function is used to introduce the values of the sensor variables with the optimal formatting
-      
-      if(mqttClient.publish(MQTT_TOPIC_PUB, dataStr)){                                                             // The string is published on ThingsBoard topic
-        if(xSemaphoreTake(semaphoreSerial, portMAX_DELAY)){
-          Debugln(dataStr);                                                                                        // Display the string in the serial monitor
-          Debugln(F("Going to sleep until next TX..."));
-          xSemaphoreGive(semaphoreSerial);
-        }
-        bootCount++;
-
-        sleep_seconds(SLEEP_DURATION_S);                                                                           // Schedule deep sleep for the specified duration (30 seconds)
-      }else{
-        if(xSemaphoreTake(semaphoreSerial, portMAX_DELAY)){
-          Debugln(F("Failed to publish data"));
-          xSemaphoreGive(semaphoreSerial);
-        }
-      }
-      // MQTT Pub END ----------------------------------------------------------------------------------------------------------------------------------------
-    }
-
-    vTaskDelay(pdMS_TO_TICKS(100));
-  }
-}
-
-// PEK THREAD ------------------------------------------------------------------------------------------------------------------------------------------------
-static void PEKTask(void *pvParameters){
-  while(true) {
-    pekThreadRoutine(&pekPressed, axp, semaphoreSerial);
-
-    vTaskDelay(pdMS_TO_TICKS(100));
-  }
-}
-// THREADS END ===============================================================================================================================================
-
-// ===========================================================================================================================================================
-// SETUP FUNCTION
-// ===========================================================================================================================================================
-void setup() {
-  #if ENABLE_SERIAL
-    Serial.begin(115200);
-  #endif
-
-  Debugln(F("Soil Quality Sensor Beta"));
-
-  // AXP192 setup --------------------------------------------------------------------------------------------------------------------------------------------
-  Wire.begin(SDA_PIN, SCL_PIN);                                                                                  // Initialize I2C bus
-  
-  if(axp.begin(Wire, AXP192_SLAVE_ADDRESS) != 0){                                                                // "AXP192_SLAVE_ADDRESS" should be "0x34"
-    Debugln(F("AXP192 not detected!"));
-    while(1);
-  }else{
-    Debugln(F("AXP192 detected"));
-  }
-
-  setupPower(axp, PMU_IRQ_PIN, handlePMUIRQ);                                                                                  // AXP192 setup
-  initSensors();                                                                                                 // Function from the custom library to setup the sensors
-  sleep_interrupt(BUTTON_PIN, 0);                                                                                // Enable deep sleep interrupt using builtin button
-  connectToWiFi(ledState, axp, WIFI_SSID, WIFI_PASSWORD, LED_PIN, PMU_IRQ_PIN);                                  // Connect to Wi-Fi during setup
-  setupOTA();                                                                                                    // Function that contains all the OTA parameters setup
-  connectToMQTT(mqttClient, secureClient, ROOT_CA, MQTT_SERVER, MQTT_PORT);                                      // Connectarse al broker MQTT y establecer TLS
-
-  // FreeRTOS setup ------------------------------------------------------------------------------------------------------------------------------------------
-  // Create the semaphore
-  semaphoreSerial = xSemaphoreCreateMutex();
-
-  // Initialize Tasks
-  xTaskCreatePinnedToCore(
-    MQTTTask,                                                                                                    /* Function to implement the task */
-    "MQTTTask",                                                                                                  /* Name of the task */
-    10000,                                                                                                       /* Stack size in bytes */
-    NULL,                                                                                                        /* Task input parameter */
-    1,                                                                                                           /* Priority of the task */
-    &MQTTTaskHandle,                                                                                             /* Task handle. */
-    1                                                                                                            /* Core where the task should run */
-  );
-
-  xTaskCreatePinnedToCore(
-    PEKTask,                                                                                                     /* Function to implement the task */
-    "PEKTask",                                                                                                   /* Name of the task */
-    5000,                                                                                                        /* Stack size in bytes */
-    NULL,                                                                                                        /* Task input parameter */
-    1,                                                                                                           /* Priority of the task */
-    &PEKTaskHandle,                                                                                              /* Task handle. */
-    0                                                                                                            /* Core where the task should run */
-  );
-  // FreeRTOS setup END --------------------------------------------------------------------------------------------------------------------------------------
-}
-// SETUP FUNCTION END ========================================================================================================================================
-
-// ===========================================================================================================================================================
-// LOOP FUNCTION
-// ===========================================================================================================================================================
-void loop() {
-  delay(10000);                                                                                                  // Empty loop as FreeRTOS is doing the tasks' job
-}
+/* ***********************************************************************************************************************************************************
+SOIL QUALITY SENSOR: this file includes the main code for the soil quality sensor used in Daniel Rodriguez Moya's Master Thesis. It sends data to ThingsBoard
+via MQTT at a fixed frequency, measuring soil temperature and moisture using a DS18B20 and a FC-38, respectively.
+*********************************************************************************************************************************************************** */
+
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
+// Wi-Fi and MQTT libs ---------------------------------------------------------------------------------------------------------------------------------------
+#include <WiFi.h>                                                                                                // Library to connect to Wi-Fi
+#include <WiFiClientSecure.h>                                                                                    // Library to add TLS certificates to MQTT connection
+#include <PubSubClient.h>                                                                                        // Library to connect to a MQTT broker
+// ArduinoOTA libs -------------------------------------------------------------------------------------------------------------------------------------------
+#include <ESPmDNS.h>
+#include <WiFiUdp.h>
+#include <ArduinoOTA.h>
+// I2C libs --------------------------------------------------------------------------------------------------------------------------------------------------
+#include <Wire.h>
+#include <axp20x.h>                                                                                              // Library for the PMU AXP192
+// Config libs -----------------------------------------------------------------------------------------------------------------------------------------------
+#include "macros.h"
+#include "mqttUtils.h"
+#include "otaUtils.h"
+#include "wifiUtils.h"
+#include "sleepUtils.h"
+#include "powerUtils.h"
+#include "timingUtils.h"
+#include "clockUtils.h"
+#include "credentialUtils.h"
+#include "downlinkUtils.h"
+// ESP-NOW libs ----------------------------------------------------------------------------------------------------------------------------------------------
+#include "espNowUtils.h"
+#include "gatewayUtils.h"
+#include "uplinks.h"
+// Sensors libs ----------------------------------------------------------------------------------------------------------------------------------------------
+#include "sensors.h"
+#include "healthUtils.h"
+#include "statsUtils.h"
+#include "predictUtils.h"
+#include "historyUtils.h"
+#include "outboxUtils.h"
+#include "irrigationUtils.h"
+// LIBRARIES INCLUSION END ===================================================================================================================================
+
+// ===========================================================================================================================================================
+// CONSTRUCTORES DE OBJETOS DE CLASE DE LIBRERIA, VARIABLES GLOBALES, CONSTANTES...
+// ===========================================================================================================================================================
+static WiFiClientSecure secureClient;                                                                            // Object of the Wi-Fi library
+static PubSubClient mqttClient(secureClient);                                                                    // Object of the MQTT library
+static AXP20X_Class axp;
+// CONSTRUCTORES END =========================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+// Variables -------------------------------------------------------------------------------------------------------------------------------------------------
+static bool ledState = LOW;
+static volatile bool pekPressed = false;
+static bool buttonWake = false;                                                                                  // Woken by BUTTON_PIN: one quick reading, sent as fast as possible
+static RTC_DATA_ATTR uint32_t bootCount = 1;                                                                     // Boot counter must be stored in the RTC memory so it survives deep sleep, but not power-off
+static RTC_DATA_ATTR float quietTemp = FRAME_INVALID_TEMP;                                                       // Last sample the send-on-delta check compared against
+static RTC_DATA_ATTR float quietMoist = 0.0f;
+static RTC_DATA_ATTR uint8_t quietWakes = 0;
+#if DEVICE_ROLE != ROLE_GATEWAY
+static SampleFrame wakeSample;                                                                                   // Taken in setup, before Wi-Fi, so the irrigation rule does not wait for the network
+#endif
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// ISR
+// ===========================================================================================================================================================
+static void IRAM_ATTR handlePMUIRQ() {
+  pekPressed = true;
+}
+// ISR END ===================================================================================================================================================
+
+// ===========================================================================================================================================================
+// FREERTOS ELEMENTS
+// ===========================================================================================================================================================
+// Task handles ----------------------------------------------------------------------------------------------------------------------------------------------
+static TaskHandle_t MQTTTaskHandle = NULL, PEKTaskHandle = NULL, GatewayTaskHandle = NULL;
+// Semaphore -------------------------------------------------------------------------------------------------------------------------------------------------
+static SemaphoreHandle_t semaphoreSerial = NULL;
+// Tasks -----------------------------------------------------------------------------------------------------------------------------------------------------
+#if DEVICE_ROLE == ROLE_GATEWAY
+static void GatewayTask(void*);
+#else
+static void MQTTTask(void*);
+#endif
+static void PEKTask(void*);
+// FREERTOS ELEMENTS END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// SAMPLE ACQUISITION
+// ===========================================================================================================================================================
+#if DEVICE_ROLE != ROLE_GATEWAY
+static_assert(TEMP_PROBES_MAX <= FRAME_MAX_PROBES, "TEMP_PROBES_MAX probes would not fit in a sample frame");
+
+// SEND-ON-DELTA: ONCE SAMPLES HAVE BEEN QUIET FOR A WHILE, THE NEXT SLEEP PASSES OVER SOME SLOTS OF THE GRID. ONCE PER BOOT
+static void planSleepSlots(const SampleFrame& frame){
+  static bool planned = false;                                                                                   // Not in RTC memory: reset on every boot
+  if(planned) return;
+  planned = true;
+
+  bool quiet = frame.flags == 0 && quietTemp != FRAME_INVALID_TEMP && !irrigationValveOpen()
+               && fabsf(frame.soilTemp - quietTemp) < QUIET_TEMP_DELTA_C && fabsf(frame.soilMoist - quietMoist) < QUIET_MOIST_DELTA;
+  quietWakes = quiet ? (quietWakes < 255 ? quietWakes + 1 : 255) : 0;
+  quietTemp = frame.soilTemp;
+  quietMoist = frame.soilMoist;
+
+  sleep_skip_slots(quietWakes >= QUIET_WAKES ? QUIET_SKIP_SLOTS : 0);                                            // Any change, fault or open valve and the next sleep is a single period again
+}
+
+// READ EVERY SENSOR INTO "frame", SAMPLING AGAIN ON NEW FAULTS. RETURNS FALSE WHEN THE SAMPLE IS NOT WORTH THE RADIO
+// "fast": ONE SAMPLE AT THE LOWEST RESOLUTION AND NO RETRIES, AND IT IS ALWAYS SENT, FAULTS INCLUDED, SINCE SOMEONE IS WAITING FOR IT
+static bool readSample(SampleFrame& frame, bool fast){
+  SampleQuality quality = {};
+  uint8_t moistSamples = fast ? BUTTON_MOISTURE_SAMPLES : MOISTURE_SAMPLES;
+  uint8_t tempSamples = fast ? BUTTON_TEMPERATURE_SAMPLES : TEMPERATURE_SAMPLES;
+
+  frame = {};
+  frame.treeId = TREE_ID;
+  frame.bootCnt = bootCount;
+  frame.tsMs = clockNowMs();                                                                                     // From the RTC, so it is right even if the sample is delivered much later
+  sensorRailOn(RAIL_MOISTURE);                                                                                   // The FC-38 warms up while the battery is read
+  frame.batVolt = (axp.getBattVoltage()) / 1000.0f;                                                              // Read battery voltage in mV and convert it to V, first because it steers the probe resolution
+  if(fast) selectFastTemperatureResolution();
+  else selectTemperatureResolution(frame.batVolt);
+
+  for(uint8_t attempt = 0; ; attempt++){
+    sensorRailOn(RAIL_MOISTURE);
+    sensorRailOn(RAIL_TEMPERATURE);                                                                              // The DS18B20 probes warm up during the moisture samples, they draw ~1 uA while idle
+    sensorRailWaitReady(RAIL_MOISTURE);
+    frame.soilMoist = getMedianSoilMoisture(moistSamples, &quality.moistRaw, &quality.moistSpreadRaw);
+    sensorRailOff(RAIL_MOISTURE);                                                                                // Only powered for its own samples, which cuts the current and the electrolysis of the probe
+
+    sensorRailWaitReady(RAIL_TEMPERATURE);
+    frame.probeCount = getMedianTemperaturesC(frame.probeTemp, FRAME_MAX_PROBES, tempSamples, quality.probeSpreadC); // One simultaneous conversion per sample for every probe on the bus, the bus is searched again if a probe dropped out
+    sensorRailOff(RAIL_TEMPERATURE);
+    for(uint8_t i = 0; i < frame.probeCount; i++){
+      frame.probeDepthCm[i] = getProbeDepthCm(i);
+    }
+
+    uint8_t faults = checkSampleHealth(frame, quality);                                                          // Also sets "soilTemperature" to the shallowest probe, as the dashboard expects
+    if(fast || !healthShouldRetry(faults, attempt)) break;
+    Debugf("Sensor faults 0x%02X, sampling again\n", faults);
+  }
+  commitSampleHealth(frame, quality);
+  frame.valve = irrigationControl(frame);                                                                        // The valve is driven here, the server only hears about it with this or a later sample
+  windowAddSample(frame);                                                                                        // Aggregates since the last delivered sample, so skipped or failed ones still count
+
+  bool worthSending = (frame.valve >> FRAME_VALVE_SWITCHES_SHIFT) != 0                                           // A valve switch not reported yet is always worth the radio
+                      || outboxAlarmPending(frame)                                                               // So is an alarm raised or cleared, whatever the prediction says
+                      || irrigationCommandPending()                                                              // And a valve command the controller has not acknowledged
+                      || (healthShouldSend(frame) && predictionShouldSend(frame)) || fast;                       // The server can tell a well predicted sample from its own model
+  historyAppend(frame, worthSending);                                                                            // Every sample, so gaps on the server can be filled from here. Only those worth sending can become backlog
+  planSleepSlots(frame);
+  return worthSending;
+}
+
+// TIME FROM THE BUTTON WAKE TO THE READING BEING DELIVERED, "millis()" STARTS WITH THE APP SO THE ROM BOOT IS NOT INCLUDED
+static uint32_t reportButtonLatency(){
+  uint32_t latencyMs = millis();
+  if(xSemaphoreTake(semaphoreSerial, portMAX_DELAY)){
+    Debugf("Button wake to delivery: %lu ms\n", (unsigned long)latencyMs);
+    xSemaphoreGive(semaphoreSerial);
+  }
+  return latencyMs;
+}
+#endif
+// SAMPLE ACQUISITION END ====================================================================================================================================
+
+// ===========================================================================================================================================================
+// THREADS
+// ===========================================================================================================================================================
+// MQTT thread -----------------------------------------------------------------------------------------------------------------------------------------------
+#if DEVICE_ROLE != ROLE_GATEWAY
+// THE SAMPLE OF THIS WAKE COULD NOT BE DELIVERED WITHIN OUTBOX_AWAKE_BUDGET_MS: IT GOES TO THE BACKLOG AND THE NODE TO SLEEP
+static void sleepUndelivered(const char* reason){
+  if(xSemaphoreTake(semaphoreSerial, portMAX_DELAY)){
+    Debugf("%s, going to sleep until next TX...\n", reason);
+    xSemaphoreGive(semaphoreSerial);
+  }
+  outboxMissed(wakeSample);                                                                                      // Replayed from flash once a broker is back
+  bootCount++;
+  disconnectFromMQTT(mqttClient, semaphoreSerial);
+  sleep_period(SLEEP_DURATION_S);                                                                                // Better luck on the next wake than retrying a dead network on battery
+}
+
+static void MQTTTask(void *pvParameters){
+  while(true) {
+    ArduinoOTA.handle();                                                                                           // If a new version is available, download and install it
+
+    if(!mqttClient.connected()){                                                                                 // If no connection
+      if(!connectToBroker(mqttClient, MQTT_CLIENT, getAccessToken(), BROKER_AWAKE_BUDGET_MS, semaphoreSerial)){  // Fastest healthy broker first, failing over within the awake-time budget
+        sleepUndelivered("No broker reachable");
+      }
+    }
+    mqttClient.loop();                                                                                             // Main MQTT function. It must run at the highest frequency and never be blocked
+
+    if(WiFi.status() != WL_CONNECTED){
+      if(!reconnectToWiFi(ledState, WIFI_SSID, WIFI_PASSWORD, LED_PIN, semaphoreSerial, OUTBOX_AWAKE_BUDGET_MS)){  // Connect to Wi-Fi during the execution of the thread
+        sleepUndelivered("Wi-Fi lost");
+      }
+    }else{                                                                                                         // Check WiFi connection status
+      // MQTT Pub ----------------------------------------------------------------------------------------------------------------------------------------------
+      char dataStr[FRAME_JSON_MAX];                                                                              // A string is created to save a JSON containing the variables and values to be published
+      SampleFrame& frame = wakeSample;                                                                           // Every probe on the bus plus moisture and battery, same acquisition as the other node roles
+      if(outboxSendLive(mqttClient, frame, semaphoreSerial)){                                                    // Alarm lane, then this sample, ahead of anything else of the wake
+        windowReset();                                                                                           // The aggregates were delivered, the next sample starts a new window
+        predictionDelivered(frame);                                                                              // The server model moved, so does ours
+        healthDelivered(frame);
+        irrigationDelivered();
+        if(buttonWake){                                                                                          // No listen window, and the attributes can wait for the next timer wake
+          snprintf(dataStr, sizeof(dataStr), "{\"buttonLatencyMs\":%lu}", (unsigned long)reportButtonLatency());
+          mqttClient.publish(MQTT_TOPIC_PUB, dataStr);                                                           // PubSubClient only publishes at QoS 0, so the time is taken when the reading left, not on a PUBACK
+        }else{
+          if(clockShouldSync()){                                                                                 // SNTP only every few wakes, the RTC keeps the time in between
+            bool synced = clockSync([]{ mqttClient.loop(); });                                                   // Keep-alives and downlinks are still served while SNTP answers
+            if(xSemaphoreTake(semaphoreSerial, portMAX_DELAY)){
+              Debugf("Clock %s, RTC drift %ld ppm\n", synced ? "synchronised" : "not synchronised", (long)clockDriftPpm());
+              xSemaphoreGive(semaphoreSerial);
+            }
+          }
+          publishAttributes(mqttClient, frame, semaphoreSerial);                                                 // Tree, firmware and probe depths, only after a reboot or when they changed
+          downlinkAfterPublish(mqttClient, semaphoreSerial);                                                     // Queued RPCs and attribute updates, plus a listen window every few wakes
+          outboxDrainBacklog(mqttClient, frame, semaphoreSerial);                                                // Backlog lane last, in large batches and only with what is left of the awake budget
+        }
+        printPhaseTimings(semaphoreSerial);                                                                      // Handshake and probe conversion cost of this wake, next to their running averages
+        if(xSemaphoreTake(semaphoreSerial, portMAX_DELAY)){
+          Debugln(F("Going to sleep until next TX..."));
+          xSemaphoreGive(semaphoreSerial);
+        }
+        bootCount++;
+        disconnectFromMQTT(mqttClient, semaphoreSerial);                                                         // The broker frees the connection now instead of after 1.5 keep-alives
+
+        sleep_period(SLEEP_DURATION_S);                                                                            // Deep sleep until the next slot of the period (30 seconds)
+      }else if(millis() > OUTBOX_AWAKE_BUDGET_MS){
+        sleepUndelivered("Failed to publish data");
+      }else{
+        if(xSemaphoreTake(semaphoreSerial, portMAX_DELAY)){
+          Debugln(F("Failed to publish data, trying again"));
+          xSemaphoreGive(semaphoreSerial);
+        }
+      }
+      // MQTT Pub END ----------------------------------------------------------------------------------------------------------------------------------------
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(100));
+  }
+}
+#endif
+
+// GATEWAY THREAD --------------------------------------------------------------------------------------------------------------------------------------------
+#if DEVICE_ROLE == ROLE_GATEWAY
+static void GatewayTask(void *pvParameters){
+  SampleFrame frame;
+
+  while(true) {
+    ArduinoOTA.handle();
+
+    if(!mqttClient.connected()){
+      reconnectToMQTT(mqttClient, MQTT_CLIENT, getAccessToken(), semaphoreSerial);                               // The gateway connects with the token of its own ThingsBoard gateway device
+    }
+    mqttClient.loop();
+
+    if(WiFi.status() != WL_CONNECTED){
+      reconnectToWiFi(ledState, WIFI_SSID, WIFI_PASSWORD, LED_PIN, semaphoreSerial, 0);                            // Mains powered, it keeps trying
+    }else{
+      while(receiveSampleFrame(frame, NULL)){                                                                    // Collect every frame the ESP-NOW callback queued since the last iteration
+        if(!gatewayAdd(frame)){                                                                                  // Batch full by count or size: publish it and start a new one
+          gatewayFlush(mqttClient, MQTT_TOPIC_GATEWAY, semaphoreSerial);
+          if(!gatewayAdd(frame) && xSemaphoreTake(semaphoreSerial, portMAX_DELAY)){
+            Debugln(F("Gateway batch full, frame dropped"));
+            xSemaphoreGive(semaphoreSerial);
+          }
+        }
+      }
+
+      if(gatewayShouldFlush()){
+        gatewayFlush(mqttClient, MQTT_TOPIC_GATEWAY, semaphoreSerial);                                           // One message for many trees instead of one connection per tree
+      }
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(10));                                                                               // Short period, the gateway is mains-powered and frames should not pile up in the queue
+  }
+}
+#endif
+
+// PEK THREAD ------------------------------------------------------------------------------------------------------------------------------------------------
+static void PEKTask(void *pvParameters){
+  while(true) {
+    pekThreadRoutine(&pekPressed, axp, semaphoreSerial);
+
+    vTaskDelay(pdMS_TO_TICKS(100));
+  }
+}
+// THREADS END ===============================================================================================================================================
+
+// ===========================================================================================================================================================
+// NODE CYCLES
+// ===========================================================================================================================================================
+// ESP-NOW NODE ----------------------------------------------------------------------------------------------------------------------------------------------
+#if DEVICE_ROLE == ROLE_ESPNOW_NODE
+static void espNowNodeCycle(){
+  static const uint8_t gatewayMac[6] = ESPNOW_GATEWAY_MAC;
+  SampleFrame frame;
+
+  bool worthSending = readSample(frame, buttonWake);
+  printPhaseTimings(semaphoreSerial);                                                                            // Probe conversion time of this wake and what the adaptive resolution saved
+  if(!worthSending){
+    Debugf("Nothing worth sending (faults 0x%02X), radio left off\n", frame.flags);                              // Nothing useful to send, so no radio energy is spent on it
+    bootCount++;
+    sleep_period(SLEEP_DURATION_S);
+  }
+
+  bool sent = setupEspNow(ESPNOW_CHANNEL, gatewayMac) && sendSampleFrame(gatewayMac, frame);                     // No association, no DHCP, no TLS: one frame and back to sleep
+  irrigationSendPending(ESPNOW_CHANNEL);                                                                         // Same channel, the valve controller is one more peer
+  if(sent){
+    if(buttonWake) reportButtonLatency();
+    Debugln(F("Frame sent to gateway, going to sleep until next TX..."));
+    windowReset();
+    predictionDelivered(frame);
+    healthDelivered(frame);
+    irrigationDelivered();
+    outboxDelivered(frame);                                                                                      // The gateway forwards the values, its rule chain raises the alarms
+    bootCount++;
+  }else{
+    Debugln(F("Failed to send frame to gateway"));
+  }
+
+  sleep_period(SLEEP_DURATION_S);
+}
+#endif
+
+// MULTI-UPLINK NODE -----------------------------------------------------------------------------------------------------------------------------------------
+#if DEVICE_ROLE == ROLE_UPLINK_NODE
+static void uplinkNodeCycle(){
+  static const uint8_t gatewayMac[6] = ESPNOW_GATEWAY_MAC;
+  static MqttUplink mqttUplink(mqttClient, WIFI_SSID, WIFI_PASSWORD, MQTT_CLIENT, getAccessToken(), semaphoreSerial);
+  static MqttSnUplink mqttSnUplink(WIFI_SSID, WIFI_PASSWORD, MQTT_CLIENT);
+  static EspNowUplink espNowUplink(gatewayMac, ESPNOW_CHANNEL);
+  static LoraUplink loraUplink(axp);
+  Uplink* const uplinks[] = {&mqttUplink, &mqttSnUplink, &espNowUplink, &loraUplink};
+  const uint8_t uplinkCount = sizeof(uplinks) / sizeof(uplinks[0]);
+  SampleFrame frame;
+
+  bool worthSending = readSample(frame, buttonWake);
+  printPhaseTimings(semaphoreSerial);                                                                            // Probe conversion time of this wake and what the adaptive resolution saved
+  if(!worthSending){
+    Debugf("Nothing worth sending (faults 0x%02X), radio left off\n", frame.flags);                              // Nothing useful to send, so no radio energy is spent on it
+    bootCount++;
+    sleep_period(SLEEP_DURATION_S);
+  }
+
+  Uplink* used = sendWithPolicy(uplinks, uplinkCount, frame, buttonWake ? BUTTON_MAX_LATENCY_MS : UPLINK_MAX_LATENCY_MS); // Cheapest healthy uplink first, the next cheapest ones on failure
+  irrigationSendPending(WiFi.status() == WL_CONNECTED ? 0 : ESPNOW_CHANNEL);                                     // Before the radios go off, on the AP channel if an uplink associated
+  if(used != NULL){
+    if(buttonWake) reportButtonLatency();
+    Debugf("Sample sent through %s (~%.0f uJ estimated)\n", used->name(), used->estimateUj(frame));
+    windowReset();
+    predictionDelivered(frame);
+    healthDelivered(frame);
+    irrigationDelivered();
+    outboxDelivered(frame);
+    if(used != &mqttUplink && outboxBacklogPending() && mqttUplink.available()){                                 // MQTT drained it already if it carried the sample
+      mqttUplink.drainBacklog(frame);                                                                            // Bounded by the awake budget, what is left waits for the next wakes
+    }
+    bootCount++;
+  }else{
+    Debugln(F("No uplink could deliver the sample"));
+    outboxMissed(frame);                                                                                         // Replayed through MQTT once any uplink gets through again
+  }
+
+  for(uint8_t i = 0; i < uplinkCount; i++){
+    uplinks[i]->end();                                                                                           // Every radio off before deep sleep, whichever was used
+  }
+
+  sleep_period(SLEEP_DURATION_S);
+}
+#endif
+// NODE CYCLES END ===========================================================================================================================================
+
+// ===========================================================================================================================================================
+// SETUP FUNCTION
+// ===========================================================================================================================================================
+void setup() {
+  #if ENABLE_SERIAL
+    Serial.begin(115200);
+  #endif
+
+  Debugln(F("Soil Quality Sensor Beta"));
+
+  semaphoreSerial = xSemaphoreCreateMutex();                                                                     // Created first, the node cycles below print through it before any task exists
+  buttonWake = sleep_button_wake();
+  if(buttonWake) Debugln(F("Button wake: fast reading"));
+  else Debugf("Woke %ld ms after the scheduled instant\n", (long)sleep_wake_lag_ms());                           // Constant from wake to wake: it is the boot time, the period itself is exact
+
+  // AXP192 setup --------------------------------------------------------------------------------------------------------------------------------------------
+  Wire.begin(SDA_PIN, SCL_PIN);                                                                                  // Initialize I2C bus
+  
+  if(axp.begin(Wire, AXP192_SLAVE_ADDRESS) != 0){                                                                // "AXP192_SLAVE_ADDRESS" should be "0x34"
+    Debugln(F("AXP192 not detected!"));
+    while(1);
+  }else{
+    Debugln(F("AXP192 detected"));
+  }
+
+  setupPower(axp, PMU_IRQ_PIN, handlePMUIRQ);                                                                                  // AXP192 setup
+  initSensors();                                                                                                 // Function from the custom library to setup the sensors
+  setupIrrigation();                                                                                             // The valve keeps the state of the last wake until the new sample says otherwise
+  sleep_interrupt(BUTTON_PIN, 0);                                                                                // Enable deep sleep interrupt using builtin button
+
+  #if DEVICE_ROLE != ROLE_ESPNOW_NODE
+    loadCredentials();                                                                                           // ACCESS_TOKEN and the PSK, from platformio.ini on the first boot and from NVS afterwards
+  #endif
+
+  #if DEVICE_ROLE == ROLE_UPLINK_NODE
+    connectToMQTT(mqttClient, secureClient, ROOT_CA, MQTT_SERVER, MQTT_PORT);                                    // Only configures TLS and the broker, the MQTT uplink connects if it is picked
+    downlinkAttach(mqttClient);
+    uplinkNodeCycle();                                                                                           // Never returns either
+  #endif
+
+  #if DEVICE_ROLE == ROLE_ESPNOW_NODE
+    espNowNodeCycle();                                                                                           // Never returns, the node goes back to deep sleep right after sending its frame
+  #endif
+
+  #if DEVICE_ROLE == ROLE_NODE
+    bool worthSending = readSample(wakeSample, buttonWake);                                                      // Sampled and acted upon before the network, however long Wi-Fi and TLS then take
+    irrigationSendPending(ESPNOW_CHANNEL);                                                                       // Before any association, the controller listens on ESPNOW_CHANNEL and not on the AP one
+    if(!worthSending){
+      Debugf("Nothing worth sending (faults 0x%02X), no uplink\n", wakeSample.flags);                            // Decided before Wi-Fi, TLS and CONNECT, which are most of the energy of a wake
+      bootCount++;
+      sleep_period(SLEEP_DURATION_S);
+    }
+  #endif
+
+  #if DEVICE_ROLE == ROLE_GATEWAY
+    connectToWiFi(ledState, axp, WIFI_SSID, WIFI_PASSWORD, LED_PIN, PMU_IRQ_PIN, 0);                             // Mains powered, it waits for the AP as long as it takes
+  #else
+    if(!connectToWiFi(ledState, axp, WIFI_SSID, WIFI_PASSWORD, LED_PIN, PMU_IRQ_PIN, OUTBOX_AWAKE_BUDGET_MS)){   // Connect to Wi-Fi during setup, within the awake budget of the node
+      Debugln(F("No Wi-Fi, going to sleep until next TX..."));
+      outboxMissed(wakeSample);                                                                                  // The AP is the most common outage, the sample waits in flash for the next one that gets through
+      bootCount++;
+      sleep_period(SLEEP_DURATION_S);
+    }
+  #endif
+  setupOTA();                                                                                                    // Function that contains all the OTA parameters setup
+  connectToMQTT(mqttClient, secureClient, ROOT_CA, MQTT_SERVER, MQTT_PORT);                                      // Connectarse al broker MQTT y establecer TLS
+
+  #if DEVICE_ROLE == ROLE_NODE
+    downlinkAttach(mqttClient);                                                                                  // Before the first CONNECT, a broker that kept the session may deliver commands right away
+  #endif
+
+  #if DEVICE_ROLE == ROLE_GATEWAY
+    mqttClient.setBufferSize(GATEWAY_FLUSH_BYTES + 64);                                                          // Room for a whole batch plus topic and MQTT header
+    configTime(0, 0, NTP_SERVER);                                                                                // Samples are stamped on reception, so several per tree can share one message
+    setupEspNow(0, NULL);                                                                                        // Listen on the channel of the AP the gateway is associated to
+  #endif
+
+  // FreeRTOS setup ------------------------------------------------------------------------------------------------------------------------------------------
+  // Initialize Tasks
+  #if DEVICE_ROLE == ROLE_GATEWAY
+  xTaskCreatePinnedToCore(
+    GatewayTask,                                                                                                 /* Function to implement the task */
+    "GatewayTask",                                                                                               /* Name of the task */
+    10000,                                                                                                       /* Stack size in bytes */
+    NULL,                                                                                                        /* Task input parameter */
+    1,                                                                                                           /* Priority of the task */
+    &GatewayTaskHandle,                                                                                          /* Task handle. */
+    1                                                                                                            /* Core where the task should run */
+  );
+  #else
+  xTaskCreatePinnedToCore(
+    MQTTTask,                                                                                                    /* Function to implement the task */
+    "MQTTTask",                                                                                                  /* Name of the task */
+    10000,                                                                                                       /* Stack size in bytes */
+    NULL,                                                                                                        /* Task input parameter */
+    1,                                                                                                           /* Priority of the task */
+    &MQTTTaskHandle,                                                                                             /* Task handle. */
+    1                                                                                                            /* Core where the task should run */
+  );
+  #endif
+
+  xTaskCreatePinnedToCore(
+    PEKTask,                                                                                                     /* Function to implement the task */
+    "PEKTask",                                                                                                   /* Name of the task */
+    5000,                                                                                                        /* Stack size in bytes */
+    NULL,                                                                                                        /* Task input parameter */
+    1,                                                                                                           /* Priority of the task */
+    &PEKTaskHandle,                                                                                              /* Task handle. */
+    0                                                                                                            /* Core where the task should run */
+  );
+  // FreeRTOS setup END --------------------------------------------------------------------------------------------------------------------------------------
+}
+// SETUP FUNCTION END ========================================================================================================================================
+
+// ===========================================================================================================================================================
+// LOOP FUNCTION
+// ===========================================================================================================================================================
+void loop() {
+  delay(10000);                                                                                                  // Empty loop as FreeRTOS is doing the tasks' job
+}
 // LOOP FUNCTION END =========================================================================================================================================
\ No newline at end of file
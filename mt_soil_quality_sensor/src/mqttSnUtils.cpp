@@ -0,0 +1,125 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <string.h>
+#include "mqttSnUtils.h"                                                                                         // Plain C++ on purpose: the host gateway stand-in uses the same codec
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// BIG ENDIAN, AS EVERY MQTT-SN FIELD
+static void put16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)(v >> 8);
+  p[1] = (uint8_t)v;
+}
+
+static uint16_t get16(const uint8_t* p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// WRITE THE SHORT HEADER, RETURNS THE FULL MESSAGE LENGTH OR 0 IF IT DOES NOT FIT
+static size_t putHeader(uint8_t* buf, size_t size, uint8_t type, size_t bodyLen) {
+  size_t len = MQTTSN_HEADER_LEN + bodyLen;
+  if (len > 0xFF || size < len) return 0;                                                                        // The 3-byte long form is never needed for a sample
+  buf[0] = (uint8_t)len;
+  buf[1] = type;
+  return len;
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// ENCODE FUNCTIONS
+// ===========================================================================================================================================================
+// CONNECT WITH A CLEAN SESSION, THE NODE SLEEPS BETWEEN SAMPLES SO THERE IS NOTHING TO RESUME
+size_t mqttSnConnect(uint8_t* buf, size_t size, const char* clientId, uint16_t keepAliveS) {
+  size_t idLen = strlen(clientId);
+  size_t len = putHeader(buf, size, MQTTSN_CONNECT, 4 + idLen);
+  if (len == 0) return 0;
+
+  buf[2] = MQTTSN_FLAG_CLEAN_SESSION;
+  buf[3] = 0x01;                                                                                                 // Protocol id
+  put16(buf + 4, keepAliveS);
+  memcpy(buf + 6, clientId, idLen);
+  return len;
+}
+
+size_t mqttSnPublish(uint8_t* buf, size_t size, uint8_t flags, uint16_t topicId, uint16_t msgId, const uint8_t* data, size_t len) {
+  size_t msgLen = putHeader(buf, size, MQTTSN_PUBLISH, MQTTSN_PUBLISH_OVERHEAD - MQTTSN_HEADER_LEN + len);
+  if (msgLen == 0) return 0;
+
+  buf[2] = flags;
+  put16(buf + 3, topicId);
+  put16(buf + 5, msgId);
+  memcpy(buf + MQTTSN_PUBLISH_OVERHEAD, data, len);
+  return msgLen;
+}
+
+size_t mqttSnConnack(uint8_t* buf, size_t size, uint8_t returnCode) {
+  size_t len = putHeader(buf, size, MQTTSN_CONNACK, 1);
+  if (len == 0) return 0;
+
+  buf[2] = returnCode;
+  return len;
+}
+
+size_t mqttSnPuback(uint8_t* buf, size_t size, uint16_t topicId, uint16_t msgId, uint8_t returnCode) {
+  size_t len = putHeader(buf, size, MQTTSN_PUBACK, 5);
+  if (len == 0) return 0;
+
+  put16(buf + 2, topicId);
+  put16(buf + 4, msgId);
+  buf[6] = returnCode;
+  return len;
+}
+
+size_t mqttSnDisconnect(uint8_t* buf, size_t size) {
+  return putHeader(buf, size, MQTTSN_DISCONNECT, 0);
+}
+// ENCODE FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// PARSE FUNCTIONS
+// ===========================================================================================================================================================
+// CHECK THE LENGTH FIELD AGAINST THE DATAGRAM, RETURNS THE HEADER LENGTH (2 OR 4) OR 0 IF IT IS MALFORMED
+size_t mqttSnParse(const uint8_t* buf, size_t len, uint8_t* type) {
+  size_t header = MQTTSN_HEADER_LEN;
+  size_t msgLen;
+
+  if (len < MQTTSN_HEADER_LEN) return 0;
+  msgLen = buf[0];
+  if (msgLen == 0x01) {                                                                                          // Long form, accepted from other clients even if this codec never writes it
+    if (len < 4) return 0;
+    msgLen = get16(buf + 1);
+    header = 4;
+  }
+  if (msgLen != len) return 0;
+
+  *type = buf[header - 1];
+  return header;
+}
+
+bool mqttSnParsePublish(const uint8_t* buf, size_t len, uint8_t* flags, uint16_t* topicId, uint16_t* msgId, const uint8_t** data, size_t* dataLen) {
+  uint8_t type;
+  size_t header = mqttSnParse(buf, len, &type);
+  if (header == 0 || type != MQTTSN_PUBLISH || len < header + 5) return false;
+
+  *flags = buf[header];
+  *topicId = get16(buf + header + 1);
+  *msgId = get16(buf + header + 3);
+  *data = buf + header + 5;
+  *dataLen = len - header - 5;
+  return true;
+}
+
+bool mqttSnParsePuback(const uint8_t* buf, size_t len, uint16_t* topicId, uint16_t* msgId, uint8_t* returnCode) {
+  uint8_t type;
+  size_t header = mqttSnParse(buf, len, &type);
+  if (header == 0 || type != MQTTSN_PUBACK || len != header + 5) return false;
+
+  *topicId = get16(buf + header);
+  *msgId = get16(buf + header + 2);
+  *returnCode = buf[header + 4];
+  return true;
+}
+// PARSE FUNCTIONS END =======================================================================================================================================
@@ -1,37 +1,142 @@
-#include <Arduino.h>
-#include "macros.h"
-#include "mqttUtils.h"
-
-// CONNECT TO MQTT -------------------------------------------------------------------------------------------------------------------------------------------
-void connectToMQTT(PubSubClient& client, WiFiClientSecure &clientSecure, const char* rootCa, const char* mqttServer, const uint16_t mqttPort) {
-  clientSecure.setCACert(rootCa);                                                                               // Initialization of the ciphered connection
-  client.setServer(mqttServer, mqttPort);                                                                  // Function of the MQTT library to establish connection with the broker
-}
-// CONNECT TO MQTT END ---------------------------------------------------------------------------------------------------------------------------------------
-
-// RECONNECT TO MQTT -----------------------------------------------------------------------------------------------------------------------------------------
-void reconnectToMQTT(PubSubClient& client, const char* clientId, const char* token, SemaphoreHandle_t serialSemaphore) {
-  while(!client.connected()){                                                                                // Loop until we're reconnected
-    if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
-      Debug(F("Attempting MQTT connection..."));
-      xSemaphoreGive(serialSemaphore);
-    }
-
-    if(client.connect("soil_quaity_sensor", token, NULL)){                                            // Attempt to connect
-      if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
-        Debugln(F("connected"));
-        xSemaphoreGive(serialSemaphore);
-      }
-    }else{
-      if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
-        Debug(F("failed, rc="));
-        Debug(client.state());
-        Debugln(F(" try again in 5 seconds"));
-        xSemaphoreGive(serialSemaphore);
-      }
-
-      vTaskDelay(pdMS_TO_TICKS(5000));                                                                           // Wait 5 seconds before retrying
-    }
-  }
-}
-// RECONNECT TO MQTT END -------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
+#include <Arduino.h>
+#include "macros.h"
+#include "mqttUtils.h"
+#include "tlsUtils.h"
+#include "timingUtils.h"
+#include "frameUtils.h"
+#include "brokerUtils.h"
+#include "credentialUtils.h"
+#include "attributeUtils.h"
+
+static WiFiClientSecure* brokerClient = NULL;
+static const char* brokerRootCa = NULL;
+static BrokerEndpoint brokers[MAX_BROKERS];
+
+// CONNECT TO MQTT -------------------------------------------------------------------------------------------------------------------------------------------
+void connectToMQTT(PubSubClient& client, WiFiClientSecure &clientSecure, const char* rootCa, const char* mqttServer, const uint16_t mqttPort) {
+  brokerClient = &clientSecure;
+  brokerRootCa = rootCa;
+  brokers[0] = {mqttServer, mqttPort, false};                                                                    // Primary cloud broker
+  brokers[1] = {TLS_PSK ? MQTT_PSK_SERVER : NULL, MQTT_PSK_PORT, true};                                          // Local LAN broker
+  brokers[2] = {MQTT_SECONDARY_SERVER, MQTT_SECONDARY_PORT, false};
+
+  setupTLS(clientSecure, rootCa, mqttServer, mqttPort, false);                                                   // Initialization of the ciphered connection, "connectToBroker()" points it at the broker it picks
+  client.setServer(mqttServer, mqttPort);                                                                        // Function of the MQTT library to establish connection with the broker
+  client.setBufferSize(FRAME_JSON_MAX + 64);                                                                     // The default 256 bytes do not fit a sample with several probes and its window aggregates
+  client.setKeepAlive(MQTT_KEEPALIVE_S);
+}
+// CONNECT TO MQTT END ---------------------------------------------------------------------------------------------------------------------------------------
+
+// TRY TO CONNECT TO MQTT ONCE -------------------------------------------------------------------------------------------------------------------------------
+bool tryConnectToMQTT(PubSubClient& client, const char* clientId, const char* token, SemaphoreHandle_t serialSemaphore) {
+  bool connected = false;
+
+  if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+    Debug(F("Attempting MQTT connection..."));
+    xSemaphoreGive(serialSemaphore);
+  }
+
+  if(connectTLS(serialSemaphore)){                                                                               // TLS session first (pinned or full), so the token is only sent to a verified peer
+    phaseStart(PHASE_MQTT_CONNECT);
+    connected = client.connect(clientId, token, NULL, NULL, 0, false, NULL, !MQTT_PERSISTENT_SESSION);           // No will and no password: the smallest CONNECT ThingsBoard takes
+    phaseEnd(PHASE_MQTT_CONNECT);
+  }
+
+  if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+    if(connected){
+      Debugln(F("connected"));
+    }else{
+      Debug(F("failed, rc="));
+      Debugln(client.state());
+    }
+    xSemaphoreGive(serialSemaphore);
+  }
+
+  return connected;
+}
+// TRY TO CONNECT TO MQTT ONCE END ---------------------------------------------------------------------------------------------------------------------------
+
+// CONNECT TO THE BEST BROKER --------------------------------------------------------------------------------------------------------------------------------
+// FASTEST HEALTHY BROKER FIRST, FAILING OVER TO THE NEXT ONES AS LONG AS THEIR EXPECTED CONNECT TIME STILL FITS IN "budgetMs"
+bool connectToBroker(PubSubClient& client, const char* clientId, const char* token, uint32_t budgetMs, SemaphoreHandle_t serialSemaphore) {
+  bool usable[MAX_BROKERS];
+  uint8_t order[MAX_BROKERS];
+  uint32_t start = millis();
+
+  if (brokerClient == NULL) return false;
+  for (uint8_t i = 0; i < MAX_BROKERS; i++) usable[i] = !brokers[i].psk || pskAvailable();                       // The LAN broker needs a provisioned PSK
+  uint8_t count = rankBrokers(brokers, usable, MAX_BROKERS, order);
+
+  for (uint8_t i = 0; i < count; i++) {
+    const BrokerEndpoint& broker = brokers[order[i]];
+    if (i > 0 && millis() - start + brokerExpectedMs(order[i]) > budgetMs) break;                                // The first one is always tried, the others only if they can still make it
+
+    if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+      Debugf("Broker %s:%u (expected %lu ms, %u%% success)\n", broker.host, broker.port, (unsigned long)brokerExpectedMs(order[i]), brokerHealth(order[i]).successPct);
+      xSemaphoreGive(serialSemaphore);
+    }
+    brokerClient->stop();                                                                                        // A session to another broker must not be reused by PubSubClient
+    setupTLS(*brokerClient, brokerRootCa, broker.host, broker.port, broker.psk);
+    client.setServer(broker.host, broker.port);
+
+    uint32_t attemptStart = millis();
+    bool connected = tryConnectToMQTT(client, clientId, token, serialSemaphore);
+    brokerResult(order[i], connected, millis() - attemptStart);
+    if (connected) return true;
+  }
+  return false;
+}
+// CONNECT TO THE BEST BROKER END ----------------------------------------------------------------------------------------------------------------------------
+
+// DISCONNECT FROM MQTT --------------------------------------------------------------------------------------------------------------------------------------
+// CLEAN DISCONNECT BEFORE DEEP SLEEP, SO THE BROKER DOES NOT WAIT FOR THE KEEP-ALIVE TO EXPIRE. THE PERSISTENT SESSION IS KEPT
+void disconnectFromMQTT(PubSubClient& client, SemaphoreHandle_t serialSemaphore) {
+  if(!client.connected()) return;
+
+  client.disconnect();
+  if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+    Debugln(F("Disconnected from broker"));
+    xSemaphoreGive(serialSemaphore);
+  }
+}
+// DISCONNECT FROM MQTT END ----------------------------------------------------------------------------------------------------------------------------------
+
+// RECONNECT TO MQTT -----------------------------------------------------------------------------------------------------------------------------------------
+void reconnectToMQTT(PubSubClient& client, const char* clientId, const char* token, SemaphoreHandle_t serialSemaphore) {
+  while(!client.connected()){                                                                                    // Loop until we're reconnected
+    if(!connectToBroker(client, clientId, token, BROKER_ROUND_BUDGET_MS, serialSemaphore)){
+      if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+        Debugln(F("No broker reachable, trying again in 5 seconds"));
+        xSemaphoreGive(serialSemaphore);
+      }
+
+      vTaskDelay(pdMS_TO_TICKS(5000));                                                                           // Wait 5 seconds before another round over every broker
+    }
+  }
+}
+// RECONNECT TO MQTT END -------------------------------------------------------------------------------------------------------------------------------------
+
+// PUBLISH THE ATTRIBUTES ------------------------------------------------------------------------------------------------------------------------------------
+// ONLY WHEN THEY DIFFER FROM THE LAST ONES THE BROKER TOOK, SO A NORMAL WAKE SENDS NOTHING BUT THE TELEMETRY
+bool publishAttributes(PubSubClient& client, const SampleFrame& frame, SemaphoreHandle_t serialSemaphore) {
+  char attributesStr[ATTRIBUTES_JSON_MAX];
+
+  formatAttributesJson(attributesStr, sizeof(attributesStr), frame, true);
+  if(!attributesChanged(attributesStr)) return true;
+
+  if(!client.publish(MQTT_TOPIC_ATTRIBUTES, attributesStr)){
+    if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+      Debugln(F("Failed to publish attributes"));
+      xSemaphoreGive(serialSemaphore);
+    }
+    return false;
+  }
+
+  attributesPublished(attributesStr);
+  if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+    Debugln(attributesStr);
+    xSemaphoreGive(serialSemaphore);
+  }
+  return true;
+}
+// PUBLISH THE ATTRIBUTES END --------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1,130 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
+#include <PubSubClient.h>
+#include "outboxUtils.h"
+#include "historyUtils.h"
+#include "macros.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+static RTC_DATA_ATTR uint8_t reportedAlarms = 0;                                                                 // Alarms the server was last told about
+static RTC_DATA_ATTR uint64_t backlogFromMs = 0;                                                                 // "ts" of the oldest sample not delivered yet, 0 with no backlog
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// PAST "limit" RAISES THE ALARM, BUT AN ACTIVE ONE ONLY CLEARS "margin" BACK INSIDE IT
+static bool beyond(bool active, float value, float limit, float margin, bool below) {
+  if (below) return value < (active ? limit + margin : limit);
+  return value > (active ? limit - margin : limit);
+}
+
+// "backlogFromMs" IS LOST WITH THE RTC MEMORY ON A POWER-ON, THE PENDING SAMPLES IN FLASH ARE NOT
+static void recoverBacklog() {
+  if (backlogFromMs == 0) backlogFromMs = historyPendingFromMs();
+}
+
+static void printLane(OutboxLane lane, const char* message, SemaphoreHandle_t serialSemaphore) {
+  static const char* const names[LANE_COUNT] = {"alarm", "live", "backlog"};
+  if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+    Debugf("[%s] %s\n", names[lane], message);
+    xSemaphoreGive(serialSemaphore);
+  }
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// OUTBOX FUNCTIONS
+// ===========================================================================================================================================================
+// ALARM_* BITS OF A SAMPLE. A FAULTY VALUE RAISES ALARM_SENSOR, NEVER A FROST OR DRY ALARM
+uint8_t outboxAlarms(const SampleFrame& frame) {
+  uint8_t alarms = 0;
+
+  if (frame.soilTemp != FRAME_INVALID_TEMP) {
+    if (beyond(reportedAlarms & ALARM_FROST, frame.soilTemp, ALARM_TEMP_MIN_C, ALARM_TEMP_HYSTERESIS_C, true)) alarms |= ALARM_FROST;
+    if (beyond(reportedAlarms & ALARM_HEAT, frame.soilTemp, ALARM_TEMP_MAX_C, ALARM_TEMP_HYSTERESIS_C, false)) alarms |= ALARM_HEAT;
+  }
+  if (!(frame.flags & FRAME_FAULT_MOIST)) {
+    if (beyond(reportedAlarms & ALARM_DRY, frame.soilMoist, ALARM_MOIST_MIN, ALARM_MOIST_HYSTERESIS, true)) alarms |= ALARM_DRY;
+    if (beyond(reportedAlarms & ALARM_WATERLOGGED, frame.soilMoist, ALARM_MOIST_MAX, ALARM_MOIST_HYSTERESIS, false)) alarms |= ALARM_WATERLOGGED;
+  }
+  if (frame.flags != 0) alarms |= ALARM_SENSOR;
+  if (frame.valve & FRAME_VALVE_TIMEOUT) alarms |= ALARM_VALVE;
+  return alarms;
+}
+
+// A RAISED OR CLEARED ALARM IS ALWAYS WORTH THE RADIO, WHATEVER SUPPRESSED THE SAMPLE OTHERWISE
+bool outboxAlarmPending(const SampleFrame& frame) {
+  return outboxAlarms(frame) != reportedAlarms;
+}
+
+// ALARM LANE, THEN LIVE LANE. NOTHING ELSE GOES OUT BEFORE THEM, SO A FRESH READING NEVER WAITS BEHIND OLD ONES. TRUE WHEN THE SAMPLE WAS PUBLISHED
+bool outboxSendLive(PubSubClient& client, const SampleFrame& frame, SemaphoreHandle_t serialSemaphore) {
+  char dataStr[FRAME_JSON_MAX];
+  uint8_t alarms = outboxAlarms(frame);
+
+  if (alarms != reportedAlarms) {
+    if (frame.tsMs != 0) snprintf(dataStr, sizeof(dataStr), "{\"ts\":%llu,\"values\":{\"alarms\":%u}}", (unsigned long long)frame.tsMs, alarms);
+    else snprintf(dataStr, sizeof(dataStr), "{\"alarms\":%u}", alarms);
+    if (!client.publish(MQTT_TOPIC_PUB, dataStr)) return false;                                                  // Same connection as the sample, no point in trying it
+    reportedAlarms = alarms;
+    printLane(LANE_ALARM, dataStr, serialSemaphore);
+  }
+
+  formatTelemetryJson(dataStr, sizeof(dataStr), frame);                                                          // Per-depth keys are only added when there is more than one probe
+  if (!client.publish(MQTT_TOPIC_PUB, dataStr)) return false;
+  historyMarkDelivered();                                                                                        // Not part of any backlog now
+  printLane(LANE_LIVE, dataStr, serialSemaphore);
+  return true;
+}
+
+// BACKLOG LANE: SAMPLES OLDER THAN "frame" THAT WERE WORTH SENDING BUT NEVER GOT THROUGH, IN LARGE BATCHES AND ONLY WITH WHAT IS LEFT OF
+// OUTBOX_AWAKE_BUDGET_MS. THE ONES SUPPRESSED ON PURPOSE STAY IN FLASH FOR "getHistory" ONLY. WHAT DOES NOT FIT IS LEFT FOR THE NEXT WAKES. RETURNS THE SAMPLES SENT
+uint16_t outboxDrainBacklog(PubSubClient& client, const SampleFrame& frame, SemaphoreHandle_t serialSemaphore) {
+  uint16_t total = 0;
+  char line[48];
+
+  recoverBacklog();
+  while (backlogFromMs != 0 && millis() < OUTBOX_AWAKE_BUDGET_MS) {
+    uint64_t lastMs;
+    bool more;
+    uint64_t toMs = frame.tsMs != 0 ? frame.tsMs - 1 : UINT64_MAX;                                               // The live sample went through its own lane
+    uint16_t sent = historyReplay(client, backlogFromMs, toMs, OUTBOX_BACKLOG_CHUNK, OUTBOX_AWAKE_BUDGET_MS, true, &lastMs, &more);
+    total += sent;
+    if (!more) backlogFromMs = 0;                                                                                // Every missed sample is delivered
+    else if (sent == 0) break;                                                                                   // Publishing failed or the budget is spent, same range next time
+    else backlogFromMs = lastMs + 1;
+  }
+
+  if (total > 0) {
+    snprintf(line, sizeof(line), "%u samples replayed%s", total, backlogFromMs != 0 ? ", more left" : "");
+    printLane(LANE_BACKLOG, line, serialSemaphore);
+  }
+  return total;
+}
+
+// THE NODE GOES BACK TO SLEEP WITHOUT DELIVERING "frame": IT IS THE FIRST OF THE BACKLOG, UNLESS AN OLDER ONE ALREADY IS.
+// ONLY TIMESTAMPED SAMPLES CAN BE REPLAYED, THE OTHERS ARE NOT IN THE HISTORY
+void outboxMissed(const SampleFrame& frame) {
+  recoverBacklog();
+  if (!HISTORY_ENABLED || frame.tsMs == 0 || backlogFromMs != 0) return;
+  backlogFromMs = frame.tsMs;
+}
+
+// SAMPLES OF EARLIER WAKES ARE WAITING, WORTH A DRAIN THROUGH MQTT EVEN WHEN THIS ONE WENT OUT THROUGH ANOTHER UPLINK
+bool outboxBacklogPending() {
+  recoverBacklog();
+  return backlogFromMs != 0;
+}
+
+// DELIVERED THROUGH ANOTHER UPLINK, E.G. ESP-NOW: THE VALUES BEHIND THE ALARMS TRAVELLED IN THE FRAME ITSELF
+void outboxDelivered(const SampleFrame& frame) {
+  reportedAlarms = outboxAlarms(frame);
+  historyMarkDelivered();
+}
+// OUTBOX FUNCTIONS END ======================================================================================================================================
@@ -1,37 +1,116 @@
-#include <Arduino.h>
-#include "powerUtils.h"
-#include "macros.h"
-
-void setupPower(AXP20X_Class& axp192, const uint8_t pmuIRQPin, void (*isr)()){
-    axp192.setPowerOutPut(AXP192_DCDC1, AXP202_ON);                                                                   // Turn on the 3V3 pin corresponding to DCDC1 on the AXP192 - Power on sensors
-
-    axp192.setPowerOutPut(AXP192_LDO2, AXP202_OFF);                                                                   // Turn off LoRa
-    axp192.setPowerOutPut(AXP192_LDO3, AXP202_OFF);                                                                   // Disable GPS power
-    Debugln(F("GPS and LoRa powered off"));
-
-    axp192.adc1Enable(AXP202_BATT_VOL_ADC1, true);                                                                    // Enable ADC for battery voltage
-
-    pinMode(pmuIRQPin, INPUT);                                                                                   // Set up PEK button IRQ pin
-
-    axp192.clearIRQ();                                                                                                // Clear any existing IRQs
-    axp192.enableIRQ(AXP202_PEK_LONGPRESS_IRQ, true);                                                                 // Enable PEK IRQ for long press
-    attachInterrupt(digitalPinToInterrupt(PMU_IRQ_PIN), isr, FALLING);                                    // Enable the interruption to notify the ESP32 to give access to execute the code to power off the device
-}
-
-void pekThreadRoutine(volatile bool* pekPressedFlag, AXP20X_Class& axp192, SemaphoreHandle_t serialSemaphore){
-    if(*pekPressedFlag){                                                                                                // Check for PEK press ISR flag
-        *pekPressedFlag = false;
-        axp192.readIRQ();                                                                                               // The task checks the type of IRQ
-
-        if(axp192.isPEKLongtPressIRQ()){                                                                                // If the IRQ is long-press type, the device is switched off
-            if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
-                Debugln(F("Long press detected: Shutting down..."));
-                xSemaphoreGive(serialSemaphore);
-            }
-            vTaskDelay(pdMS_TO_TICKS(100));                                                                            // Delay to get to see the print
-            axp192.shutdown();
-        }
-
-        axp192.clearIRQ();
-    }
+#include <Arduino.h>
+#include "powerUtils.h"
+#include "macros.h"
+
+struct RailConfig {
+    int8_t gpio;                                                                                                 // Negative: the rail is the 3V3 pin of DCDC1, shared by every rail configured that way
+    uint16_t warmUpMs;
+};
+
+static const RailConfig railConfigs[RAIL_COUNT] = {
+    {TEMP_RAIL_GPIO, TEMP_RAIL_WARMUP_MS},
+    {MOIST_RAIL_GPIO, MOIST_RAIL_WARMUP_MS}
+};
+
+static AXP20X_Class* railAxp = NULL;
+static uint8_t railsOn = 0;                                                                                      // One bit per SensorRail
+static uint32_t railOnMs[RAIL_COUNT];
+static uint32_t dcdc1OnMs = 0;
+
+void setupPower(AXP20X_Class& axp192, const uint8_t pmuIRQPin, void (*isr)()){
+    setupSensorRails(axp192);                                                                                    // Sensors stay unpowered until their own measurement, see "sensorRailOn()"
+
+    axp192.setPowerOutPut(AXP192_LDO2, AXP202_OFF);                                                                   // Turn off LoRa
+    axp192.setPowerOutPut(AXP192_LDO3, AXP202_OFF);                                                                   // Disable GPS power
+    Debugln(F("GPS and LoRa powered off"));
+
+    axp192.adc1Enable(AXP202_BATT_VOL_ADC1, true);                                                                    // Enable ADC for battery voltage
+
+    pinMode(pmuIRQPin, INPUT);                                                                                   // Set up PEK button IRQ pin
+
+    axp192.clearIRQ();                                                                                                // Clear any existing IRQs
+    axp192.enableIRQ(AXP202_PEK_LONGPRESS_IRQ, true);                                                                 // Enable PEK IRQ for long press
+    attachInterrupt(digitalPinToInterrupt(PMU_IRQ_PIN), isr, FALLING);                                    // Enable the interruption to notify the ESP32 to give access to execute the code to power off the device
+}
+
+// SENSOR RAILS ----------------------------------------------------------------------------------------------------------------------------------------------
+static bool onDcdc1(uint8_t rail){
+    return railConfigs[rail].gpio < 0;
+}
+
+static bool dcdc1InUse(){
+    for(uint8_t i = 0; i < RAIL_COUNT; i++){
+        if((railsOn & (1 << i)) && onDcdc1(i)) return true;
+    }
+    return false;
+}
+
+void setupSensorRails(AXP20X_Class& axp192){
+    railAxp = &axp192;
+    railsOn = 0;
+
+    for(uint8_t i = 0; i < RAIL_COUNT; i++){
+        if(onDcdc1(i)) continue;
+        pinMode(railConfigs[i].gpio, OUTPUT);
+        digitalWrite(railConfigs[i].gpio, LOW);
+    }
+#if DCDC1_SWITCHED
+    axp192.setPowerOutPut(AXP192_DCDC1, AXP202_OFF);                                                             // Turn off the 3V3 pin corresponding to DCDC1 on the AXP192
+#else
+    axp192.setPowerOutPut(AXP192_DCDC1, AXP202_ON);                                                              // Something else lives on the 3V3 pin, it stays on for the whole wake
+    dcdc1OnMs = millis();
+#endif
+}
+
+// POWER A SENSOR AND START ITS WARM-UP, THE CALLER CAN DO OTHER WORK BEFORE "sensorRailWaitReady()"
+void sensorRailOn(SensorRail rail){
+    if(railsOn & (1 << rail)) return;
+
+    if(!onDcdc1(rail)){
+        digitalWrite(railConfigs[rail].gpio, HIGH);
+        railOnMs[rail] = millis();
+    }else{
+        if(DCDC1_SWITCHED && !dcdc1InUse()){
+            railAxp->setPowerOutPut(AXP192_DCDC1, AXP202_ON);
+            dcdc1OnMs = millis();
+        }
+        railOnMs[rail] = dcdc1OnMs;                                                                              // A shared rail that is already up has been warming up since then
+    }
+    railsOn |= (1 << rail);
+}
+
+// WAIT ONLY FOR WHAT IS LEFT OF THE WARM-UP
+void sensorRailWaitReady(SensorRail rail){
+    uint32_t elapsed = millis() - railOnMs[rail];
+    if(elapsed < railConfigs[rail].warmUpMs) delay(railConfigs[rail].warmUpMs - elapsed);
+}
+
+void sensorRailOff(SensorRail rail){
+    if(!(railsOn & (1 << rail))) return;
+    railsOn &= ~(1 << rail);
+
+    if(!onDcdc1(rail)){
+        digitalWrite(railConfigs[rail].gpio, LOW);
+    }else if(DCDC1_SWITCHED && !dcdc1InUse()){
+        railAxp->setPowerOutPut(AXP192_DCDC1, AXP202_OFF);                                                       // Last sensor on DCDC1 done
+    }
+}
+// SENSOR RAILS END ------------------------------------------------------------------------------------------------------------------------------------------
+
+void pekThreadRoutine(volatile bool* pekPressedFlag, AXP20X_Class& axp192, SemaphoreHandle_t serialSemaphore){
+    if(*pekPressedFlag){                                                                                                // Check for PEK press ISR flag
+        *pekPressedFlag = false;
+        axp192.readIRQ();                                                                                               // The task checks the type of IRQ
+
+        if(axp192.isPEKLongtPressIRQ()){                                                                                // If the IRQ is long-press type, the device is switched off
+            if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+                Debugln(F("Long press detected: Shutting down..."));
+                xSemaphoreGive(serialSemaphore);
+            }
+            vTaskDelay(pdMS_TO_TICKS(100));                                                                            // Delay to get to see the print
+            axp192.shutdown();
+        }
+
+        axp192.clearIRQ();
+    }
 }
\ No newline at end of file
@@ -0,0 +1,81 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <math.h>
+#include <stdlib.h>
+#include "predictUtils.h"                                                                                        // Plain C++ on purpose: tools/predict_reconstruct.cpp runs the very same model on the host
+#include "macros.h"
+#include "rtcMemory.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+static RTC_DATA_ATTR Predictor tempModel;                                                                        // Model of "soilTemperature" as the server knows it, only moved by delivered samples
+static RTC_DATA_ATTR Predictor moistModel;                                                                       // Same for "soilMoisture"
+static RTC_DATA_ATTR uint8_t deliveredFlags = 0;                                                                 // Faults of the last delivered sample, a cleared fault has to reach the server too
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// MODEL FUNCTIONS
+// ===========================================================================================================================================================
+// SAME ROUNDING AS THE "%.2f" OF THE TELEMETRY, SO BOTH SIDES START FROM THE SAME INTEGERS
+int32_t predictToHundredths(float value) {
+  return (int32_t)lroundf(value * 100.0f);
+}
+
+// SLOT OF THE SLEEP GRID NEAREST TO "tsMs". NOT "bootCnt": SKIPPED SLOTS DO NOT COUNT AS BOOTS AND BUTTON WAKES DO, WHILE "ts" REACHES THE SERVER AS IT IS
+uint32_t predictStep(uint64_t tsMs) {
+  return (uint32_t)((tsMs + PREDICT_STEP_MS / 2) / PREDICT_STEP_MS);
+}
+
+// LINEAR TREND FROM THE LAST DELIVERED VALUE, IN HUNDREDTHS
+int32_t predictAt(const Predictor& model, uint32_t step) {
+  if (!model.valid) return 0;
+  int64_t ahead = (int64_t)model.trend * (int32_t)(step - model.step);
+  return model.level + (int32_t)(ahead / (1 << PREDICT_TREND_SHIFT));                                            // Division, not a shift: rounds towards zero the same way for both signs on every compiler
+}
+
+// ANCHOR THE MODEL ON A DELIVERED VALUE. THE TREND IS SMOOTHED BY 1/2, SO ONE NOISY SAMPLE DOES NOT SET THE SLOPE OF THE NEXT HOURS
+void predictUpdate(Predictor& model, uint32_t step, int32_t value) {
+  if (model.valid && step != model.step) {
+    int32_t observed = (int32_t)(((int64_t)(value - model.level) << PREDICT_TREND_SHIFT) / (int32_t)(step - model.step));
+    model.trend += (observed - model.trend) / 2;
+  } else if (!model.valid) {
+    model.trend = 0;
+  }
+  model.level = value;
+  model.step = step;
+  model.valid = true;
+}
+// MODEL FUNCTIONS END =======================================================================================================================================
+
+// ===========================================================================================================================================================
+// SENSOR FUNCTIONS
+// ===========================================================================================================================================================
+// TRUE WHEN THE SERVER'S PREDICTION OF THIS SAMPLE WOULD BE OFF BY MORE THAN THE TOLERANCE, OR IT HAS NOT HEARD FROM THE SENSOR FOR TOO LONG.
+// FAULTS ARE LEFT TO THE HEALTH CHECKS, A FRAME WITH ANY OF THEM, OR WITHOUT THE ONES LAST SENT, IS ALWAYS SENT. SO IS ONE WITHOUT A TIME
+bool predictionShouldSend(const SampleFrame& frame) {
+  if (!PREDICTION_REPORTING) return true;
+  if (frame.flags != 0 || frame.flags != deliveredFlags || frame.soilTemp == FRAME_INVALID_TEMP || !tempModel.valid || !moistModel.valid) return true;
+  if (frame.tsMs == 0) return true;                                                                              // Clock never set, the server could not place the prediction
+  uint32_t step = predictStep(frame.tsMs);
+  if (step - tempModel.step >= PREDICT_HEARTBEAT_WAKES) return true;                                             // Also re-anchors a trend that drifted within the tolerance, and a clock set backwards
+
+  int32_t tempError = predictToHundredths(frame.soilTemp) - predictAt(tempModel, step);
+  int32_t moistError = predictToHundredths(frame.soilMoist) - predictAt(moistModel, step);
+  return abs(tempError) > predictToHundredths(PREDICT_TEMP_TOLERANCE_C) || abs(moistError) > predictToHundredths(PREDICT_MOIST_TOLERANCE);
+}
+
+// ONLY ONCE THE SAMPLE REACHED THE SERVER, OTHERWISE BOTH MODELS WOULD DRIFT APART
+void predictionDelivered(const SampleFrame& frame) {
+  deliveredFlags = frame.flags;
+  if (frame.tsMs == 0) {                                                                                         // Nowhere on the time axis: start again from the next sample with a time, which is always sent
+    tempModel.valid = false;
+    moistModel.valid = false;
+    return;
+  }
+  if (frame.soilTemp != FRAME_INVALID_TEMP) predictUpdate(tempModel, predictStep(frame.tsMs), predictToHundredths(frame.soilTemp));
+  if (!(frame.flags & FRAME_FAULT_MOIST)) predictUpdate(moistModel, predictStep(frame.tsMs), predictToHundredths(frame.soilMoist));
+}
+// SENSOR FUNCTIONS END ======================================================================================================================================
@@ -1,87 +1,276 @@
-// ===========================================================================================================================================================
-// LIBRARY INCLUSION
-// ===========================================================================================================================================================
-#include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
-#include <OneWire.h>
-#include <DallasTemperature.h>
-#include <QuickMedianLib.h>
-#include "sensors.h"
-#include "macros.h"
-// LIBRARY INCLUSION END =====================================================================================================================================
-
-// ===========================================================================================================================================================
-// CONSTRUCTORES DE OBJETOS DE CLASE DE LIBRERIA, VARIABLES GLOBALES, CONSTANTES...
-// ===========================================================================================================================================================
-static OneWire oneWireBus(ONE_WIRE_PIN);
-static DallasTemperature tempSensor(&oneWireBus);
-// CONSTRUCTORES END =========================================================================================================================================
-
-// ===========================================================================================================================================================
-// GLOBAL VARIABLES
-// ===========================================================================================================================================================
-static const float humedadAire = 605.0f;
-static const float humedadAgua = 500.0f;
-// GLOBAL VARIABLES END ======================================================================================================================================
-
-// ===========================================================================================================================================================
-// SETUP FUNCTIONS
-// ===========================================================================================================================================================
-void initSensors() {
-  analogSetAttenuation(ADC_11db);                                                                                // Set the attenuation to -11 dB to go from 0V to 3V3 in the range of 0 to 4095
-  tempSensor.begin();                                                                                            // Start the OneWire bus for the DS18B20
-}
-// SETUP FUNCTIONS END =======================================================================================================================================
-
-// ===========================================================================================================================================================
-// LOOP FUNCTIONS
-// ===========================================================================================================================================================
-// SOIL TEMPERATURE FUNCTIONS --------------------------------------------------------------------------------------------------------------------------------
-// READ TEMPERATURE FUNCTION
-static float readTemperatureC() {
-  tempSensor.requestTemperatures();                                                                              // Ask the OneWire bus to be available to read the temperature
-  return tempSensor.getTempCByIndex(0);                                                                          // Read temperature from the first (and only) device
-}
-
-// GET MEDIAN TEMPERATURE FROM "X" SAMPLES
-float getMedianTemperatureC(uint8_t samples) {
-  if (samples == 0) return 0.0f;                                                                               // If the function is called like "getMedianTemperature(0)", just return 0
-
-  float measurements[samples];                                                                                 // Create a local array of measurements of size "samples"
-
-  for (uint8_t i = 0; i < samples; i++) {                                                                      // For each loop cycle,
-    measurements[i] = readTemperatureC();                                                                    // add each measurement to its corresponding index
-    delay(10);                                                                                               // Small delay between samples
-  }
-
-  return QuickMedian<float>::GetMedian(measurements, samples);                                                 // Return the median value corresponding to the measurements array
-}
-// SOIL TEMPERATURE FUNCTIONS END ----------------------------------------------------------------------------------------------------------------------------
-
-// SOIL MOISTURE FUNCTIONS -----------------------------------------------------------------------------------------------------------------------------------
-// ADAPTION OF MAP FUNCTION TO WORK WITH FLOATS
-static float fmap(float x, float in_min, float in_max, float out_min, float out_max) {
-  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
-}
-
-// READ MOISTURE FUNCTION
-static float readSoilMoisturePercent() {
-  int raw = analogRead(SOIL_MOIST_PIN);
-  float percent = fmap(raw, humedadAire, humedadAgua, 0.0f, 100.0f);
-  return constrain(percent, 0.0f, 100.0f);
-}
-
-// GET MEDIAN MOISTURE FROM "X" SAMPLES
-float getMedianSoilMoisture(uint8_t samples) {
-  if (samples == 0) return 0.0;
-
-  float values[samples];
-
-  for (uint8_t i = 0; i < samples; i++) {
-    values[i] = readSoilMoisturePercent();
-    delay(10);
-  }
-
-  return QuickMedian<float>::GetMedian(values, samples);
-}
-// SOIL MOISTURE FUNCTIONS END -------------------------------------------------------------------------------------------------------------------------------
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include <QuickMedianLib.h>
+#include "sensors.h"
+#include "frameUtils.h"
+#include "macros.h"
+#include "timingUtils.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// CONSTRUCTORES DE OBJETOS DE CLASE DE LIBRERIA, VARIABLES GLOBALES, CONSTANTES...
+// ===========================================================================================================================================================
+static OneWire oneWireBus(ONE_WIRE_PIN);                                                                         // The DS18B20 probes are driven straight from OneWire, the ROM cache below replaces the library bus search
+// CONSTRUCTORES END =========================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+static const float humedadAire = 605.0f;
+static const float humedadAgua = 500.0f;
+
+#define DS18B20_FAMILY 0x28
+#define CMD_CONVERT_T 0x44
+#define CMD_READ_SCRATCHPAD 0xBE
+#define CMD_WRITE_SCRATCHPAD 0x4E
+#define CONV_12BIT_US 750000UL                                                                                   // Datasheet maximum for a 12-bit conversion, seed for the measured average below
+
+static const uint8_t probeDepthsCm[TEMP_PROBES_MAX] = TEMP_PROBE_DEPTHS_CM;
+static const uint8_t probeMapRoms[TEMP_PROBES_MAX][8] = TEMP_PROBE_ROMS;
+static RTC_DATA_ATTR uint8_t probeRoms[TEMP_PROBES_MAX][8];                                                      // ROM addresses found on the bus from the shallowest probe down, kept in RTC memory so the bus is only searched after a power-on or a probe failure
+static RTC_DATA_ATTR uint8_t probeSlots[TEMP_PROBES_MAX];                                                        // Index of each cached probe in TEMP_PROBE_DEPTHS_CM
+static RTC_DATA_ATTR uint8_t probeCount = 0;
+static RTC_DATA_ATTR bool probeRomsValid = false;
+
+static RTC_DATA_ATTR uint8_t tempResolution = TEMP_RESOLUTION_MAX;                                               // Bits chosen by selectTemperatureResolution() for this wake
+static RTC_DATA_ATTR float lastTemps[TEMP_PROBES_MAX];                                                           // Medians of the previous wake, to tell whether the readings are stable
+static RTC_DATA_ATTR bool lastTempsValid = false;
+static RTC_DATA_ATTR uint8_t stableWakes = 0;
+static RTC_DATA_ATTR uint32_t conv12Us = CONV_12BIT_US;                                                          // Measured 12-bit conversion time, the baseline the saved time is counted against
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// SETUP FUNCTIONS
+// ===========================================================================================================================================================
+// POSITION OF A PROBE IN TEMP_PROBE_ROMS, -1 IF IT IS NOT LISTED
+static int8_t mappedSlot(const uint8_t* rom) {
+  for (uint8_t i = 0; i < TEMP_PROBES_MAX; i++) {
+    if (memcmp(probeMapRoms[i], rom, 8) == 0) return i;
+  }
+  return -1;
+}
+
+// SEARCH THE BUS FOR DS18B20 PROBES AND CACHE THEIR ROM ADDRESSES
+static void searchProbes() {
+  uint8_t rom[8];
+  bool mapped = probeMapRoms[0][0] == DS18B20_FAMILY;                                                            // TEMP_PROBE_ROMS was filled in
+
+  probeCount = 0;
+  oneWireBus.reset_search();
+  while (probeCount < TEMP_PROBES_MAX && oneWireBus.search(rom)) {
+    if (OneWire::crc8(rom, 7) != rom[7] || rom[0] != DS18B20_FAMILY) continue;                                   // Corrupted search or not a DS18B20
+
+    int8_t slot = mapped ? mappedSlot(rom) : 0;
+    Debugf("DS18B20 {0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X}%s\n", rom[0], rom[1], rom[2], rom[3],
+           rom[4], rom[5], rom[6], rom[7], slot < 0 ? " is not in TEMP_PROBE_ROMS, ignored" : "");
+    if (slot < 0) continue;                                                                                      // Its depth is unknown, better no key than a wrong one
+
+    uint8_t pos = probeCount;                                                                                    // Insertion sort by depth, or by ROM without a map, whatever order the search finds them in
+    while (pos > 0 && (mapped ? probeSlots[pos - 1] > slot : memcmp(probeRoms[pos - 1], rom, sizeof(rom)) > 0)) {
+      memcpy(probeRoms[pos], probeRoms[pos - 1], sizeof(rom));
+      probeSlots[pos] = probeSlots[pos - 1];
+      pos--;
+    }
+    memcpy(probeRoms[pos], rom, sizeof(rom));
+    probeSlots[pos] = slot;
+    probeCount++;
+  }
+  for (uint8_t i = 0; !mapped && i < probeCount; i++) probeSlots[i] = i;
+
+  probeRomsValid = (probeCount > 0);
+  Debugf("%u DS18B20 probe(s) found on the bus\n", probeCount);
+}
+
+void initSensors() {
+  analogSetAttenuation(ADC_11db);                                                                                // Set the attenuation to -11 dB to go from 0V to 3V3 in the range of 0 to 4095
+}
+// SETUP FUNCTIONS END =======================================================================================================================================
+
+// ===========================================================================================================================================================
+// LOOP FUNCTIONS
+// ===========================================================================================================================================================
+// DIFFERENCE BETWEEN THE HIGHEST AND THE LOWEST OF "n" VALUES
+static float spread(const float* values, uint8_t n) {
+  float lo = values[0], hi = values[0];
+  for (uint8_t i = 1; i < n; i++) {
+    if (values[i] < lo) lo = values[i];
+    if (values[i] > hi) hi = values[i];
+  }
+  return hi - lo;
+}
+
+// SOIL TEMPERATURE FUNCTIONS --------------------------------------------------------------------------------------------------------------------------------
+static_assert(DEVICE_DISCONNECTED_C == FRAME_INVALID_TEMP, "A disconnected probe must read as an invalid temperature in the frame");
+
+// CHOOSE THE RESOLUTION FOR THIS WAKE: FULL NEAR THE REGION OF INTEREST, LOWEST WHEN STABLE OR ON A LOW BATTERY, DEFAULT OTHERWISE
+uint8_t selectTemperatureResolution(float batVolt) {
+  bool nearRoi = !lastTempsValid;                                                                                // Nothing known yet, start with full resolution
+
+  for (uint8_t i = 0; lastTempsValid && i < probeCount; i++) {
+    if (lastTemps[i] > TEMP_ROI_MIN_C - TEMP_ROI_MARGIN_C && lastTemps[i] < TEMP_ROI_MAX_C + TEMP_ROI_MARGIN_C) nearRoi = true;
+  }
+
+  if (nearRoi) tempResolution = TEMP_RESOLUTION_MAX;
+  else if (batVolt < TEMP_LOW_BATT_V || stableWakes >= TEMP_STABLE_WAKES) tempResolution = TEMP_RESOLUTION_MIN;
+  else tempResolution = TEMP_RESOLUTION_DEFAULT;
+
+  Debugf("DS18B20 resolution: %u bit (stable for %u wakes)\n", tempResolution, stableWakes);
+  return tempResolution;
+}
+
+// LOWEST RESOLUTION WHATEVER THE READINGS, FOR A BUTTON WAKE WHERE A QUICK ANSWER MATTERS MORE THAN THE LAST DIGIT
+uint8_t selectFastTemperatureResolution() {
+  tempResolution = TEMP_RESOLUTION_MIN;
+  Debugf("DS18B20 resolution: %u bit (button wake)\n", tempResolution);
+  return tempResolution;
+}
+
+// WRITE THE RESOLUTION TO EVERY PROBE AT ONCE (SKIP ROM). ONLY THE SCRATCHPAD, THE PROBES LOSE IT WHEN THEIR RAIL IS TURNED OFF
+static bool writeResolution(uint8_t bits) {
+  if (!oneWireBus.reset()) return false;
+  oneWireBus.skip();
+  oneWireBus.write(CMD_WRITE_SCRATCHPAD);
+  oneWireBus.write(0x4B);                                                                                        // TH and TL alarm registers, unused, power-on defaults
+  oneWireBus.write(0x46);
+  oneWireBus.write(((bits - 9) << 5) | 0x1F);                                                                    // Config register: R1 R0 in bits 6 and 5, the rest reads as ones
+  return true;
+}
+
+// REMEMBER THE MEDIANS OF THIS WAKE AND COUNT HOW MANY WAKES IN A ROW THEY BARELY MOVED
+static void updateStability(const float* temps, uint8_t probes) {
+  bool stable = lastTempsValid;
+
+  for (uint8_t i = 0; i < probes; i++) {
+    if (temps[i] == DEVICE_DISCONNECTED_C) {
+      lastTempsValid = false;                                                                                    // A failed probe says nothing about stability, back to full resolution
+      stableWakes = 0;
+      return;
+    }
+    if (fabsf(temps[i] - lastTemps[i]) >= TEMP_STABLE_DELTA_C) stable = false;
+    lastTemps[i] = temps[i];
+  }
+
+  lastTempsValid = (probes > 0);
+  stableWakes = stable ? (stableWakes < 255 ? stableWakes + 1 : 255) : 0;
+}
+
+// START ONE CONVERSION ON EVERY PROBE AT ONCE (SKIP ROM) AND WAIT UNTIL THE SLOWEST ONE IS DONE
+static bool convertAllProbes() {
+  if (!oneWireBus.reset()) return false;                                                                         // No presence pulse, nothing on the bus
+  oneWireBus.skip();
+  oneWireBus.write(CMD_CONVERT_T);
+
+  phaseStart(PHASE_TEMP_CONVERSION);
+  uint32_t start = millis();
+  while (!oneWireBus.read_bit()) {                                                                               // Probes hold the line low while converting
+    if (millis() - start > TEMP_CONVERSION_TIMEOUT_MS) {
+      phaseEnd(PHASE_TEMP_CONVERSION);
+      return false;
+    }
+    delay(1);
+  }
+  uint32_t elapsedUs = phaseEnd(PHASE_TEMP_CONVERSION);
+
+  if (tempResolution == TEMP_RESOLUTION_MAX) conv12Us = conv12Us - (conv12Us >> 3) + (elapsedUs >> 3);           // Same 1/8 running average as the phase timings
+  else if (conv12Us > elapsedUs) phaseSaved(PHASE_TEMP_CONVERSION, conv12Us - elapsedUs);
+  return true;
+}
+
+// READ THE LAST CONVERSION OF ONE PROBE BY ITS ROM ADDRESS
+static float readProbeC(const uint8_t* rom) {
+  uint8_t data[9];
+
+  if (!oneWireBus.reset()) return DEVICE_DISCONNECTED_C;
+  oneWireBus.select(rom);
+  oneWireBus.write(CMD_READ_SCRATCHPAD);
+  for (uint8_t i = 0; i < sizeof(data); i++) data[i] = oneWireBus.read();
+  if (OneWire::crc8(data, 8) != data[8]) return DEVICE_DISCONNECTED_C;                                           // Also catches a missing probe, which reads as all ones
+  if ((data[4] & 0x9F) != 0x1F) return DEVICE_DISCONNECTED_C;                                                    // Fixed bits of the config register, catches a bus stuck low (all zeros passes the CRC)
+
+  int16_t raw = (int16_t)((data[1] << 8) | data[0]);
+  switch (data[4] & 0x60) {                                                                                      // Low bits are undefined below 12-bit resolution
+    case 0x00: raw &= ~7; break;
+    case 0x20: raw &= ~3; break;
+    case 0x40: raw &= ~1; break;
+  }
+  return raw / 16.0f;
+}
+
+// READ TEMPERATURE FUNCTION: ONE CONVERSION FOR ALL THE PROBES, THEN EACH ONE IS READ BY ADDRESS
+static uint8_t readTemperaturesC(float* temps) {
+  bool converted = convertAllProbes();
+
+  for (uint8_t i = 0; i < probeCount; i++) {
+    temps[i] = converted ? readProbeC(probeRoms[i]) : DEVICE_DISCONNECTED_C;
+    if (temps[i] == DEVICE_DISCONNECTED_C) probeRomsValid = false;                                               // Search the bus again on the next boot
+  }
+  return probeCount;
+}
+
+// GET MEDIAN TEMPERATURE OF EVERY PROBE FROM "X" SAMPLES, RETURNS THE NUMBER OF PROBES WRITTEN TO "temps"
+// "spreads", IF NOT NULL, GETS THE DIFFERENCE BETWEEN THE HIGHEST AND LOWEST SAMPLE OF EACH PROBE
+uint8_t getMedianTemperaturesC(float* temps, uint8_t maxProbes, uint8_t samples, float* spreads) {
+  if (samples == 0) return 0;
+  if (!probeRomsValid) searchProbes();                                                                           // Only after a power-on or a failed probe, the search costs tens of ms per device
+
+  uint8_t probes = probeCount < maxProbes ? probeCount : maxProbes;
+  if (probes == 0) return 0;
+
+  float measurements[TEMP_PROBES_MAX][samples];                                                                  // One row of samples per probe
+  float sample[TEMP_PROBES_MAX];
+
+  writeResolution(tempResolution);                                                                               // Every time: the probes are powered up just before this call and come back at their EEPROM resolution
+  for (uint8_t i = 0; i < samples; i++) {
+    readTemperaturesC(sample);
+    for (uint8_t p = 0; p < probes; p++) measurements[p][i] = sample[p];
+    delay(10);                                                                                                   // Small delay between samples
+  }
+
+  for (uint8_t p = 0; p < probes; p++) {
+    if (spreads != NULL) spreads[p] = spread(measurements[p], samples);                                          // Before the median, which may reorder the samples
+    temps[p] = QuickMedian<float>::GetMedian(measurements[p], samples);
+  }
+  updateStability(temps, probes);
+  return probes;
+}
+
+uint8_t getProbeDepthCm(uint8_t probe) {
+  return probe < probeCount ? probeDepthsCm[probeSlots[probe]] : 0;
+}
+// SOIL TEMPERATURE FUNCTIONS END ----------------------------------------------------------------------------------------------------------------------------
+
+// SOIL MOISTURE FUNCTIONS -----------------------------------------------------------------------------------------------------------------------------------
+// ADAPTION OF MAP FUNCTION TO WORK WITH FLOATS
+static float fmap(float x, float in_min, float in_max, float out_min, float out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+// CONVERT A RAW READING TO A PERCENTAGE WITH THE CALIBRATION ABOVE
+static float soilMoisturePercent(float raw) {
+  float percent = fmap(raw, humedadAire, humedadAgua, 0.0f, 100.0f);
+  return constrain(percent, 0.0f, 100.0f);
+}
+
+// GET MEDIAN MOISTURE FROM "X" SAMPLES
+// "raw" AND "spreadRaw", IF NOT NULL, GET THE MEDIAN AND THE SPREAD OF THE ADC READINGS, WHICH THE CLAMPED PERCENTAGE HIDES
+float getMedianSoilMoisture(uint8_t samples, uint16_t* raw, uint16_t* spreadRaw) {
+  if (samples == 0) return 0.0;
+
+  float values[samples];
+
+  for (uint8_t i = 0; i < samples; i++) {
+    values[i] = analogRead(SOIL_MOIST_PIN);
+    delay(10);
+  }
+
+  if (spreadRaw != NULL) *spreadRaw = (uint16_t)spread(values, samples);
+  float median = QuickMedian<float>::GetMedian(values, samples);
+  if (raw != NULL) *raw = (uint16_t)median;
+  return soilMoisturePercent(median);                                                                            // Median of the readings, then calibrated: the same result as calibrating each one, the mapping is monotonic
+}
+// SOIL MOISTURE FUNCTIONS END -------------------------------------------------------------------------------------------------------------------------------
 // LOOP FUNCTIONS END ========================================================================================================================================
\ No newline at end of file
@@ -1,11 +1,54 @@
-#include <Arduino.h>    
-#include <esp_sleep.h>
-
-void sleep_interrupt(gpio_num_t gpio, uint8_t mode) {
-    esp_sleep_enable_ext0_wakeup(gpio, mode);
-}
-
-void sleep_seconds(uint64_t seconds) {
-    esp_sleep_enable_timer_wakeup(seconds * 1000000ULL);
-    esp_deep_sleep_start();
-}
\ No newline at end of file
+#include <Arduino.h>    
+#include <esp_sleep.h>
+#include <soc/rtc.h>
+#include <esp32/clk.h>
+#include "sleepUtils.h"
+
+#define SLEEP_CAL_CYCLES 1024                                                                                    // Slow clock cycles measured against the crystal before each sleep, ~7 ms with the 150 kHz RC oscillator
+#define SLEEP_MIN_TICKS 300                                                                                      // ~2 ms with the RC oscillator: a slot closer than this is skipped, it would be over before the sleep starts
+
+static RTC_DATA_ATTR uint64_t periodNextTicks = 0;                                                               // RTC time of the next timer wake on the grid of "sleep_period()", 0 until the first sleep
+static RTC_DATA_ATTR uint8_t periodSlots = 1;                                                                    // Slots between the previous target and "periodNextTicks", more than 1 after a stretched sleep
+static RTC_DATA_ATTR uint8_t skipSlots = 0;                                                                      // Slots the next timer sleep passes over, set by "sleep_skip_slots()"
+
+void sleep_interrupt(gpio_num_t gpio, uint8_t mode) {
+    esp_sleep_enable_ext0_wakeup(gpio, mode);
+}
+
+// SLEEP UNTIL THE NEXT SLOT OF A FIXED GRID OF "seconds". THE SLOTS ARE KEPT IN RTC TICKS, WHICH COUNT THROUGH DEEP SLEEP, SO THE AWAKE TIME DOES NOT ADD
+// UP INTO THE PERIOD: A TIMER WAKE GOES TO THE NEXT SLOT, A BUTTON WAKE BACK TO THE SLOT IT INTERRUPTED AND AN OVERRUN SKIPS THE SLOTS IT MISSED
+// AFTER A TIMER WAKE, "sleep_skip_slots()" STRETCHES THE SLEEP OVER THAT MANY MORE SLOTS, STILL ON THE GRID
+void sleep_period(uint64_t seconds) {
+    uint32_t cal = rtc_clk_cal(RTC_CAL_RTC_MUX, SLEEP_CAL_CYCLES);                                               // The RC oscillator drifts with temperature, a calibration from the boot could be minutes old
+    if (cal != 0) esp_clk_slowclk_cal_set(cal);                                                                  // Also moves the checkpoint of the RTC time, so "gettimeofday()" stays continuous
+    else cal = esp_clk_slowclk_cal_get();
+
+    uint64_t periodTicks = ((seconds * 1000000ULL) << RTC_CLK_CAL_FRACT) / cal;                                  // Same conversion as "rtc_time_us_to_slowclk()"
+    uint64_t now = rtc_time_get();
+    if (periodNextTicks == 0 || periodNextTicks > now + periodSlots * periodTicks) periodNextTicks = now;        // First sleep after a power-on, or an RTC counter that restarted under the slot
+    if (periodNextTicks < now + SLEEP_MIN_TICKS) {                                                               // The target passed: a timer wake or an overrun, not a button wake
+        periodSlots = 1 + skipSlots;
+        periodNextTicks += ((now + SLEEP_MIN_TICKS - periodNextTicks) / periodTicks + periodSlots) * periodTicks;
+    }
+
+    esp_sleep_enable_timer_wakeup(rtc_time_slowclk_to_us(periodNextTicks - now, cal));                           // From the same "now" as the check above, so it cannot wrap around
+    esp_deep_sleep_start();
+}
+
+// HOW LATE THIS BOOT IS AGAINST ITS SLOT, ROM AND BOOTLOADER TIME INCLUDED. ONLY MEANINGFUL ON A TIMER WAKE, 0 BEFORE THE FIRST SLEEP
+int32_t sleep_wake_lag_ms() {
+    if (periodNextTicks == 0) return 0;
+    int64_t lagTicks = (int64_t)(rtc_time_get() - periodNextTicks);
+    int64_t lagUs = (lagTicks * (int64_t)esp_clk_slowclk_cal_get()) / (1LL << RTC_CLK_CAL_FRACT);
+    return (int32_t)(lagUs / 1000);
+}
+
+// TRUE WHEN THIS BOOT COMES FROM THE EXT0 PIN ARMED BY "sleep_interrupt()", I.E. THE BUTTON, AND NOT FROM THE TIMER
+bool sleep_button_wake() {
+    return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0;
+}
+
+// PASS OVER "slots" SLOTS OF THE GRID ON THE NEXT TIMER SLEEP, 0 TO WAKE ON THE NEXT ONE
+void sleep_skip_slots(uint8_t slots) {
+    skipSlots = slots;
+}
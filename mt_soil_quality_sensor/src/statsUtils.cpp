@@ -0,0 +1,59 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <math.h>
+#include "statsUtils.h"                                                                                          // Plain C++ on purpose: the aggregates are also built and tested on the host
+#include "rtcMemory.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+static RTC_DATA_ATTR RunningStats tempStats;                                                                     // Reporting window of "soilTemp", kept in RTC memory until a sample is delivered
+static RTC_DATA_ATTR RunningStats moistStats;                                                                    // Same for "soilMoist"
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// RUNNING STATISTICS
+// ===========================================================================================================================================================
+void statsReset(RunningStats& stats) {
+  stats = {};
+}
+
+// WELFORD UPDATE, NUMERICALLY STABLE EVEN WITH FLOATS AND MANY CLOSE VALUES
+void statsAdd(RunningStats& stats, float value) {
+  if (stats.count == UINT16_MAX) return;                                                                         // Saturated, the window is long enough to be representative anyway
+  if (stats.count == 0 || value < stats.min) stats.min = value;
+  if (stats.count == 0 || value > stats.max) stats.max = value;
+
+  stats.count++;
+  float delta = value - stats.mean;
+  stats.mean += delta / stats.count;
+  stats.m2 += delta * (value - stats.mean);
+}
+
+// SAMPLE STANDARD DEVIATION (N - 1), 0 FOR A SINGLE SAMPLE
+WindowSummary statsSummary(const RunningStats& stats) {
+  float variance = (stats.count > 1) ? stats.m2 / (stats.count - 1) : 0.0f;
+  return {stats.count, stats.mean, sqrtf(variance > 0.0f ? variance : 0.0f), stats.min, stats.max};
+}
+// RUNNING STATISTICS END ====================================================================================================================================
+
+// ===========================================================================================================================================================
+// REPORTING WINDOW
+// ===========================================================================================================================================================
+// ADD THE VALID VALUES OF A FRESH SAMPLE TO THE WINDOW AND COPY THE WINDOW AGGREGATES INTO THE FRAME
+void windowAddSample(SampleFrame& frame) {
+  if (frame.soilTemp != FRAME_INVALID_TEMP) statsAdd(tempStats, frame.soilTemp);
+  if (!(frame.flags & FRAME_FAULT_MOIST)) statsAdd(moistStats, frame.soilMoist);
+
+  frame.tempWindow = statsSummary(tempStats);
+  frame.moistWindow = statsSummary(moistStats);
+}
+
+// START A NEW WINDOW, ONCE THE AGGREGATES HAVE BEEN DELIVERED
+void windowReset() {
+  statsReset(tempStats);
+  statsReset(moistStats);
+}
+// REPORTING WINDOW END ======================================================================================================================================
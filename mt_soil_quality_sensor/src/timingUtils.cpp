@@ -0,0 +1,56 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
+#include "timingUtils.h"
+#include "macros.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+static const char* const phaseNames[PHASE_COUNT] = {"tlsFull", "tlsPinned", "tlsBundle", "tlsPsk", "mqttConnect", "tempConversion"};
+
+static uint32_t phaseStartUs[PHASE_COUNT];
+static uint32_t phaseTimeUs[PHASE_COUNT];                                                                        // Time spent in each phase during the current wake, 0 if the phase did not run
+static uint32_t phaseSavedUs[PHASE_COUNT];                                                                       // Time an optimisation avoided in each phase during the current wake, as estimated by its caller
+static RTC_DATA_ATTR uint32_t phaseAvgUs[PHASE_COUNT];                                                           // Running average across wakes, kept in RTC memory so it survives deep sleep
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// TIMING FUNCTIONS
+// ===========================================================================================================================================================
+// START A PHASE
+void phaseStart(TimingPhase phase) {
+  phaseStartUs[phase] = micros();
+}
+
+// END A PHASE, RETURNING ITS DURATION IN MICROSECONDS
+uint32_t phaseEnd(TimingPhase phase) {
+  uint32_t elapsed = micros() - phaseStartUs[phase];                                                             // Unsigned arithmetic keeps this right across a micros() rollover
+  phaseTimeUs[phase] += elapsed;                                                                                 // A phase may run more than once per wake (retries), so the time is accumulated
+
+  if (phaseAvgUs[phase] == 0) phaseAvgUs[phase] = elapsed;                                                       // First sample seeds the average
+  else phaseAvgUs[phase] = phaseAvgUs[phase] - (phaseAvgUs[phase] >> 3) + (elapsed >> 3);                        // Exponential moving average with alpha = 1/8, integer only
+
+  return elapsed;
+}
+
+// RECORD TIME A PHASE DID NOT HAVE TO SPEND, E.G. A LOWER RESOLUTION CONVERSION AGAINST A FULL ONE
+void phaseSaved(TimingPhase phase, uint32_t savedUs) {
+  phaseSavedUs[phase] += savedUs;
+}
+
+// PRINT THE PHASES THAT RAN DURING THIS WAKE
+void printPhaseTimings(SemaphoreHandle_t serialSemaphore) {
+  if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+    for (uint8_t i = 0; i < PHASE_COUNT; i++) {
+      if (phaseTimeUs[i] == 0) continue;
+      Debugf("[timing] %s: %lu us (avg %lu us", phaseNames[i], (unsigned long)phaseTimeUs[i], (unsigned long)phaseAvgUs[i]);
+      if (phaseSavedUs[i] > 0) Debugf(", saved %lu us", (unsigned long)phaseSavedUs[i]);
+      Debugln(F(")"));
+    }
+    xSemaphoreGive(serialSemaphore);
+  }
+}
+// TIMING FUNCTIONS END ======================================================================================================================================
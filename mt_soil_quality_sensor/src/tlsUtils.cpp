@@ -0,0 +1,179 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
+#include <WiFiClientSecure.h>
+#include <mbedtls/x509.h>
+#include "tlsUtils.h"
+#include "timingUtils.h"
+#include "macros.h"
+#include "credentialUtils.h"
+#include "caBundle.h"                                                                                            // Generated from ROOT_CA by scripts/gen_ca_bundle.py before every build
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+static WiFiClientSecure* tlsClient = NULL;
+static const char* tlsRootCa = NULL;
+static const char* tlsHost = NULL;
+static uint16_t tlsPort = 0;
+static bool tlsPsk = false;
+
+static RTC_DATA_ATTR bool pinValid = false;                                                                      // Set once a full chain validation succeeded and its fingerprint was cached
+static RTC_DATA_ATTR uint32_t pinnedHost = 0;                                                                    // Hash of the broker the pin belongs to, brokers can change from one wake to the next
+static RTC_DATA_ATTR uint8_t pinnedFingerprint[32];                                                              // SHA-256 of the broker leaf certificate, survives deep sleep but not power-off
+static RTC_DATA_ATTR uint32_t pinnedWakes = 0;                                                                   // Pinned handshakes since the last full chain validation
+static RTC_DATA_ATTR bool bundleFailed = false;                                                                  // The broker chain could not be validated with CA_BUNDLE, so only the PEM is used until power-off
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// SETUP FUNCTIONS
+// ===========================================================================================================================================================
+void setupTLS(WiFiClientSecure& clientSecure, const char* rootCa, const char* host, const uint16_t port, const bool psk) {
+  tlsClient = &clientSecure;
+  tlsRootCa = rootCa;
+  tlsHost = host;
+  tlsPort = port;
+  tlsPsk = psk;
+  tlsClient->setTimeout(BROKER_CONNECT_TIMEOUT_S);                                                               // Seconds, for the TCP connect
+  tlsClient->setHandshakeTimeout(BROKER_CONNECT_TIMEOUT_S);                                                      // The default 120 s would outlast any awake-time budget
+}
+// SETUP FUNCTIONS END =======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// FNV-1A, ONLY TO TELL WHETHER THE PIN WAS TAKEN FROM THIS HOST
+static uint32_t hostHash(const char* host) {
+  uint32_t hash = 2166136261UL;
+  while (*host) hash = (hash ^ (uint8_t)*host++) * 16777619UL;
+  return hash;
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// CONNECTION FUNCTIONS
+// ===========================================================================================================================================================
+// PINNED HANDSHAKE: SKIP THE CHAIN VALIDATION AND COMPARE THE LEAF FINGERPRINT WITH THE CACHED ONE
+static bool connectPinned(SemaphoreHandle_t serialSemaphore) {
+  uint8_t fingerprint[32];
+
+  tlsClient->setInsecure();                                                                                      // No chain validation, the fingerprint check below replaces it
+  phaseStart(PHASE_TLS_PINNED);
+  bool connected = tlsClient->connect(tlsHost, tlsPort);
+  uint32_t elapsed = phaseEnd(PHASE_TLS_PINNED);
+
+  if (!connected) return false;
+
+  if (!tlsClient->getFingerprintSHA256(fingerprint) || memcmp(fingerprint, pinnedFingerprint, sizeof(fingerprint)) != 0) {
+    tlsClient->stop();                                                                                           // Never send the access token to a peer that does not match the pin
+    pinValid = false;                                                                                            // Certificate rotated (or worse): drop the pin so the full validation runs right away
+    if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+      Debugln(F("TLS fingerprint mismatch, falling back to full chain validation"));
+      xSemaphoreGive(serialSemaphore);
+    }
+    return false;
+  }
+
+  pinnedWakes++;
+  if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+    Debugf("TLS pinned handshake: %lu us\n", (unsigned long)elapsed);
+    xSemaphoreGive(serialSemaphore);
+  }
+  return true;
+}
+
+// CHAIN VALIDATION AGAINST CA_BUNDLE: ONLY THE SUBJECT AND THE PUBLIC KEY OF THE ROOT ARE LOOKED UP, NOTHING IS PARSED
+static bool connectBundle(uint32_t& elapsed) {
+  tlsClient->setCACert(NULL);                                                                                    // Clears the insecure mode the pinned path may have left
+  tlsClient->setCACertBundle(CA_BUNDLE);
+  phaseStart(PHASE_TLS_BUNDLE);
+  bool connected = tlsClient->connect(tlsHost, tlsPort);
+  elapsed = phaseEnd(PHASE_TLS_BUNDLE);
+
+  if (!connected) {
+    char error[64];
+    if (tlsClient->lastError(error, sizeof(error)) == MBEDTLS_ERR_X509_CERT_VERIFY_FAILED) bundleFailed = true;  // The lookup failed, not the network (e.g. a cross-signed root at the top of the chain)
+  }
+  return connected;
+}
+
+// CHAIN VALIDATION AGAINST ROOT_CA: THE PEM IS BASE64-DECODED AND X.509-PARSED DURING THE HANDSHAKE
+static bool connectPem(uint32_t& elapsed) {
+  tlsClient->setCACertBundle(NULL);
+  tlsClient->setCACert(tlsRootCa);
+  phaseStart(PHASE_TLS_FULL);
+  bool connected = tlsClient->connect(tlsHost, tlsPort);
+  elapsed = phaseEnd(PHASE_TLS_FULL);
+  return connected;
+}
+
+// FULL HANDSHAKE: VALIDATE THE WHOLE CHAIN, PREPARSED ROOT FIRST AND PEM AS FALLBACK, AND CACHE THE LEAF FINGERPRINT
+static bool connectFull(SemaphoreHandle_t serialSemaphore) {
+  uint32_t elapsed = 0;
+  bool connected = false;
+
+  #if TLS_CA_BUNDLE
+    if (!bundleFailed) connected = connectBundle(elapsed);
+  #endif
+  if (!connected) connected = connectPem(elapsed);
+
+  if (!connected) return false;
+
+  #if TLS_PINNING
+    if (tlsClient->getFingerprintSHA256(pinnedFingerprint)) {                                                    // The chain is trusted now, so its leaf is safe to pin
+      pinValid = true;
+      pinnedHost = hostHash(tlsHost);
+      pinnedWakes = 0;
+    }
+  #endif
+
+  if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+    Debugf("TLS full handshake: %lu us\n", (unsigned long)elapsed);
+    xSemaphoreGive(serialSemaphore);
+  }
+  return true;
+}
+
+// PSK HANDSHAKE: BOTH ENDS PROVE THEY HOLD THE SAME KEY FROM NVS, SYMMETRIC CRYPTO ONLY
+static bool connectPsk(SemaphoreHandle_t serialSemaphore) {
+  tlsClient->setCACert(NULL);                                                                                    // WiFiClientSecure only uses the PSK when neither a CA, a bundle nor the insecure mode is set
+  tlsClient->setCACertBundle(NULL);
+  tlsClient->setPreSharedKey(getPskIdentity(), getPskKey());
+  phaseStart(PHASE_TLS_PSK);
+  bool connected = tlsClient->connect(tlsHost, tlsPort);
+  uint32_t elapsed = phaseEnd(PHASE_TLS_PSK);
+
+  if (!connected) return false;
+
+  if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+    Debugf("TLS-PSK handshake: %lu us\n", (unsigned long)elapsed);
+    xSemaphoreGive(serialSemaphore);
+  }
+  return true;
+}
+
+// OPEN THE TLS SESSION TO THE BROKER, SO THAT "PubSubClient" ONLY HAS TO SEND THE CONNECT PACKET
+bool connectTLS(SemaphoreHandle_t serialSemaphore) {
+  if (tlsClient == NULL) return false;
+  if (tlsClient->connected()) return true;
+
+  if (tlsPsk) {                                                                                                  // Local broker: PSK first, certificates on the same port if its handshake fails
+    if (pskAvailable() && connectPsk(serialSemaphore)) return true;
+    tlsClient->setPreSharedKey(NULL, NULL);
+    if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+      Debugln(F("TLS-PSK handshake failed, falling back to certificate TLS"));
+      xSemaphoreGive(serialSemaphore);
+    }
+  }
+
+  #if TLS_PINNING
+    if (pinValid && pinnedHost == hostHash(tlsHost) && pinnedWakes < TLS_PIN_MAX_WAKES) {                        // Fast path while the pin is fresh enough
+      if (connectPinned(serialSemaphore)) return true;
+    }
+  #endif
+
+  return connectFull(serialSemaphore);
+}
+// CONNECTION FUNCTIONS END ==================================================================================================================================
@@ -0,0 +1,90 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <string.h>
+#include "uplinkUtils.h"                                                                                         // Plain C++ on purpose: the policy and the simulated uplink have to build on the host
+#include "macros.h"
+#include "rtcMemory.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+static RTC_DATA_ATTR uint8_t uplinkFailures[MAX_UPLINKS];                                                        // Consecutive failed cycles per uplink slot, survives deep sleep
+static RTC_DATA_ATTR uint8_t uplinkSkipped[MAX_UPLINKS];                                                         // Cycles an unhealthy uplink has been skipped since its last try
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// SIMULATED UPLINK
+// ===========================================================================================================================================================
+bool SimUplink::send(const SampleFrame& frame) {
+  attempts++;
+  if (!up || !delivers) return false;
+  last = frame;
+  sent++;
+  return true;
+}
+// SIMULATED UPLINK END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// POLICY FUNCTIONS
+// ===========================================================================================================================================================
+// AN UPLINK THAT FAILED TOO MANY TIMES IN A ROW IS ONLY PROBED AGAIN EVERY "UPLINK_RETRY_CYCLES"
+static bool healthy(uint8_t index) {
+  if (uplinkFailures[index] < UPLINK_MAX_FAILURES) return true;
+  return uplinkSkipped[index] >= UPLINK_RETRY_CYCLES;
+}
+
+// PICK THE AVAILABLE AND HEALTHY UPLINK WITH THE LOWEST ESTIMATED ENERGY FOR THIS FRAME, WITHIN THE LATENCY BOUND
+Uplink* selectUplink(Uplink* const* uplinks, uint8_t count, const SampleFrame& frame, uint32_t maxLatencyMs) {
+  Uplink* best = NULL;
+  float bestUj = 0.0f;
+
+  for (uint8_t i = 0; i < count && i < MAX_UPLINKS; i++) {
+    Uplink* u = uplinks[i];
+    if (u == NULL || !healthy(i) || u->cost().latencyMs > maxLatencyMs || !u->available()) continue;
+
+    float uj = u->estimateUj(frame);
+    if (best == NULL || uj < bestUj || (uj == bestUj && u->cost().latencyMs < best->cost().latencyMs)) {         // Ties go to the faster link
+      best = u;
+      bestUj = uj;
+    }
+  }
+  return best;
+}
+
+// SEND THE FRAME THROUGH THE CHEAPEST UPLINK, FALLING BACK TO THE NEXT CHEAPEST ONES ON FAILURE. RETURNS THE UPLINK USED OR NULL
+Uplink* sendWithPolicy(Uplink* const* uplinks, uint8_t count, const SampleFrame& frame, uint32_t maxLatencyMs) {
+  Uplink* candidates[MAX_UPLINKS];
+  uint8_t n = count < MAX_UPLINKS ? count : MAX_UPLINKS;
+
+  for (uint8_t i = 0; i < n; i++) {
+    candidates[i] = uplinks[i];
+    if (uplinks[i] != NULL && !healthy(i)) uplinkSkipped[i]++;                                                   // Count the cycle towards the next probe
+  }
+
+  for (uint8_t tries = 0; tries < n; tries++) {
+    Uplink* u = selectUplink(candidates, n, frame, maxLatencyMs);
+    if (u == NULL) return NULL;
+
+    uint8_t index = 0;
+    while (candidates[index] != u) index++;
+
+    bool ok = u->send(frame);
+    uplinkSkipped[index] = 0;
+    if (ok) {
+      uplinkFailures[index] = 0;
+      return u;
+    }
+
+    if (uplinkFailures[index] < 255) uplinkFailures[index]++;
+    candidates[index] = NULL;                                                                                    // Not again this cycle, try the next cheapest one
+  }
+  return NULL;
+}
+
+void resetUplinkHealth() {
+  memset(uplinkFailures, 0, sizeof(uplinkFailures));
+  memset(uplinkSkipped, 0, sizeof(uplinkSkipped));
+}
+// POLICY FUNCTIONS END ======================================================================================================================================
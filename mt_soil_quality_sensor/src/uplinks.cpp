@@ -0,0 +1,244 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
+#include <WiFi.h>
+#include <SPI.h>
+#include <LoRa.h>                                                                                                // Library for the SX1276 LoRa transceiver
+#include "uplinks.h"
+#include "mqttUtils.h"
+#include "espNowUtils.h"
+#include "mqttSnUtils.h"
+#include "downlinkUtils.h"
+#include "wifiUtils.h"
+#include "clockUtils.h"
+#include "outboxUtils.h"
+#include "macros.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// BOUNDED BY UPLINK_WIFI_TIMEOUT_MS, SHORTER THAN THE AWAKE BUDGET OF "connectToWiFi()", SO OTHER UPLINKS STILL GET THEIR TURN
+static bool joinWiFi(const char* ssid, const char* password) {
+  if (WiFi.status() == WL_CONNECTED) return true;
+
+  WiFi.mode(WIFI_STA);
+  beginWiFi(ssid, password);
+  uint32_t start = millis();
+  while (!pollWiFi(ssid, password, start)) {
+    if (millis() - start > UPLINK_WIFI_TIMEOUT_MS) {
+      WiFi.disconnect();                                                                                         // Stop the association attempt, or it keeps hopping channels under the ESP-NOW uplink tried next
+      return false;
+    }
+    delay(50);
+  }
+  if (clockShouldSync()) clockSync();                                                                            // Whichever Wi-Fi uplink joins first keeps the clock of the node in time
+  return true;
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// MQTT UPLINK
+// ===========================================================================================================================================================
+MqttUplink::MqttUplink(PubSubClient& client, const char* ssid, const char* password, const char* clientId, const char* token, SemaphoreHandle_t serialSemaphore)
+  : mqttClient(client), wifiSsid(ssid), wifiPassword(password), mqttClientId(clientId), mqttToken(token), semaphore(serialSemaphore) {}
+
+UplinkCost MqttUplink::cost() const {
+  return {COST_MQTT_CONNECT_UJ, COST_MQTT_BYTE_UJ, COST_MQTT_LATENCY_MS};
+}
+
+size_t MqttUplink::payloadSize(const SampleFrame& frame) const {
+  return formatTelemetryJson(NULL, 0, frame) + sizeof(MQTT_TOPIC_PUB);                                           // JSON plus topic, the MQTT header is negligible
+}
+
+bool MqttUplink::available() {
+  return wifiSsid != NULL && wifiSsid[0] != '\0';                                                                // Nothing cheaper to check without bringing Wi-Fi up
+}
+
+bool MqttUplink::send(const SampleFrame& frame) {
+  if (!joinWiFi(wifiSsid, wifiPassword)) return false;
+
+  if (!mqttClient.connected() && !connectToBroker(mqttClient, mqttClientId, mqttToken, BROKER_AWAKE_BUDGET_MS, semaphore)) return false;
+
+  if (!outboxSendLive(mqttClient, frame, semaphore)) return false;                                               // Alarms and this sample before anything else on the connection
+  publishAttributes(mqttClient, frame, semaphore);                                                               // Not worth failing the sample over, they are sent again on the next wake
+  downlinkAfterPublish(mqttClient, semaphore);                                                                   // Only this uplink can receive, so the window counts its own publications
+  outboxDrainBacklog(mqttClient, frame, semaphore);                                                              // Missed samples last, with whatever is left of the awake budget
+  return true;
+}
+
+// ONLY THIS UPLINK CAN REPLAY THE BACKLOG, SO IT IS BROUGHT UP FOR IT WHEN THE SAMPLE WENT OUT THROUGH ANOTHER ONE. BOUNDED BY OUTBOX_AWAKE_BUDGET_MS
+uint16_t MqttUplink::drainBacklog(const SampleFrame& frame) {
+  if (millis() + COST_MQTT_LATENCY_MS > OUTBOX_AWAKE_BUDGET_MS) return 0;                                        // Not even the connection would fit in what is left
+  if (!joinWiFi(wifiSsid, wifiPassword)) return 0;
+  if (!mqttClient.connected() && !connectToBroker(mqttClient, mqttClientId, mqttToken, BROKER_AWAKE_BUDGET_MS, semaphore)) return 0;
+  return outboxDrainBacklog(mqttClient, frame, semaphore);
+}
+
+void MqttUplink::end() {
+  mqttClient.disconnect();
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+}
+// MQTT UPLINK END ===========================================================================================================================================
+
+// ===========================================================================================================================================================
+// MQTT-SN UPLINK
+// ===========================================================================================================================================================
+UplinkCost MqttSnUplink::cost() const {
+  return {COST_MQTTSN_CONNECT_UJ, COST_MQTTSN_BYTE_UJ, COST_MQTTSN_LATENCY_MS};
+}
+
+size_t MqttSnUplink::payloadSize(const SampleFrame& frame) const {
+  size_t len = MQTTSN_PUBLISH_OVERHEAD + frameLength(frame);
+  if (MQTTSN_QOS == 1) len += 6 + strlen(snClientId) + 3 + 7;                                                    // CONNECT, CONNACK and PUBACK
+  return len;
+}
+
+bool MqttSnUplink::available() {
+  return MQTTSN_UPLINK && wifiSsid != NULL && wifiSsid[0] != '\0';                                               // Only offered where a gateway has been deployed, like raw LoRa
+}
+
+// SEND "msg" AND WAIT FOR A REPLY OF "replyType", RESENDING ON TIMEOUT. UDP MAY LOSE EITHER DATAGRAM
+bool MqttSnUplink::exchange(const uint8_t* msg, size_t len, uint8_t replyType, uint8_t* reply, size_t* replyLen) {
+  size_t capacity = *replyLen;
+
+  for (uint8_t attempt = 0; attempt < MQTTSN_RETRIES; attempt++) {
+    udp.beginPacket(MQTTSN_GATEWAY, MQTTSN_PORT);
+    udp.write(msg, len);
+    if (!udp.endPacket()) continue;
+
+    uint32_t start = millis();
+    while (millis() - start < MQTTSN_ACK_TIMEOUT_MS) {
+      if (udp.parsePacket() <= 0) {
+        delay(5);
+        continue;
+      }
+      int read = udp.read(reply, capacity);
+      uint8_t type;
+      if (read > 0 && mqttSnParse(reply, read, &type) != 0 && type == replyType) {                               // Anything else, e.g. a late reply to an earlier attempt, is skipped
+        *replyLen = read;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool MqttSnUplink::send(const SampleFrame& frame) {
+  uint8_t data[FRAME_MAX_LEN];
+  uint8_t msg[MQTTSN_PUBLISH_OVERHEAD + FRAME_MAX_LEN];
+  uint8_t reply[16];
+  size_t replyLen = sizeof(reply);
+  size_t dataLen, len;
+  uint16_t msgId = (uint16_t)(frame.bootCnt % 0xFFFF) + 1;                                                       // Never 0, and the same on every retry so the gateway can drop duplicates
+
+  if (!joinWiFi(wifiSsid, wifiPassword)) return false;
+  if (!ready) ready = udp.begin(0) == 1;                                                                         // Any local port, the gateway replies to the one the datagram came from
+  if (!ready) return false;
+
+  dataLen = encodeFrame(frame, data, sizeof(data));
+  if (dataLen == 0) return false;
+
+  if (MQTTSN_QOS != 1) {                                                                                         // QoS -1: a single datagram and no connection, delivery is best effort
+    len = mqttSnPublish(msg, sizeof(msg), MQTTSN_FLAG_QOS_M1 | MQTTSN_FLAG_TOPIC_PREDEFINED, MQTTSN_TOPIC_ID, 0, data, dataLen);
+    udp.beginPacket(MQTTSN_GATEWAY, MQTTSN_PORT);
+    udp.write(msg, len);
+    return udp.endPacket() == 1;
+  }
+
+  len = mqttSnConnect(msg, sizeof(msg), snClientId, (uint16_t)(SLEEP_DURATION_S * 2));
+  if (len == 0 || !exchange(msg, len, MQTTSN_CONNACK, reply, &replyLen)) return false;
+  if (reply[2] != MQTTSN_RC_ACCEPTED) return false;
+
+  uint16_t topicId, ackId;
+  uint8_t returnCode;
+  replyLen = sizeof(reply);
+  len = mqttSnPublish(msg, sizeof(msg), MQTTSN_FLAG_QOS_1 | MQTTSN_FLAG_TOPIC_PREDEFINED, MQTTSN_TOPIC_ID, msgId, data, dataLen);
+  if (!exchange(msg, len, MQTTSN_PUBACK, reply, &replyLen)) return false;
+  if (!mqttSnParsePuback(reply, replyLen, &topicId, &ackId, &returnCode)) return false;
+  if (ackId != msgId || returnCode != MQTTSN_RC_ACCEPTED) return false;
+
+  len = mqttSnDisconnect(msg, sizeof(msg));                                                                      // Not waited for, the gateway drops the session on its own after the keep-alive
+  udp.beginPacket(MQTTSN_GATEWAY, MQTTSN_PORT);
+  udp.write(msg, len);
+  udp.endPacket();
+  return true;
+}
+
+void MqttSnUplink::end() {
+  if (ready) {
+    udp.stop();
+    ready = false;
+  }
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+}
+// MQTT-SN UPLINK END ========================================================================================================================================
+
+// ===========================================================================================================================================================
+// ESP-NOW UPLINK
+// ===========================================================================================================================================================
+UplinkCost EspNowUplink::cost() const {
+  return {COST_ESPNOW_CONNECT_UJ, COST_ESPNOW_BYTE_UJ, COST_ESPNOW_LATENCY_MS};
+}
+
+bool EspNowUplink::available() {
+  static const uint8_t broadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  return memcmp(gatewayMac, broadcast, sizeof(broadcast)) != 0;                                                  // A broadcast is never ACKed, so the policy could not tell a dead gateway apart
+}
+
+bool EspNowUplink::send(const SampleFrame& frame) {
+  if (!ready) ready = setupEspNow(espNowChannel, gatewayMac);
+  return ready && sendSampleFrame(gatewayMac, frame);
+}
+// ESP-NOW UPLINK END ========================================================================================================================================
+
+// ===========================================================================================================================================================
+// LORA UPLINK
+// ===========================================================================================================================================================
+UplinkCost LoraUplink::cost() const {
+  return {COST_LORA_CONNECT_UJ, COST_LORA_BYTE_UJ, COST_LORA_LATENCY_MS};
+}
+
+bool LoraUplink::available() {
+  return LORA_UPLINK;                                                                                            // Raw LoRa has no ACK either, so it is only offered where a receiver has been deployed
+}
+
+bool LoraUplink::send(const SampleFrame& frame) {
+  uint8_t buf[FRAME_MAX_LEN];
+  size_t len;
+
+  if (!ready) {
+    pmu.setPowerOutPut(AXP192_LDO2, AXP202_ON);                                                                  // "setupPower()" leaves the radio off, it is only powered for this
+    delay(10);                                                                                                   // Let the supply settle before talking to the SX1276
+    SPI.begin(LORA_SCK_PIN, LORA_MISO_PIN, LORA_MOSI_PIN, LORA_CS_PIN);
+    LoRa.setPins(LORA_CS_PIN, LORA_RST_PIN, LORA_DIO0_PIN);
+    if (!LoRa.begin(LORA_FREQUENCY)) {
+      pmu.setPowerOutPut(AXP192_LDO2, AXP202_OFF);
+      return false;
+    }
+    LoRa.setSpreadingFactor(LORA_SPREADING_FACTOR);
+    LoRa.setTxPower(LORA_TX_POWER);
+    LoRa.setSyncWord(LORA_SYNC_WORD);
+    LoRa.enableCrc();
+    ready = true;
+  }
+
+  len = encodeFrame(frame, buf, sizeof(buf));
+  if (len == 0) return false;
+  LoRa.beginPacket();
+  LoRa.write(buf, len);
+  return LoRa.endPacket() == 1;                                                                                  // Blocking until TX done. There is no ACK, delivery is best effort
+}
+
+void LoraUplink::end() {
+  if (ready) {
+    LoRa.sleep();
+    LoRa.end();
+    ready = false;
+  }
+  pmu.setPowerOutPut(AXP192_LDO2, AXP202_OFF);
+}
+// LORA UPLINK END ===========================================================================================================================================
@@ -1,84 +1,125 @@
-#include <Arduino.h>
-#include <WiFi.h>                                                                                                // Library to connect to Wi-Fi
-#include <axp20x.h>
-#include "wifiUtils.h"
-#include "macros.h"
-
-// Connect to Wi-Fi during setup ---------------------------------------------------------------------------------------------------------------------------
-void connectToWiFi(bool stateLED, AXP20X_Class& axp192, const char* ssid, const char* password, const uint8_t ledPin, const uint8_t pmuIRQPin) {
-  pinMode(ledPin, OUTPUT);
-  digitalWrite(ledPin, stateLED);
-  
-  Debug(F("Connecting to WIFI SSID "));
-  Debugln(ssid);
-
-  WiFi.mode(WIFI_STA);
-  WiFi.disconnect();
-  delay(100);
-  WiFi.begin(ssid, password);
-
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Debug(".");
-    stateLED = !stateLED;
-    digitalWrite(ledPin, stateLED);
-
-    if (digitalRead(pmuIRQPin) == LOW) {
-      axp192.readIRQ();
-
-      if (axp192.isPEKLongtPressIRQ()) {
-        Debugln(F("Long press detected: Shutting down..."));
-        delay(100);
-        axp192.shutdown();
-      }
-
-      axp192.clearIRQ();
-    }
-  }
-
-  Debugln(F(""));
-  Debug(F("WiFi connected, IP address: "));
-  Debugln(WiFi.localIP());
-
-  if (stateLED) {
-    digitalWrite(ledPin, LOW);
-  }
-}
-// Connect to Wi-Fi during setup END -----------------------------------------------------------------------------------------------------------------------
-
-// Connect to Wi-Fi during the execution of the thread ---------------------------------------------------------------------------------------------------
-void reconnectToWiFi(bool stateLED, const char* ssid, const char* password, const uint8_t ledPin, SemaphoreHandle_t serialSemaphore){
-    if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
-    Debug(F("Connecting to WIFI SSID "));
-    Debugln(ssid);
-    xSemaphoreGive(serialSemaphore);
-    }
-
-    WiFi.mode(WIFI_STA);
-    WiFi.disconnect();
-    vTaskDelay(pdMS_TO_TICKS(100));
-    WiFi.begin(ssid, password);
-
-    while(WiFi.status() != WL_CONNECTED){
-    vTaskDelay(pdMS_TO_TICKS(500));
-    if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
-      Debug(".");
-      xSemaphoreGive(serialSemaphore);
-    }
-    stateLED = !stateLED;
-    digitalWrite(ledPin, stateLED);
-    }
-
-    if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
-      Debugln(F(""));
-
-      Debug(F("WiFi connected, IP address: "));
-      Debugln(WiFi.localIP());
-      xSemaphoreGive(serialSemaphore);
-    }
-
-    if(stateLED){
-      digitalWrite(ledPin, LOW);
-    }
-}
+#include <Arduino.h>
+#include <WiFi.h>                                                                                                // Library to connect to Wi-Fi
+#include <axp20x.h>
+#include "wifiUtils.h"
+#include "macros.h"
+
+static RTC_DATA_ATTR uint8_t apBssid[6];                                                                         // AP of the last association, so the next wake joins it without scanning
+static RTC_DATA_ATTR int32_t apChannel = 0;                                                                      // 0 until a first association
+
+// Associate with the cached AP ----------------------------------------------------------------------------------------------------------------------------
+// START ASSOCIATING, STRAIGHT TO THE CACHED AP AND CHANNEL WHEN THERE IS ONE
+void beginWiFi(const char* ssid, const char* password) {
+  if (apChannel != 0) WiFi.begin(ssid, password, apChannel, apBssid);                                            // No scan of every channel, hundreds of ms saved on each wake
+  else WiFi.begin(ssid, password);
+}
+
+// TRUE ONCE ASSOCIATED. THE CACHED AP GETS "WIFI_CACHED_TIMEOUT_MS" FROM "startMs", THEN IT IS FORGOTTEN AND THE CHANNELS ARE SCANNED AGAIN
+bool pollWiFi(const char* ssid, const char* password, uint32_t startMs) {
+  if (WiFi.status() == WL_CONNECTED) {
+    memcpy(apBssid, WiFi.BSSID(), sizeof(apBssid));
+    apChannel = WiFi.channel();
+    return true;
+  }
+  if (apChannel != 0 && millis() - startMs > WIFI_CACHED_TIMEOUT_MS) {                                           // The AP moved to another channel or is gone
+    apChannel = 0;
+    WiFi.disconnect();
+    WiFi.begin(ssid, password);
+  }
+  return false;
+}
+// Associate with the cached AP END ------------------------------------------------------------------------------------------------------------------------
+
+// Connect to Wi-Fi during setup ---------------------------------------------------------------------------------------------------------------------------
+// GIVES UP AFTER "timeoutMs" SINCE BOOT, 0 TO WAIT FOREVER. A NODE ON BATTERY SLEEPS INSTEAD OF DRAINING IT ON A DEAD AP
+bool connectToWiFi(bool stateLED, AXP20X_Class& axp192, const char* ssid, const char* password, const uint8_t ledPin, const uint8_t pmuIRQPin, uint32_t timeoutMs) {
+  pinMode(ledPin, OUTPUT);
+  digitalWrite(ledPin, stateLED);
+  
+  Debug(F("Connecting to WIFI SSID "));
+  Debugln(ssid);
+
+  WiFi.mode(WIFI_STA);
+  WiFi.disconnect();
+  delay(100);
+  beginWiFi(ssid, password);
+
+  uint32_t start = millis();
+  while (!pollWiFi(ssid, password, start)) {
+    if (timeoutMs != 0 && millis() > timeoutMs) {
+      Debugln(F(" timed out"));
+      digitalWrite(ledPin, LOW);
+      return false;
+    }
+    delay(500);
+    Debug(".");
+    stateLED = !stateLED;
+    digitalWrite(ledPin, stateLED);
+
+    if (digitalRead(pmuIRQPin) == LOW) {
+      axp192.readIRQ();
+
+      if (axp192.isPEKLongtPressIRQ()) {
+        Debugln(F("Long press detected: Shutting down..."));
+        delay(100);
+        axp192.shutdown();
+      }
+
+      axp192.clearIRQ();
+    }
+  }
+
+  Debugln(F(""));
+  Debug(F("WiFi connected, IP address: "));
+  Debugln(WiFi.localIP());
+
+  if (stateLED) {
+    digitalWrite(ledPin, LOW);
+  }
+  return true;
+}
+// Connect to Wi-Fi during setup END -----------------------------------------------------------------------------------------------------------------------
+
+// Connect to Wi-Fi during the execution of the thread ---------------------------------------------------------------------------------------------------
+// SAME "timeoutMs" AS "connectToWiFi()"
+bool reconnectToWiFi(bool stateLED, const char* ssid, const char* password, const uint8_t ledPin, SemaphoreHandle_t serialSemaphore, uint32_t timeoutMs){
+    if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+    Debug(F("Connecting to WIFI SSID "));
+    Debugln(ssid);
+    xSemaphoreGive(serialSemaphore);
+    }
+
+    WiFi.mode(WIFI_STA);
+    WiFi.disconnect();
+    vTaskDelay(pdMS_TO_TICKS(100));
+    beginWiFi(ssid, password);
+
+    uint32_t start = millis();
+    while(!pollWiFi(ssid, password, start)){
+    if(timeoutMs != 0 && millis() > timeoutMs){
+      digitalWrite(ledPin, LOW);
+      return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(500));
+    if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+      Debug(".");
+      xSemaphoreGive(serialSemaphore);
+    }
+    stateLED = !stateLED;
+    digitalWrite(ledPin, stateLED);
+    }
+
+    if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+      Debugln(F(""));
+
+      Debug(F("WiFi connected, IP address: "));
+      Debugln(WiFi.localIP());
+      xSemaphoreGive(serialSemaphore);
+    }
+
+    if(stateLED){
+      digitalWrite(ledPin, LOW);
+    }
+    return true;
+}
 // Connect to Wi-Fi during the execution of the thread END -----------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1,129 @@
+// Host tests of the broker ranking kept across wakes, run with "pio test -e native -f test_broker"
+
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <unity.h>
+#include "brokerUtils.h"
+#include "macros.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+static const BrokerEndpoint brokers[MAX_BROKERS] = {
+  {"primary.example", 8883, false},
+  {"secondary.example", 8883, false},
+  {"psk.example", 8884, true},
+};
+static const bool allUsable[MAX_BROKERS] = {true, true, true};
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+static void assertOrder(uint8_t first, uint8_t second, uint8_t third) {
+  uint8_t order[MAX_BROKERS];
+  TEST_ASSERT_EQUAL_UINT8(3, rankBrokers(brokers, allUsable, MAX_BROKERS, order));
+  TEST_ASSERT_EQUAL_UINT8(first, order[0]);
+  TEST_ASSERT_EQUAL_UINT8(second, order[1]);
+  TEST_ASSERT_EQUAL_UINT8(third, order[2]);
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// TESTS
+// ===========================================================================================================================================================
+void setUp() {
+  resetBrokerHealth();                                                                                           // The health is static, every test starts from a first boot
+}
+
+void tearDown() {}
+
+// NOTHING MEASURED YET: EVERY BROKER HAS THE PRIOR LATENCY AND THE LIST ORDER DECIDES
+static void test_unmeasured_keep_list_order() {
+  TEST_ASSERT_EQUAL_UINT32(BROKER_PRIOR_LATENCY_MS, brokerExpectedMs(1));
+  assertOrder(0, 1, 2);
+}
+
+static void test_unusable_and_empty_left_out() {
+  const BrokerEndpoint partial[MAX_BROKERS] = {{"primary.example", 8883, false}, {"", 8883, false}, {"psk.example", 8884, true}};
+  const bool usable[MAX_BROKERS] = {false, true, true};
+  uint8_t order[MAX_BROKERS];
+
+  TEST_ASSERT_EQUAL_UINT8(1, rankBrokers(partial, usable, MAX_BROKERS, order));
+  TEST_ASSERT_EQUAL_UINT8(2, order[0]);
+}
+
+// THE FIRST MEASURE IS TAKEN AS IT IS, THE NEXT ONES ARE A 1/4 RUNNING AVERAGE
+static void test_latency_averaged() {
+  brokerResult(0, true, 800);
+  TEST_ASSERT_EQUAL_UINT32(800, brokerExpectedMs(0));
+  brokerResult(0, true, 1600);
+  TEST_ASSERT_EQUAL_UINT32(1000, brokerExpectedMs(0));
+  brokerResult(0, false, 5000);                                                                                  // A timeout says nothing about the latency
+  TEST_ASSERT_EQUAL_UINT32(1000, brokerExpectedMs(0));
+}
+
+static void test_fastest_first() {
+  brokerResult(0, true, 2500);
+  brokerResult(1, true, 400);
+  brokerResult(2, true, 1200);
+  assertOrder(1, 2, 0);
+}
+
+// A FAST BROKER THAT OFTEN FAILS CAN COST MORE THAN A SLOWER RELIABLE ONE
+static void test_success_rate_counts() {
+  brokerResult(0, true, 1000);
+  brokerResult(1, true, 1300);
+  brokerResult(0, false, 0);
+  brokerResult(0, false, 0);
+  brokerResult(0, true, 1000);                                                                                   // Still healthy, but only ~70 % of its attempts work
+  assertOrder(1, 0, 2);
+}
+
+// "BROKER_MAX_FAILURES" FAILED ATTEMPTS IN A ROW AND A BROKER IS RANKED AFTER EVERY HEALTHY ONE, HOWEVER FAST IT WAS
+static void test_failing_broker_ranked_last() {
+  brokerResult(0, true, 300);
+  brokerResult(1, true, 2000);
+  brokerResult(2, true, 2500);
+  for (uint8_t i = 0; i < BROKER_MAX_FAILURES - 1; i++) brokerResult(0, false, 0);
+  assertOrder(0, 1, 2);
+
+  brokerResult(0, false, 0);
+  assertOrder(1, 2, 0);
+  TEST_ASSERT_EQUAL_UINT8(BROKER_MAX_FAILURES, brokerHealth(0).failures);
+}
+
+// ONCE EVERY "BROKER_RETRY_CYCLES" ROUNDS A FAILING BROKER GOES FIRST FOR ONE ATTEMPT, HOWEVER LOW ITS SCORE FELL, AND IS BACK FOR GOOD ONCE IT CONNECTS
+static void test_failing_broker_retried_first() {
+  brokerResult(0, true, 2800);
+  brokerResult(1, true, 1000);
+  brokerResult(2, true, 1200);
+  for (uint8_t i = 0; i < BROKER_MAX_FAILURES + 5; i++) brokerResult(0, false, 0);                               // Its score is now far behind the others
+
+  for (uint8_t round = 1; round < BROKER_RETRY_CYCLES; round++) assertOrder(1, 2, 0);
+  assertOrder(0, 1, 2);
+  assertOrder(0, 1, 2);                                                                                          // Still due until it is actually tried
+
+  brokerResult(0, false, 0);                                                                                     // One attempt, then last again for another cycle
+  for (uint8_t round = 1; round < BROKER_RETRY_CYCLES; round++) assertOrder(1, 2, 0);
+  assertOrder(0, 1, 2);
+
+  brokerResult(0, true, 2800);
+  TEST_ASSERT_EQUAL_UINT8(0, brokerHealth(0).failures);
+  assertOrder(1, 2, 0);                                                                                          // Healthy again, ranked by its score like the others
+}
+// TESTS END =================================================================================================================================================
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_unmeasured_keep_list_order);
+  RUN_TEST(test_unusable_and_empty_left_out);
+  RUN_TEST(test_latency_averaged);
+  RUN_TEST(test_fastest_first);
+  RUN_TEST(test_success_rate_counts);
+  RUN_TEST(test_failing_broker_ranked_last);
+  RUN_TEST(test_failing_broker_retried_first);
+  return UNITY_END();
+}
@@ -0,0 +1,210 @@
+// Host tests of the sample frame codec and the in-memory ESP-NOW loopback, run with "pio test -e native -f test_frame"
+
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <string.h>
+#include <unity.h>
+#include "frameUtils.h"
+#include "espNowUtils.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// A FRAME WITH EVERY OPTIONAL BLOCK FILLED: PROBES, WINDOW AGGREGATES, VALVE STATE AND SAMPLING TIME
+static SampleFrame fullFrame() {
+  SampleFrame frame = {};
+  frame.treeId = 7;
+  frame.bootCnt = 123456;
+  frame.soilTemp = 18.25f;
+  frame.soilMoist = 41.5f;
+  frame.batVolt = 3.912f;
+  frame.flags = FRAME_FAULT_TEMP_NOISY;
+  frame.valve = FRAME_VALVE_PRESENT | FRAME_VALVE_OPEN | (3 << FRAME_VALVE_SWITCHES_SHIFT);
+  frame.tsMs = 1767225600123ULL;                                                                                 // Needs more than 32 bits
+  frame.probeCount = 3;
+  for (uint8_t i = 0; i < frame.probeCount; i++) {
+    frame.probeDepthCm[i] = 10 + 20 * i;
+    frame.probeTemp[i] = 17.5f - 1.25f * i;
+  }
+  frame.tempWindow = {4, 18.1f, 0.12f, 17.9f, 18.3f};
+  frame.moistWindow = {4, 41.7f, 0.35f, 41.2f, 42.0f};
+  return frame;
+}
+
+// A FRAME WITH NONE OF THEM, THE SHORTEST ONE A NODE SENDS
+static SampleFrame bareFrame() {
+  SampleFrame frame = {};
+  frame.treeId = -1;
+  frame.bootCnt = 1;
+  frame.soilTemp = -3.5f;
+  frame.soilMoist = 0.0f;
+  frame.batVolt = 3.3f;
+  frame.probeCount = 1;
+  return frame;
+}
+
+// SAME CRC-8 AS THE CODEC, TO FORGE FRAMES IT WOULD ONLY REJECT FOR THEIR CONTENT
+static uint8_t crc8(const uint8_t* data, size_t len) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t j = 0; j < 8; j++) crc = (crc & 0x01) ? (crc >> 1) ^ 0x8C : crc >> 1;
+  }
+  return crc;
+}
+
+static void assertWindowEqual(const WindowSummary& expected, const WindowSummary& actual) {
+  TEST_ASSERT_EQUAL_UINT16(expected.count, actual.count);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, expected.mean, actual.mean);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, expected.stdDev, actual.stdDev);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, expected.min, actual.min);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, expected.max, actual.max);
+}
+
+// EVERY FIELD THE CODEC CARRIES, AT THE RESOLUTION IT CARRIES IT
+static void assertFrameEqual(const SampleFrame& expected, const SampleFrame& actual) {
+  TEST_ASSERT_EQUAL_INT16(expected.treeId, actual.treeId);
+  TEST_ASSERT_EQUAL_UINT32(expected.bootCnt, actual.bootCnt);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, expected.soilTemp, actual.soilTemp);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, expected.soilMoist, actual.soilMoist);
+  TEST_ASSERT_FLOAT_WITHIN(0.0005f, expected.batVolt, actual.batVolt);
+  TEST_ASSERT_EQUAL_UINT8(expected.flags, actual.flags);
+  TEST_ASSERT_EQUAL_UINT8(expected.valve, actual.valve);
+  TEST_ASSERT_TRUE(expected.tsMs == actual.tsMs);
+  uint8_t probes = expected.probeCount > 1 ? expected.probeCount : 0;                                            // A single probe travels as "soilTemp" only
+  TEST_ASSERT_EQUAL_UINT8(probes, actual.probeCount);
+  for (uint8_t i = 0; i < probes; i++) {
+    TEST_ASSERT_EQUAL_UINT8(expected.probeDepthCm[i], actual.probeDepthCm[i]);
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, expected.probeTemp[i], actual.probeTemp[i]);
+  }
+  assertWindowEqual(expected.tempWindow, actual.tempWindow);
+  assertWindowEqual(expected.moistWindow, actual.moistWindow);
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// TESTS
+// ===========================================================================================================================================================
+void setUp() {}
+void tearDown() {}
+
+static void test_round_trip_full() {
+  SampleFrame frame = fullFrame(), decoded = {};
+  uint8_t buf[FRAME_MAX_LEN];
+  size_t len = encodeFrame(frame, buf, sizeof(buf));
+
+  TEST_ASSERT_EQUAL_size_t(FRAME_BASE_LEN + 3 * FRAME_PROBE_LEN + FRAME_WINDOW_LEN, len);
+  TEST_ASSERT_EQUAL_size_t(frameLength(frame), len);
+  TEST_ASSERT_TRUE(decodeFrame(buf, len, decoded));
+  assertFrameEqual(frame, decoded);
+}
+
+static void test_round_trip_bare() {
+  SampleFrame frame = bareFrame(), decoded = fullFrame();                                                        // Leftovers in "decoded" must be cleared
+  uint8_t buf[FRAME_MAX_LEN];
+  size_t len = encodeFrame(frame, buf, sizeof(buf));
+
+  TEST_ASSERT_EQUAL_size_t(FRAME_BASE_LEN, len);
+  TEST_ASSERT_TRUE(decodeFrame(buf, len, decoded));
+  assertFrameEqual(frame, decoded);
+}
+
+static void test_out_of_range_values_saturate() {
+  SampleFrame frame = bareFrame(), decoded = {};
+  frame.soilTemp = 1000.0f;
+  frame.soilMoist = -5.0f;
+  uint8_t buf[FRAME_MAX_LEN];
+
+  TEST_ASSERT_TRUE(decodeFrame(buf, encodeFrame(frame, buf, sizeof(buf)), decoded));
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, 327.67f, decoded.soilTemp);
+  TEST_ASSERT_FLOAT_WITHIN(0.005f, 0.0f, decoded.soilMoist);
+}
+
+static void test_encode_into_short_buffer() {
+  SampleFrame frame = fullFrame();
+  uint8_t buf[FRAME_MAX_LEN];
+
+  TEST_ASSERT_EQUAL_size_t(0, encodeFrame(frame, buf, frameLength(frame) - 1));
+}
+
+// CRC-8 CATCHES EVERY SINGLE-BIT ERROR, WHICHEVER BYTE IT HITS, THE CRC ITSELF INCLUDED
+static void test_corrupted_bits_rejected() {
+  SampleFrame frame = fullFrame(), decoded;
+  uint8_t buf[FRAME_MAX_LEN];
+  size_t len = encodeFrame(frame, buf, sizeof(buf));
+
+  for (size_t i = 0; i < len; i++) {
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      buf[i] ^= 1 << bit;
+      TEST_ASSERT_FALSE(decodeFrame(buf, len, decoded));
+      buf[i] ^= 1 << bit;
+    }
+  }
+  TEST_ASSERT_TRUE(decodeFrame(buf, len, decoded));
+}
+
+// A FRAME CUT SHORT OR WITH TRAILING BYTES, E.G. TWO FRAMES MERGED, IS REJECTED EVEN IF THE BYTES THERE HAPPEN TO MATCH A CRC
+static void test_truncated_and_padded_rejected() {
+  SampleFrame frame = fullFrame(), decoded;
+  uint8_t buf[FRAME_MAX_LEN + 1];
+  size_t len = encodeFrame(frame, buf, sizeof(buf));
+
+  for (size_t cut = 0; cut < len; cut++) TEST_ASSERT_FALSE(decodeFrame(buf, cut, decoded));
+  buf[len] = 0;
+  TEST_ASSERT_FALSE(decodeFrame(buf, len + 1, decoded));
+
+  frame = bareFrame();                                                                                           // Without probes nor window, so the length check alone decides
+  len = encodeFrame(frame, buf, sizeof(buf));
+  for (size_t cut = 0; cut < len; cut++) TEST_ASSERT_FALSE(decodeFrame(buf, cut, decoded));
+}
+
+static void test_foreign_magic_and_version_rejected() {
+  SampleFrame frame = bareFrame(), decoded;
+  uint8_t buf[FRAME_MAX_LEN];
+  size_t len = encodeFrame(frame, buf, sizeof(buf));
+
+  uint8_t valve[VALVE_COMMAND_LEN];                                                                              // A valve command on the same channel is not a sample
+  TEST_ASSERT_EQUAL_size_t(VALVE_COMMAND_LEN, encodeValveCommand(7, true, valve, sizeof(valve)));
+  TEST_ASSERT_FALSE(decodeFrame(valve, sizeof(valve), decoded));
+
+  buf[1] = FRAME_VERSION + 1;                                                                                    // Another layout, even with a matching CRC
+  buf[len - 1] = crc8(buf, len - 1);
+  TEST_ASSERT_FALSE(decodeFrame(buf, len, decoded));
+}
+
+// THE LOOPBACK BACKEND HANDS BACK WHAT WAS SENT, AND DROPS WHAT DOES NOT FIT IN ITS QUEUE
+static void test_loopback_round_trip() {
+  SampleFrame frame = fullFrame(), decoded = {};
+  uint8_t mac[6] = {};
+
+  TEST_ASSERT_TRUE(setupEspNow(1, mac));
+  TEST_ASSERT_FALSE(receiveSampleFrame(decoded, mac));
+  TEST_ASSERT_TRUE(sendSampleFrame(mac, frame));
+  TEST_ASSERT_TRUE(receiveSampleFrame(decoded, mac));
+  assertFrameEqual(frame, decoded);
+  TEST_ASSERT_EQUAL_HEX8(0x02, mac[0]);                                                                          // Locally administered source address
+  TEST_ASSERT_FALSE(receiveSampleFrame(decoded, mac));
+
+  uint32_t dropped = getDroppedFrames();
+  uint8_t queued = 0;
+  while (sendSampleFrame(mac, frame)) queued++;
+  TEST_ASSERT_EQUAL_UINT32(dropped + 1, getDroppedFrames());
+  for (uint8_t i = 0; i < queued; i++) TEST_ASSERT_TRUE(receiveSampleFrame(decoded, mac));
+  TEST_ASSERT_FALSE(receiveSampleFrame(decoded, mac));
+}
+// TESTS END =================================================================================================================================================
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip_full);
+  RUN_TEST(test_round_trip_bare);
+  RUN_TEST(test_out_of_range_values_saturate);
+  RUN_TEST(test_encode_into_short_buffer);
+  RUN_TEST(test_corrupted_bits_rejected);
+  RUN_TEST(test_truncated_and_padded_rejected);
+  RUN_TEST(test_foreign_magic_and_version_rejected);
+  RUN_TEST(test_loopback_round_trip);
+  return UNITY_END();
+}
@@ -0,0 +1,186 @@
+// Host tests of the sample health checks and of when a faulty sample is worth the radio, run with "pio test -e native -f test_health"
+
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <unity.h>
+#include "healthUtils.h"
+#include "macros.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// TWO GOOD PROBES AND A MOISTURE READING WELL INSIDE THE RAILS, WITH SOME ADC NOISE
+static SampleFrame goodFrame(SampleQuality& quality) {
+  SampleFrame frame = {};
+  frame.probeCount = 2;
+  frame.probeTemp[0] = 18.5f;
+  frame.probeTemp[1] = 16.0f;
+  frame.soilMoist = 41.5f;
+  quality = {};
+  quality.probeSpreadC[0] = 0.1f;
+  quality.probeSpreadC[1] = 0.2f;
+  quality.moistRaw = 2100;
+  quality.moistSpreadRaw = 12;
+  return frame;
+}
+
+// A SAMPLE WITH NO VALID VALUE AT ALL: NO PROBE ON THE BUS AND THE MOISTURE PROBE SHORTED
+static SampleFrame deadFrame(SampleQuality& quality) {
+  SampleFrame frame = {};
+  quality = {};
+  quality.moistRaw = 0;
+  checkSampleHealth(frame, quality);
+  return frame;
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// TESTS
+// ===========================================================================================================================================================
+void setUp() {
+  resetSampleHealth();                                                                                           // The state of the previous wakes is static, every test starts from a first boot
+}
+
+void tearDown() {}
+
+static void test_good_sample_has_no_faults() {
+  SampleQuality quality;
+  SampleFrame frame = goodFrame(quality);
+
+  TEST_ASSERT_EQUAL_HEX8(0, checkSampleHealth(frame, quality));
+  TEST_ASSERT_EQUAL_FLOAT(18.5f, frame.soilTemp);                                                                // The shallowest probe, as the dashboard expects
+  TEST_ASSERT_EQUAL_FLOAT(16.0f, frame.probeTemp[1]);
+}
+
+// EVERY PROBE FAULT, FROM THE MOST TO THE LEAST SEVERE. A FAULTY PROBE IS MARKED INVALID, THE OTHERS KEEP THEIR VALUE
+static void test_probe_faults_classified() {
+  const struct { float tempC; float spreadC; uint8_t fault; } cases[] = {
+    {FRAME_INVALID_TEMP, 0.0f, FRAME_FAULT_TEMP_DISCONNECTED},
+    {DS18B20_POWER_ON_C, 0.0f, FRAME_FAULT_TEMP_STUCK},
+    {HEALTH_TEMP_MAX_C + 1.0f, 0.0f, FRAME_FAULT_TEMP_RANGE},
+    {HEALTH_TEMP_MIN_C - 1.0f, HEALTH_TEMP_MAX_SPREAD_C + 1.0f, FRAME_FAULT_TEMP_RANGE},
+    {20.0f, HEALTH_TEMP_MAX_SPREAD_C + 1.0f, FRAME_FAULT_TEMP_NOISY},
+  };
+
+  for (const auto& c : cases) {
+    SampleQuality quality;
+    SampleFrame frame = goodFrame(quality);
+    frame.probeTemp[0] = c.tempC;
+    quality.probeSpreadC[0] = c.spreadC;
+
+    TEST_ASSERT_EQUAL_HEX8(c.fault, checkSampleHealth(frame, quality));
+    TEST_ASSERT_EQUAL_FLOAT(FRAME_INVALID_TEMP, frame.probeTemp[0]);
+    TEST_ASSERT_EQUAL_FLOAT(FRAME_INVALID_TEMP, frame.soilTemp);
+    TEST_ASSERT_EQUAL_FLOAT(16.0f, frame.probeTemp[1]);
+  }
+}
+
+static void test_no_probe_is_disconnected() {
+  SampleQuality quality;
+  SampleFrame frame = goodFrame(quality);
+  frame.probeCount = 0;
+
+  TEST_ASSERT_EQUAL_HEX8(FRAME_FAULT_TEMP_DISCONNECTED, checkSampleHealth(frame, quality));
+  TEST_ASSERT_EQUAL_FLOAT(FRAME_INVALID_TEMP, frame.soilTemp);
+}
+
+static void test_moisture_faults_classified() {
+  SampleQuality quality;
+  SampleFrame frame = goodFrame(quality);
+
+  quality.moistRaw = HEALTH_MOIST_RAW_MIN - 1;
+  TEST_ASSERT_EQUAL_HEX8(FRAME_FAULT_MOIST_RANGE, checkSampleHealth(frame, quality));
+  quality.moistRaw = HEALTH_MOIST_RAW_MAX + 1;
+  TEST_ASSERT_EQUAL_HEX8(FRAME_FAULT_MOIST_RANGE, checkSampleHealth(frame, quality));
+
+  quality.moistRaw = 2100;
+  quality.moistSpreadRaw = HEALTH_MOIST_MAX_SPREAD_RAW + 1;
+  TEST_ASSERT_EQUAL_HEX8(FRAME_FAULT_MOIST_NOISY, checkSampleHealth(frame, quality));
+}
+
+// A LIVE PROBE ALWAYS SHOWS SOME NOISE: ONLY "HEALTH_STUCK_WAKES" PERFECTLY FLAT IDENTICAL WAKES IN A ROW MAKE IT STUCK
+static void test_moisture_stuck_after_flat_wakes() {
+  SampleQuality quality;
+  SampleFrame frame = goodFrame(quality);
+  quality.moistSpreadRaw = 0;
+  commitSampleHealth(frame, quality);                                                                            // The wake the next ones are identical to
+
+  for (uint8_t wake = 1; wake < HEALTH_STUCK_WAKES; wake++) {
+    TEST_ASSERT_EQUAL_HEX8(0, checkSampleHealth(frame, quality));
+    commitSampleHealth(frame, quality);
+  }
+  TEST_ASSERT_EQUAL_HEX8(FRAME_FAULT_MOIST_STUCK, checkSampleHealth(frame, quality));
+  commitSampleHealth(frame, quality);
+
+  quality.moistRaw++;                                                                                            // Any change clears it
+  TEST_ASSERT_EQUAL_HEX8(0, checkSampleHealth(frame, quality));
+}
+
+// A NEW FAULT IS SAMPLED AGAIN A BOUNDED NUMBER OF TIMES, ONE THAT SURVIVED A WHOLE WAKE IS NOT RETRIED ON THE NEXT ONES
+static void test_only_new_faults_retried() {
+  SampleQuality quality;
+  SampleFrame frame = goodFrame(quality);
+  frame.probeTemp[1] = FRAME_INVALID_TEMP;
+  uint8_t faults = checkSampleHealth(frame, quality);
+
+  TEST_ASSERT_TRUE(healthShouldRetry(faults, 0));
+  TEST_ASSERT_FALSE(healthShouldRetry(faults, HEALTH_MAX_RETRIES));
+  commitSampleHealth(frame, quality);
+  TEST_ASSERT_FALSE(healthShouldRetry(faults, 0));
+  TEST_ASSERT_TRUE(healthShouldRetry(faults | FRAME_FAULT_MOIST_NOISY, 0));
+}
+
+// A SAMPLE WITH ANY VALID VALUE IS ALWAYS WORTH THE RADIO, WHATEVER ITS FAULTS
+static void test_valid_value_worth_sending() {
+  SampleQuality quality;
+  SampleFrame frame = goodFrame(quality);
+  frame.probeTemp[0] = FRAME_INVALID_TEMP;
+  checkSampleHealth(frame, quality);
+
+  TEST_ASSERT_TRUE(healthShouldSend(frame));
+  healthDelivered(frame);
+  TEST_ASSERT_TRUE(healthShouldSend(frame));
+}
+
+// WITH NOTHING VALID, ONLY A CHANGE IN THE FAULTS SINCE THE LAST DELIVERED SAMPLE OR THE PERIODIC REPORT USE THE RADIO
+static void test_dead_sample_reported_periodically() {
+  SampleQuality quality;
+  SampleFrame frame = deadFrame(quality);
+  commitSampleHealth(frame, quality);
+
+  TEST_ASSERT_TRUE(healthShouldSend(frame));                                                                     // New faults
+  TEST_ASSERT_TRUE(healthShouldSend(frame));                                                                     // Judging it moves nothing, only a delivery does
+  healthDelivered(frame);
+
+  for (uint8_t wake = 1; wake < HEALTH_REPORT_WAKES; wake++) {
+    frame = deadFrame(quality);
+    commitSampleHealth(frame, quality);
+    TEST_ASSERT_FALSE(healthShouldSend(frame));
+  }
+  frame = deadFrame(quality);
+  commitSampleHealth(frame, quality);
+  TEST_ASSERT_TRUE(healthShouldSend(frame));
+
+  commitSampleHealth(frame, quality);                                                                            // That report was never delivered, the next wake tries again
+  TEST_ASSERT_TRUE(healthShouldSend(frame));
+  healthDelivered(frame);
+  frame = deadFrame(quality);
+  commitSampleHealth(frame, quality);
+  TEST_ASSERT_FALSE(healthShouldSend(frame));
+}
+// TESTS END =================================================================================================================================================
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_good_sample_has_no_faults);
+  RUN_TEST(test_probe_faults_classified);
+  RUN_TEST(test_no_probe_is_disconnected);
+  RUN_TEST(test_moisture_faults_classified);
+  RUN_TEST(test_moisture_stuck_after_flat_wakes);
+  RUN_TEST(test_only_new_faults_retried);
+  RUN_TEST(test_valid_value_worth_sending);
+  RUN_TEST(test_dead_sample_reported_periodically);
+  return UNITY_END();
+}
@@ -0,0 +1,138 @@
+// Host tests of the Welford accumulator and of the reporting windows kept between delivered samples, run with "pio test -e native -f test_stats"
+
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <math.h>
+#include <unity.h>
+#include "statsUtils.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// A FRESH SAMPLE WITH BOTH VALUES VALID
+static SampleFrame sample(float tempC, float moist) {
+  SampleFrame frame = {};
+  frame.soilTemp = tempC;
+  frame.soilMoist = moist;
+  return frame;
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// TESTS
+// ===========================================================================================================================================================
+void setUp() {
+  windowReset();                                                                                                 // The windows are static, every test starts from a delivered sample
+}
+
+void tearDown() {}
+
+static void test_empty_and_single_sample() {
+  RunningStats stats;
+  statsReset(stats);
+  TEST_ASSERT_EQUAL_UINT16(0, statsSummary(stats).count);
+
+  statsAdd(stats, 21.5f);
+  WindowSummary summary = statsSummary(stats);
+  TEST_ASSERT_EQUAL_UINT16(1, summary.count);
+  TEST_ASSERT_EQUAL_FLOAT(21.5f, summary.mean);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, summary.stdDev);                                                                 // No spread from a single sample
+  TEST_ASSERT_EQUAL_FLOAT(21.5f, summary.min);
+  TEST_ASSERT_EQUAL_FLOAT(21.5f, summary.max);
+}
+
+// SAME MEAN, SAMPLE STANDARD DEVIATION (N - 1), MIN AND MAX AS THE TEXTBOOK TWO-PASS FORMULAS
+static void test_matches_two_pass() {
+  const float values[] = {12.0f, 15.5f, 9.25f, 18.0f, 14.75f, 11.0f};
+  const uint16_t n = sizeof(values) / sizeof(values[0]);
+  RunningStats stats;
+  statsReset(stats);
+
+  double sum = 0.0;
+  for (float v : values) {
+    statsAdd(stats, v);
+    sum += v;
+  }
+  double mean = sum / n;
+  double squares = 0.0;
+  for (float v : values) squares += (v - mean) * (v - mean);
+
+  WindowSummary summary = statsSummary(stats);
+  TEST_ASSERT_EQUAL_UINT16(n, summary.count);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, (float)mean, summary.mean);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, (float)sqrt(squares / (n - 1)), summary.stdDev);
+  TEST_ASSERT_EQUAL_FLOAT(9.25f, summary.min);
+  TEST_ASSERT_EQUAL_FLOAT(18.0f, summary.max);
+}
+
+// MANY CLOSE VALUES FAR FROM ZERO, WHERE A SUM OF SQUARES IN FLOAT WOULD CANCEL OUT TO NOISE OR A NEGATIVE VARIANCE
+static void test_stable_with_close_values() {
+  RunningStats stats;
+  statsReset(stats);
+  for (uint16_t i = 0; i < 1000; i++) statsAdd(stats, 3000.0f + ((i % 2) ? 0.5f : -0.5f));
+
+  WindowSummary summary = statsSummary(stats);
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, 3000.0f, summary.mean);
+  TEST_ASSERT_FLOAT_WITHIN(1e-2f, 0.5f, summary.stdDev);
+}
+
+static void test_count_saturates() {
+  RunningStats stats;
+  statsReset(stats);
+  for (uint32_t i = 0; i < UINT16_MAX + 10UL; i++) statsAdd(stats, 1.0f);
+
+  TEST_ASSERT_EQUAL_UINT16(UINT16_MAX, statsSummary(stats).count);
+  TEST_ASSERT_EQUAL_FLOAT(1.0f, statsSummary(stats).mean);
+}
+
+// THE WINDOW GROWS WITH EVERY SAMPLE UNTIL ONE IS DELIVERED, AND ITS AGGREGATES GO OUT WITH EACH FRAME
+static void test_window_spans_undelivered_samples() {
+  SampleFrame frame = sample(10.0f, 40.0f);
+  windowAddSample(frame);
+  frame = sample(14.0f, 44.0f);
+  windowAddSample(frame);
+
+  TEST_ASSERT_EQUAL_UINT16(2, frame.tempWindow.count);
+  TEST_ASSERT_EQUAL_FLOAT(12.0f, frame.tempWindow.mean);
+  TEST_ASSERT_EQUAL_FLOAT(10.0f, frame.tempWindow.min);
+  TEST_ASSERT_EQUAL_FLOAT(14.0f, frame.tempWindow.max);
+  TEST_ASSERT_EQUAL_FLOAT(42.0f, frame.moistWindow.mean);
+
+  windowReset();
+  frame = sample(20.0f, 30.0f);
+  windowAddSample(frame);
+  TEST_ASSERT_EQUAL_UINT16(1, frame.tempWindow.count);
+  TEST_ASSERT_EQUAL_FLOAT(20.0f, frame.tempWindow.mean);
+}
+
+// AN INVALID VALUE IS LEFT OUT OF ITS WINDOW ONLY, THE OTHER VALUE OF THE SAMPLE STILL COUNTS
+static void test_invalid_values_left_out() {
+  SampleFrame frame = sample(10.0f, 40.0f);
+  windowAddSample(frame);
+
+  frame = sample(FRAME_INVALID_TEMP, 50.0f);
+  windowAddSample(frame);
+  TEST_ASSERT_EQUAL_UINT16(1, frame.tempWindow.count);
+  TEST_ASSERT_EQUAL_UINT16(2, frame.moistWindow.count);
+
+  frame = sample(12.0f, 0.0f);
+  frame.flags = FRAME_FAULT_MOIST_RANGE;
+  windowAddSample(frame);
+  TEST_ASSERT_EQUAL_UINT16(2, frame.tempWindow.count);
+  TEST_ASSERT_EQUAL_UINT16(2, frame.moistWindow.count);
+  TEST_ASSERT_EQUAL_FLOAT(45.0f, frame.moistWindow.mean);
+}
+// TESTS END =================================================================================================================================================
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_and_single_sample);
+  RUN_TEST(test_matches_two_pass);
+  RUN_TEST(test_stable_with_close_values);
+  RUN_TEST(test_count_saturates);
+  RUN_TEST(test_window_spans_undelivered_samples);
+  RUN_TEST(test_invalid_values_left_out);
+  return UNITY_END();
+}
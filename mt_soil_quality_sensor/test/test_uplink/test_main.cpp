@@ -0,0 +1,130 @@
+// Host tests of the uplink selection policy with simulated uplinks, run with "pio test -e native -f test_uplink"
+
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <unity.h>
+#include "uplinkUtils.h"
+#include "macros.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+#define FRAME_BYTES 30                                                                                           // Same payload size for every simulated uplink unless a test says otherwise
+
+static const SampleFrame frame = {};
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// TESTS
+// ===========================================================================================================================================================
+void setUp() {
+  resetUplinkHealth();                                                                                           // The failure counters are static, every test starts from healthy uplinks
+}
+
+void tearDown() {}
+
+static void test_cheapest_first() {
+  SimUplink wifi("wifi", {60000.0f, 2.0f, 3000}, FRAME_BYTES);
+  SimUplink espNow("espnow", {800.0f, 1.5f, 50}, FRAME_BYTES);
+  SimUplink lora("lora", {2000.0f, 400.0f, 1500}, FRAME_BYTES);
+  Uplink* uplinks[] = {&wifi, &lora, &espNow};
+
+  TEST_ASSERT_EQUAL_PTR(&espNow, sendWithPolicy(uplinks, 3, frame, UPLINK_MAX_LATENCY_MS));
+  TEST_ASSERT_EQUAL_UINT32(1, espNow.sent);
+  TEST_ASSERT_EQUAL_UINT32(0, wifi.attempts);                                                                    // The others were never brought up
+  TEST_ASSERT_EQUAL_UINT32(0, lora.attempts);
+}
+
+// THE PAYLOAD SIZE COUNTS: A LINK WITH A CHEAP START-UP LOSES TO ONE WITH CHEAP BYTES ONCE THE FRAME IS LARGE ENOUGH
+static void test_cost_follows_payload_size() {
+  SimUplink small("small", {100.0f, 10.0f, 100}, 10);
+  SimUplink large("large", {500.0f, 1.0f, 100}, 10);
+  Uplink* uplinks[] = {&small, &large};
+
+  TEST_ASSERT_EQUAL_PTR(&small, selectUplink(uplinks, 2, frame, UPLINK_MAX_LATENCY_MS));                         // 200 against 510 µJ
+
+  SimUplink smallBig("small", {100.0f, 10.0f, 100}, 100);
+  SimUplink largeBig("large", {500.0f, 1.0f, 100}, 100);
+  Uplink* bigUplinks[] = {&smallBig, &largeBig};
+  TEST_ASSERT_EQUAL_PTR(&largeBig, selectUplink(bigUplinks, 2, frame, UPLINK_MAX_LATENCY_MS));                   // 1100 against 600 µJ
+}
+
+static void test_tie_goes_to_faster_link() {
+  SimUplink slow("slow", {1000.0f, 0.0f, 2000}, FRAME_BYTES);
+  SimUplink fast("fast", {1000.0f, 0.0f, 100}, FRAME_BYTES);
+  Uplink* uplinks[] = {&slow, &fast};
+
+  TEST_ASSERT_EQUAL_PTR(&fast, selectUplink(uplinks, 2, frame, UPLINK_MAX_LATENCY_MS));
+}
+
+// A FAILED SEND FALLS BACK TO THE NEXT CHEAPEST UPLINK IN THE SAME CYCLE, AN UNAVAILABLE ONE IS NOT EVEN TRIED
+static void test_failover() {
+  SimUplink espNow("espnow", {800.0f, 1.5f, 50}, FRAME_BYTES);
+  SimUplink lora("lora", {2000.0f, 400.0f, 1500}, FRAME_BYTES);
+  SimUplink wifi("wifi", {60000.0f, 2.0f, 3000}, FRAME_BYTES);
+  Uplink* uplinks[] = {&espNow, &lora, &wifi};
+
+  espNow.delivers = false;
+  lora.up = false;
+  TEST_ASSERT_EQUAL_PTR(&wifi, sendWithPolicy(uplinks, 3, frame, UPLINK_MAX_LATENCY_MS));
+  TEST_ASSERT_EQUAL_UINT32(1, espNow.attempts);
+  TEST_ASSERT_EQUAL_UINT32(0, lora.attempts);
+  TEST_ASSERT_EQUAL_UINT32(1, wifi.sent);
+
+  wifi.delivers = false;                                                                                         // Nothing left: every working uplink tried once, then give up
+  TEST_ASSERT_NULL(sendWithPolicy(uplinks, 3, frame, UPLINK_MAX_LATENCY_MS));
+  TEST_ASSERT_EQUAL_UINT32(2, espNow.attempts);
+  TEST_ASSERT_EQUAL_UINT32(2, wifi.attempts);
+}
+
+// UPLINKS SLOWER THAN THE BUDGET ARE LEFT OUT HOWEVER CHEAP THEY ARE, AND NOTHING IS SENT IF NONE FITS
+static void test_latency_budget() {
+  SimUplink lora("lora", {500.0f, 1.0f, 5000}, FRAME_BYTES);
+  SimUplink espNow("espnow", {2000.0f, 1.0f, 50}, FRAME_BYTES);
+  Uplink* uplinks[] = {&lora, &espNow};
+
+  TEST_ASSERT_EQUAL_PTR(&lora, sendWithPolicy(uplinks, 2, frame, UPLINK_MAX_LATENCY_MS));
+  TEST_ASSERT_EQUAL_PTR(&espNow, sendWithPolicy(uplinks, 2, frame, 1000));                                      // Costs more but fits the budget
+  TEST_ASSERT_EQUAL_UINT32(1, lora.attempts);
+
+  espNow.delivers = false;                                                                                       // No fallback to the slow link either
+  TEST_ASSERT_NULL(sendWithPolicy(uplinks, 2, frame, 1000));
+  TEST_ASSERT_EQUAL_UINT32(1, lora.attempts);
+
+  TEST_ASSERT_NULL(sendWithPolicy(uplinks, 2, frame, 10));
+  TEST_ASSERT_EQUAL_UINT32(1, lora.attempts);
+  TEST_ASSERT_EQUAL_UINT32(2, espNow.attempts);
+}
+
+// AFTER "UPLINK_MAX_FAILURES" FAILED CYCLES AN UPLINK IS ONLY PROBED EVERY "UPLINK_RETRY_CYCLES", AND IS BACK FOR GOOD ONCE IT DELIVERS
+static void test_unhealthy_uplink_probed_again() {
+  SimUplink espNow("espnow", {800.0f, 1.5f, 50}, FRAME_BYTES);
+  SimUplink wifi("wifi", {60000.0f, 2.0f, 3000}, FRAME_BYTES);
+  Uplink* uplinks[] = {&espNow, &wifi};
+
+  espNow.delivers = false;
+  for (uint8_t i = 0; i < UPLINK_MAX_FAILURES; i++) TEST_ASSERT_EQUAL_PTR(&wifi, sendWithPolicy(uplinks, 2, frame, UPLINK_MAX_LATENCY_MS));
+  TEST_ASSERT_EQUAL_UINT32(UPLINK_MAX_FAILURES, espNow.attempts);
+
+  for (uint8_t i = 1; i < UPLINK_RETRY_CYCLES; i++) TEST_ASSERT_EQUAL_PTR(&wifi, sendWithPolicy(uplinks, 2, frame, UPLINK_MAX_LATENCY_MS));
+  TEST_ASSERT_EQUAL_UINT32(UPLINK_MAX_FAILURES, espNow.attempts);                                                // Skipped, the cheaper link is down
+
+  espNow.delivers = true;
+  TEST_ASSERT_EQUAL_PTR(&espNow, sendWithPolicy(uplinks, 2, frame, UPLINK_MAX_LATENCY_MS));
+  TEST_ASSERT_EQUAL_PTR(&espNow, sendWithPolicy(uplinks, 2, frame, UPLINK_MAX_LATENCY_MS));
+  TEST_ASSERT_EQUAL_UINT32(UPLINK_MAX_FAILURES + 2, espNow.attempts);
+}
+// TESTS END =================================================================================================================================================
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_cheapest_first);
+  RUN_TEST(test_cost_follows_payload_size);
+  RUN_TEST(test_tie_goes_to_faster_link);
+  RUN_TEST(test_failover);
+  RUN_TEST(test_latency_budget);
+  RUN_TEST(test_unhealthy_uplink_probed_again);
+  return UNITY_END();
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <openssl/ssl.h>
+#include "spool.h"
+
+struct BridgeConfig {
+  uint16_t mqttPort = 1883;                                                                                      // Plain MQTT from the sensors, 0 to disable
+  uint16_t pskPort = 8884;                                                                                       // MQTT over TLS-PSK, needs "pskFile"
+  uint16_t snPort = 1884;                                                                                        // MQTT-SN over UDP
+  uint16_t snTopicId = 1;                                                                                        // MQTTSN_TOPIC_ID of the sensors
+  std::string pskFile;                                                                                           // "identity:hexkey" lines, same format as tools/mosquitto_psk_file.txt.example
+  std::string spoolDir = ".";
+  uint64_t spoolMaxBytes = 1ULL << 30;
+  std::string upstreamHost = "srv-iot.diatel.upm.es";
+  uint16_t upstreamPort = 8883;
+  std::string token;                                                                                             // Access token of the ThingsBoard gateway device
+  std::string caFile;                                                                                            // System trust store when empty
+  std::string deviceName = "soil_quality_sensor_%d";                                                             // GATEWAY_DEVICE_NAME, applied to the "treeId" of each sample
+  size_t batchBytes = 32 * 1024;                                                                                 // Publish as soon as this much is waiting...
+  uint32_t flushMs = 1000;                                                                                       // ...or at least this often while anything is
+  uint32_t statsS = 10;
+};
+
+struct BridgeStats {
+  uint64_t samplesIn = 0;
+  uint64_t samplesOut = 0;                                                                                       // Acknowledged by ThingsBoard
+  uint64_t batchesOut = 0;
+  uint64_t bytesOut = 0;
+  uint64_t rejected = 0;                                                                                         // Malformed, or refused because the spool is full
+  uint32_t clients = 0;                                                                                          // MQTT connections plus MQTT-SN clients seen within their keep-alive
+};
+
+extern BridgeConfig config;
+extern BridgeStats stats;
+extern Spool spool;
+
+// EVENT LOOP: EVERY FILE DESCRIPTOR IN EPOLL POINTS TO THE ENDPOINT THAT HANDLES IT
+class Endpoint {
+  public:
+    virtual ~Endpoint() {}
+    virtual void onEvent(uint32_t events) = 0;
+};
+
+bool loopAdd(int fd, uint32_t events, Endpoint* endpoint);
+void loopMod(int fd, uint32_t events, Endpoint* endpoint);
+void loopDel(int fd);
+void loopDefer(Endpoint* endpoint);                                                                              // Deleted once the current batch of events is handled
+void loopReap();
+
+// LINK: NONBLOCKING TCP SOCKET, OPTIONALLY WRAPPED IN TLS
+struct Link {
+  int fd = -1;
+  SSL* ssl = NULL;
+  bool established = false;                                                                                      // Handshake done, always true for plain TCP
+  bool wantWrite = false;                                                                                        // TLS needs the socket writable to make progress
+  uint32_t watched = 0;                                                                                          // Events currently registered in epoll
+  std::string in;
+  std::string out;
+};
+
+bool linkRead(Link& link);
+bool linkFlush(Link& link);
+void linkWatch(Link& link, Endpoint* endpoint);
+void linkClose(Link& link);
+bool setNonBlocking(int fd);
+
+uint64_t nowMs();
+uint64_t epochMs();
+
+// SAMPLES
+bool acceptSample(const std::string& device, uint64_t tsMs, const std::string& values);
+bool acceptTelemetry(const std::string& fallbackDevice, const std::string& payload);
+
+// LISTENERS AND UPSTREAM
+bool startListeners();
+void listenersTick(uint64_t now);
+
+bool upstreamStart();
+void upstreamTick(uint64_t now);
+void upstreamKick();
+void upstreamAttributes(const std::string& device, const std::string& attributes);
+const char* upstreamState();
@@ -0,0 +1,554 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <openssl/err.h>
+#include "bridge.h"
+#include "mqttPacket.h"
+#include "mqttSnUtils.h"
+#include "frameUtils.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+#define TOPIC_TELEMETRY "v1/devices/me/telemetry"                                                                // MQTT_TOPIC_PUB, what the sensors publish on when talking to ThingsBoard directly
+#define TOPIC_ATTRIBUTES "v1/devices/me/attributes"                                                              // MQTT_TOPIC_ATTRIBUTES, their "treeId" names the device and they are forwarded as they are
+#define SENSORS_FILE "/sensors.tsv"                                                                              // In the spool directory, one "sensor<TAB>device<TAB>attributes" line each
+#define MAX_SAMPLE_BYTES (16 * 1024)
+#define CONNECT_TIMEOUT_MS 10000                                                                                 // Handshake and CONNECT must be done by then
+#define SN_IDLE_MS (10 * 60 * 1000)                                                                              // MQTT-SN clients are forgotten after this long without a datagram, on top of their keep-alive
+#define RC_INVALID_TOPIC 0x02
+#define RC_CONGESTION 0x01
+#define RC_NOT_SUPPORTED 0x03
+
+class Client;
+static std::unordered_set<Client*> clients;
+static std::unordered_map<std::string, std::string> pskKeys;                                                     // Identity to raw key
+struct SensorRecord {
+  std::string device;
+  std::string attributes;                                                                                        // Last client attributes, JSON object
+};
+static std::unordered_map<std::string, SensorRecord> sensors;                                                    // Client id or PSK identity, kept on disk since attributes are only sent when they change
+static SSL_CTX* pskCtx = NULL;
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// SAMPLE INTAKE
+// ===========================================================================================================================================================
+// QUEUE ONE SAMPLE FOR THINGSBOARD, "values" BEING A JSON OBJECT OF TELEMETRY KEYS
+bool acceptSample(const std::string& device, uint64_t tsMs, const std::string& values) {
+  if (values.size() > MAX_SAMPLE_BYTES || !spool.append(device, tsMs, values)) {
+    stats.rejected++;
+    return false;
+  }
+  stats.samplesIn++;
+  upstreamKick();
+  return true;
+}
+
+// DEVICE NAME FROM THE "treeId" KEY OF A JSON OBJECT, THE SAME WAY THE ESP-NOW GATEWAY NAMES IT
+static bool treeDevice(const std::string& json, std::string& device) {
+  size_t tree = json.find("\"treeId\":");
+  if (tree == std::string::npos) return false;
+
+  char name[64];
+  snprintf(name, sizeof(name), config.deviceName.c_str(), atoi(json.c_str() + tree + 9));
+  device = name;
+  return true;
+}
+
+// A JSON OBJECT ON ONE LINE WITHOUT SURROUNDING BLANKS, FALSE IF "payload" IS NOT ONE
+static bool oneLineObject(const std::string& payload, std::string& object) {
+  object = payload;
+  for (char& c : object) {
+    if (c == '\n' || c == '\r' || c == '\t') c = ' ';                                                            // JSON whitespace, but the spool is line and tab separated
+  }
+  size_t first = object.find_first_not_of(' ');
+  size_t last = object.find_last_not_of(' ');
+  if (first == std::string::npos || object[first] != '{' || object[last] != '}') return false;
+  object = object.substr(first, last - first + 1);
+  return true;
+}
+
+// A TELEMETRY PAYLOAD AS ThingsBoard TAKES IT: {"key":value,...} OR {"ts":...,"values":{...}}
+// THE DEVICE IS NAMED AFTER ITS "treeId" (OLDER FIRMWARE SENT IT WITH EVERY SAMPLE), OR "fallbackDevice" WITHOUT ONE
+bool acceptTelemetry(const std::string& fallbackDevice, const std::string& payload) {
+  std::string values;
+  uint64_t tsMs = 0;
+
+  if (!oneLineObject(payload, values)) {
+    stats.rejected++;
+    return false;
+  }
+
+  if (values.compare(0, 6, "{\"ts\":") == 0) {
+    size_t inner = values.find("\"values\":");
+    if (inner == std::string::npos) {
+      stats.rejected++;
+      return false;
+    }
+    tsMs = strtoull(values.c_str() + 6, NULL, 10);
+    values = values.substr(inner + 9, values.size() - inner - 10);
+  }
+  if (tsMs == 0) tsMs = epochMs();                                                                               // Reception time, so samples spooled during an outage keep their own time in ThingsBoard
+
+  std::string device(fallbackDevice);
+  treeDevice(values, device);
+  return acceptSample(device, tsMs, values);
+}
+
+// REWRITE THE SENSOR TABLE, THROUGH A TEMPORARY FILE SO A CRASH LEAVES EITHER THE OLD OR THE NEW ONE
+static void saveSensors() {
+  std::string path = config.spoolDir + SENSORS_FILE;
+  std::string tmp = path + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "w");
+  if (f == NULL) {
+    perror(tmp.c_str());
+    return;
+  }
+  for (const auto& entry : sensors) {
+    fprintf(f, "%s\t%s\t%s\n", Spool::sanitize(entry.first).c_str(), entry.second.device.c_str(), entry.second.attributes.c_str());
+  }
+  if (fflush(f) != 0 || fsync(fileno(f)) != 0 || fclose(f) != 0 || rename(tmp.c_str(), path.c_str()) != 0) perror(path.c_str());
+}
+
+// THE TABLE AS THE LAST RUN LEFT IT. THE ATTRIBUTES ARE FORWARDED AGAIN, ThingsBoard MAY NOT HAVE ACKNOWLEDGED THEM BEFORE THE RESTART
+static void loadSensors() {
+  std::string path = config.spoolDir + SENSORS_FILE;
+  FILE* f = fopen(path.c_str(), "r");
+  char line[MAX_SAMPLE_BYTES + 256];
+  if (f == NULL) return;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char* device = strchr(line, '\t');
+    char* attributes = device != NULL ? strchr(device + 1, '\t') : NULL;
+    if (attributes == NULL) continue;
+    *device++ = '\0';
+    *attributes++ = '\0';
+    attributes[strcspn(attributes, "\n")] = '\0';
+
+    SensorRecord& record = sensors[line];
+    record.device = device;
+    record.attributes = attributes;
+    if (!record.attributes.empty()) upstreamAttributes(record.device, record.attributes);
+  }
+  fclose(f);
+  fprintf(stderr, "%s: %zu sensors known\n", path.c_str(), sensors.size());
+}
+
+// CLIENT ATTRIBUTES OF "sensor": THEIR "treeId" NAMES ITS DEVICE FROM NOW ON, AND THEY GO TO ThingsBoard AS THE DEVICE'S CLIENT ATTRIBUTES
+static bool acceptAttributes(const std::string& sensor, const std::string& payload) {
+  std::string attributes;
+  if (payload.size() > MAX_SAMPLE_BYTES || !oneLineObject(payload, attributes) || !Spool::validValues(attributes)) {
+    stats.rejected++;
+    return false;
+  }
+
+  SensorRecord& record = sensors[sensor];
+  std::string device(record.device.empty() ? sensor : record.device);
+  treeDevice(attributes, device);
+  record.device = Spool::sanitize(device);
+  record.attributes = attributes;
+  saveSensors();
+  upstreamAttributes(record.device, record.attributes);
+  return true;
+}
+// SAMPLE INTAKE END =========================================================================================================================================
+
+// ===========================================================================================================================================================
+// MQTT CLIENTS
+// ===========================================================================================================================================================
+// ONE SENSOR CONNECTION, PLAIN OR TLS-PSK. ONLY TELEMETRY PUBLICATIONS ARE TAKEN, SUBSCRIPTIONS ARE REFUSED
+class Client : public Endpoint {
+  public:
+    Client(int fd, SSL* ssl) {
+      link.fd = fd;
+      link.ssl = ssl;
+      link.established = ssl == NULL;
+      lastMs = nowMs();
+      clients.insert(this);
+    }
+    ~Client() override { clients.erase(this); }
+
+    void onEvent(uint32_t events) override;
+    void close();
+    bool idle(uint64_t now) const;
+
+    Link link;
+
+  private:
+    bool handlePacket(uint8_t header, const uint8_t* body, size_t len);
+
+    std::string clientId;
+    bool connected = false;
+    uint16_t keepAliveS = 0;
+    uint64_t lastMs;
+};
+
+void Client::close() {
+  if (link.fd < 0) return;
+  linkClose(link);
+  loopDefer(this);
+}
+
+// NO CONNECT IN TIME, OR SILENT FOR 1.5 TIMES ITS KEEP-ALIVE AS MQTT PRESCRIBES
+bool Client::idle(uint64_t now) const {
+  if (!connected) return now - lastMs > CONNECT_TIMEOUT_MS;
+  return keepAliveS != 0 && now - lastMs > keepAliveS * 1500ULL;
+}
+
+void Client::onEvent(uint32_t events) {
+  if (events & (EPOLLERR | EPOLLHUP)) {
+    close();
+    return;
+  }
+  bool open = linkRead(link);
+  lastMs = nowMs();
+
+  for (;;) {
+    size_t bodyOffset;
+    long len = mqttFrame(link.in, &bodyOffset);
+    if (len == 0) break;
+    if (len < 0 || !handlePacket((uint8_t)link.in[0], (const uint8_t*)link.in.data() + bodyOffset, len - bodyOffset)) {
+      linkFlush(link);                                                                                           // A CONNACK refusal should still reach the sensor
+      close();
+      return;
+    }
+    link.in.erase(0, len);
+  }
+
+  if (!open || !linkFlush(link)) {
+    close();
+    return;
+  }
+  linkWatch(link, this);
+}
+
+// FALSE TO DROP THE CONNECTION
+bool Client::handlePacket(uint8_t header, const uint8_t* body, size_t len) {
+  uint8_t type = header & 0xF0;
+
+  if (!connected && type != (MQTT_CONNECT & 0xF0)) return false;
+  switch (type) {
+    case MQTT_CONNECT & 0xF0: {
+      std::string username;
+      if (connected || !mqttParseConnect(body, len, clientId, username, keepAliveS)) return false;
+      connected = true;                                                                                          // Any token is accepted: the bridge is on the local network, ThingsBoard only knows the gateway token
+      link.out += mqttConnack(MQTT_RC_ACCEPTED);
+      return true;
+    }
+
+    case MQTT_PUBLISH & 0xF0: {
+      std::string topic, payload;
+      uint16_t packetId;
+      if (!mqttParsePublish(header, body, len, topic, payload, packetId)) return false;
+      bool taken = true;
+      const char* identity = link.ssl != NULL ? SSL_get_psk_identity(link.ssl) : NULL;
+      std::string sensor(identity != NULL ? identity : clientId);
+      if (topic == TOPIC_TELEMETRY) {
+        auto known = sensors.find(sensor);
+        taken = acceptTelemetry(known != sensors.end() ? known->second.device : sensor, payload);
+      } else if (topic == TOPIC_ATTRIBUTES) {
+        taken = acceptAttributes(sensor, payload);
+      }
+      if (packetId != 0 && taken) link.out += mqttPuback(packetId);                                              // No PUBACK when the spool refused it, the sensor keeps the sample and retries
+      return true;
+    }
+
+    case MQTT_SUBSCRIBE & 0xF0: {
+      uint16_t packetId;
+      size_t topics;
+      if (!mqttParseSubscribe(body, len, packetId, topics)) return false;
+      link.out += mqttSuback(packetId, topics);
+      return true;
+    }
+
+    case MQTT_PINGREQ:
+      link.out += mqttEmpty(MQTT_PINGRESP);
+      return true;
+
+    case MQTT_DISCONNECT:
+      return false;
+
+    default:
+      return true;                                                                                               // PUBACK and the like, nothing is ever sent that needs them
+  }
+}
+// MQTT CLIENTS END ==========================================================================================================================================
+
+// ===========================================================================================================================================================
+// MQTT LISTENER
+// ===========================================================================================================================================================
+class MqttListener : public Endpoint {
+  public:
+    MqttListener(int listenFd, SSL_CTX* sslCtx) : fd(listenFd), ctx(sslCtx) {}
+    void onEvent(uint32_t events) override;
+
+  private:
+    int fd;
+    SSL_CTX* ctx;                                                                                                // NULL for the plain listener
+};
+
+// ACCEPT EVERY PENDING CONNECTION AT ONCE, A FIELD OF SENSORS WAKING TOGETHER ARRIVES IN BURSTS
+void MqttListener::onEvent(uint32_t) {
+  for (;;) {
+    int conn = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (conn < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+      return;
+    }
+    int one = 1;
+    setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    SSL* ssl = NULL;
+    if (ctx != NULL) {
+      ssl = SSL_new(ctx);
+      SSL_set_fd(ssl, conn);
+      SSL_set_accept_state(ssl);
+    }
+    Client* client = new Client(conn, ssl);
+    client->link.watched = EPOLLIN | EPOLLRDHUP;
+    if (!loopAdd(conn, client->link.watched, client)) client->close();
+  }
+}
+
+static unsigned int pskServerCallback(SSL*, const char* identity, unsigned char* psk, unsigned int maxLen) {
+  auto it = pskKeys.find(identity != NULL ? identity : "");
+  if (it == pskKeys.end() || it->second.size() > maxLen) return 0;                                               // Unknown identity: the handshake fails
+  memcpy(psk, it->second.data(), it->second.size());
+  return (unsigned int)it->second.size();
+}
+
+// SAME FILE FORMAT AS MOSQUITTO'S "psk_file", SO ONE FILE CAN SERVE BOTH
+static bool loadPskFile(const std::string& path) {
+  FILE* f = fopen(path.c_str(), "r");
+  char line[512];
+  if (f == NULL) return false;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char* colon = strchr(line, ':');
+    if (line[0] == '#' || colon == NULL) continue;
+    *colon = '\0';
+    std::string key;
+    for (char* p = colon + 1; isxdigit((unsigned char)p[0]) && isxdigit((unsigned char)p[1]); p += 2) {
+      char byte[3] = {p[0], p[1], '\0'};
+      key += (char)strtol(byte, NULL, 16);
+    }
+    if (!key.empty()) pskKeys[line] = key;
+  }
+  fclose(f);
+  return !pskKeys.empty();
+}
+
+// TLS 1.2 WITH THE SAME PSK SUITES AS tools/mosquitto_psk.conf, WHAT THE SENSORS' TLS_PSK MODE OFFERS
+static SSL_CTX* createPskContext() {
+  SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+  if (ctx == NULL) return NULL;
+  SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+  SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+  SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+  if (SSL_CTX_set_cipher_list(ctx, "PSK-AES128-GCM-SHA256:PSK-AES128-CBC-SHA256:ECDHE-PSK-AES128-CBC-SHA256") != 1) {
+    SSL_CTX_free(ctx);
+    return NULL;
+  }
+  SSL_CTX_use_psk_identity_hint(ctx, "soil-quality-sensors");
+  SSL_CTX_set_psk_server_callback(ctx, pskServerCallback);
+  return ctx;
+}
+// MQTT LISTENER END =========================================================================================================================================
+
+// ===========================================================================================================================================================
+// MQTT-SN LISTENER
+// ===========================================================================================================================================================
+struct SnClient {
+  bool connected;
+  uint16_t keepAliveS;
+  uint16_t lastMsgId;                                                                                            // A retried PUBLISH is acknowledged again but not queued twice
+  uint64_t lastMs;
+};
+
+// ALL MQTT-SN SENSORS SHARE ONE UDP SOCKET, THEY ARE TOLD APART BY ADDRESS AND PORT
+class SnListener : public Endpoint {
+  public:
+    SnListener(int socketFd) : fd(socketFd) {}
+    void onEvent(uint32_t events) override;
+    void expire(uint64_t now);
+    size_t count() const { return snClients.size(); }
+
+  private:
+    void handle(const sockaddr_in& from, const uint8_t* buf, size_t len);
+    void reply(const sockaddr_in& to, const uint8_t* msg, size_t len);
+
+    int fd;
+    std::unordered_map<uint64_t, SnClient> snClients;
+};
+
+static SnListener* snListener = NULL;
+
+static uint64_t snKey(const sockaddr_in& addr) {
+  return ((uint64_t)addr.sin_addr.s_addr << 16) | addr.sin_port;
+}
+
+void SnListener::reply(const sockaddr_in& to, const uint8_t* msg, size_t len) {
+  if (len > 0) sendto(fd, msg, len, 0, (const sockaddr*)&to, sizeof(to));                                        // Lost if the socket buffer is full, the sensor retries
+}
+
+void SnListener::onEvent(uint32_t) {
+  uint8_t buf[1024];
+  for (;;) {
+    sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    ssize_t len = recvfrom(fd, buf, sizeof(buf), 0, (sockaddr*)&from, &fromLen);
+    if (len < 0 && errno == EINTR) continue;
+    if (len < 0) return;
+    handle(from, buf, (size_t)len);
+  }
+}
+
+// SAME DIALOGUE AS tools/mqttsn_gateway.cpp, WITH THE SAMPLES QUEUED FOR THINGSBOARD INSTEAD OF PRINTED
+void SnListener::handle(const sockaddr_in& from, const uint8_t* buf, size_t len) {
+  uint8_t out[16];
+  uint8_t type, flags;
+  uint16_t topic, msgId;
+  const uint8_t* data;
+  size_t dataLen;
+  SampleFrame frame;
+  char json[FRAME_JSON_MAX];
+
+  if (mqttSnParse(buf, len, &type) == 0) {
+    stats.rejected++;
+    return;
+  }
+
+  uint64_t key = snKey(from);
+  auto it = snClients.find(key);
+  if (it != snClients.end()) it->second.lastMs = nowMs();
+
+  switch (type) {
+    case MQTTSN_CONNECT:
+      if (len < 6) return;
+      snClients[key] = {true, (uint16_t)((buf[4] << 8) | buf[5]), 0, nowMs()};
+      reply(from, out, mqttSnConnack(out, sizeof(out), MQTTSN_RC_ACCEPTED));
+      return;
+
+    case MQTTSN_PUBLISH: {
+      if (!mqttSnParsePublish(buf, len, &flags, &topic, &msgId, &data, &dataLen)) return;
+      uint8_t qos = flags & MQTTSN_FLAG_QOS_M1;
+      bool confirmed = qos == MQTTSN_FLAG_QOS_1;
+      SnClient* client = it != snClients.end() ? &it->second : NULL;
+      if (qos != MQTTSN_FLAG_QOS_M1 && (client == NULL || !client->connected)) return;                           // QoS 0 and 1 need a CONNECT first
+      if (confirmed && msgId == client->lastMsgId) {                                                             // Our PUBACK was lost, the sensor sent it again
+        reply(from, out, mqttSnPuback(out, sizeof(out), topic, msgId, MQTTSN_RC_ACCEPTED));
+        return;
+      }
+
+      uint8_t rc = MQTTSN_RC_ACCEPTED;
+      if (topic != config.snTopicId) {
+        rc = RC_INVALID_TOPIC;
+      } else if (!decodeFrame(data, dataLen, frame)) {
+        rc = RC_NOT_SUPPORTED;
+        stats.rejected++;
+      } else {
+        char device[64];
+        formatFrameJson(json, sizeof(json), frame);
+        snprintf(device, sizeof(device), config.deviceName.c_str(), frame.treeId);
+        uint64_t tsMs = frame.tsMs != 0 ? frame.tsMs : epochMs();                                                // Reception time for a node whose clock was never set
+        if (!acceptSample(device, tsMs, json)) rc = RC_CONGESTION;                                               // Spool full: the sensor keeps the sample for its next wake
+      }
+      if (!confirmed) return;
+      if (rc == MQTTSN_RC_ACCEPTED) client->lastMsgId = msgId;
+      reply(from, out, mqttSnPuback(out, sizeof(out), topic, msgId, rc));
+      return;
+    }
+
+    case MQTTSN_DISCONNECT:
+      snClients.erase(key);
+      reply(from, out, mqttSnDisconnect(out, sizeof(out)));
+      return;
+
+    default:
+      return;
+  }
+}
+
+void SnListener::expire(uint64_t now) {
+  for (auto it = snClients.begin(); it != snClients.end();) {
+    if (now - it->second.lastMs > it->second.keepAliveS * 1500ULL + SN_IDLE_MS) it = snClients.erase(it);
+    else ++it;
+  }
+}
+// MQTT-SN LISTENER END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// SETUP FUNCTIONS
+// ===========================================================================================================================================================
+static int openSocket(int type, uint16_t port) {
+  int fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  int one = 1;
+  sockaddr_in addr = {};
+
+  if (fd < 0) return -1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd, (const sockaddr*)&addr, sizeof(addr)) != 0 || (type == SOCK_STREAM && listen(fd, SOMAXCONN) != 0)) {
+    fprintf(stderr, "port %u: %s\n", port, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool startListeners() {
+  loadSensors();
+  if (config.mqttPort != 0) {
+    int fd = openSocket(SOCK_STREAM, config.mqttPort);
+    if (fd < 0 || !loopAdd(fd, EPOLLIN, new MqttListener(fd, NULL))) return false;
+  }
+
+  if (config.pskPort != 0 && !config.pskFile.empty()) {
+    if (!loadPskFile(config.pskFile) || (pskCtx = createPskContext()) == NULL) {
+      fprintf(stderr, "%s: no usable PSK\n", config.pskFile.c_str());
+      return false;
+    }
+    int fd = openSocket(SOCK_STREAM, config.pskPort);
+    if (fd < 0 || !loopAdd(fd, EPOLLIN, new MqttListener(fd, pskCtx))) return false;
+  }
+
+  if (config.snPort != 0) {
+    int fd = openSocket(SOCK_DGRAM, config.snPort);
+    int size = 4 * 1024 * 1024;                                                                                  // Room for a burst of datagrams while the loop is busy elsewhere
+    if (fd < 0) return false;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    snListener = new SnListener(fd);
+    if (!loopAdd(fd, EPOLLIN, snListener)) return false;
+  }
+  return true;
+}
+
+// DROP DEAD CONNECTIONS AND FORGOTTEN MQTT-SN CLIENTS, AND COUNT THE LIVE ONES
+void listenersTick(uint64_t now) {
+  for (auto it = clients.begin(); it != clients.end();) {
+    Client* client = *it++;                                                                                      // "close()" does not erase, but step first anyway
+    if (client->idle(now)) client->close();
+  }
+  if (snListener != NULL) snListener->expire(now);
+  stats.clients = (uint32_t)(clients.size() + (snListener != NULL ? snListener->count() : 0));
+}
+// SETUP FUNCTIONS END =======================================================================================================================================
@@ -0,0 +1,217 @@
+// Edge bridge for the soil quality sensors: runs on a Linux box in the field and takes the sensors' traffic locally, so they
+// never have to reach srv-iot.diatel.upm.es over TLS themselves:
+//
+//   plain MQTT     on --mqtt-port (1883)  v1/devices/me/telemetry, as ROLE_NODE publishes it with MQTT_SERVER pointed here
+//   MQTT over PSK  on --psk-port (8884)   the same, with TLS_PSK and the keys of --psk-file (tools/mosquitto_psk_file.txt.example)
+//   MQTT-SN        on --sn-port (1884)    binary sample frames, MqttSnUplink with MQTTSN_GATEWAY pointed here
+//
+// Every sample is appended to a disk spool first and acknowledged to the sensor, then forwarded in batches through a single
+// persistent TLS connection using the ThingsBoard gateway API (v1/gateway/telemetry, one device per "treeId"). A batch only
+// leaves the spool once ThingsBoard has acknowledged it, so outages and restarts lose nothing. Once --spool-max-mb is waiting,
+// new samples are refused: MQTT-SN QoS 1 and MQTT QoS 1 senders are told and retry later, but the firmware publishes MQTT at
+// QoS 0 (PubSubClient), so those samples are lost on the bridge. Size the spool for the longest outage to ride out.
+//
+//   make && ./edge_bridge --token <gateway access token> --spool /var/lib/edge_bridge --psk-file psk_file.txt
+//
+// A single thread serves thousands of sensors through epoll. Throughput and queue depth are printed every --stats seconds.
+
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <openssl/ssl.h>
+#include "bridge.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+#define TICK_MS 100
+#define MAX_EVENTS 256
+
+BridgeConfig config;
+BridgeStats stats;
+Spool spool;
+
+extern int epollFd;
+static bool running = true;
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+static void usage(const char* name) {
+  fprintf(stderr,
+          "usage: %s --token TOKEN [options]\n"
+          "  --mqtt-port N       plain MQTT listener, 0 to disable (1883)\n"
+          "  --psk-port N        MQTT over TLS-PSK listener, needs --psk-file (8884)\n"
+          "  --psk-file PATH     identity:hexkey lines\n"
+          "  --sn-port N         MQTT-SN listener, 0 to disable (1884)\n"
+          "  --sn-topic N        predefined MQTT-SN topic id of the sensors (1)\n"
+          "  --spool DIR         spool directory (.)\n"
+          "  --spool-max-mb N    refuse samples once this much is waiting, QoS 0 ones are lost (1024)\n"
+          "  --upstream HOST:PORT  ThingsBoard MQTT over TLS (srv-iot.diatel.upm.es:8883)\n"
+          "  --ca-file PATH      trusted CAs, the system store by default\n"
+          "  --device-name FMT   device name from the treeId (soil_quality_sensor_%%d)\n"
+          "  --batch-bytes N     publish once this much is waiting (32768)\n"
+          "  --flush-ms N        ...or at least this often (1000)\n"
+          "  --stats N           seconds between two statistics lines (10)\n",
+          name);
+}
+
+static bool parseOptions(int argc, char** argv) {
+  static const option options[] = {
+    {"mqtt-port", required_argument, NULL, 'm'},   {"psk-port", required_argument, NULL, 'p'},
+    {"psk-file", required_argument, NULL, 'k'},    {"sn-port", required_argument, NULL, 'n'},
+    {"sn-topic", required_argument, NULL, 'i'},    {"spool", required_argument, NULL, 's'},
+    {"spool-max-mb", required_argument, NULL, 'x'}, {"upstream", required_argument, NULL, 'u'},
+    {"token", required_argument, NULL, 't'},       {"ca-file", required_argument, NULL, 'c'},
+    {"device-name", required_argument, NULL, 'd'}, {"batch-bytes", required_argument, NULL, 'b'},
+    {"flush-ms", required_argument, NULL, 'f'},    {"stats", required_argument, NULL, 'S'},
+    {NULL, 0, NULL, 0}};
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    switch (opt) {
+      case 'm': config.mqttPort = (uint16_t)atoi(optarg); break;
+      case 'p': config.pskPort = (uint16_t)atoi(optarg); break;
+      case 'k': config.pskFile = optarg; break;
+      case 'n': config.snPort = (uint16_t)atoi(optarg); break;
+      case 'i': config.snTopicId = (uint16_t)atoi(optarg); break;
+      case 's': config.spoolDir = optarg; break;
+      case 'x': config.spoolMaxBytes = strtoull(optarg, NULL, 10) * 1024 * 1024; break;
+      case 't': config.token = optarg; break;
+      case 'c': config.caFile = optarg; break;
+      case 'd': config.deviceName = optarg; break;
+      case 'b': config.batchBytes = strtoul(optarg, NULL, 10); break;
+      case 'f': config.flushMs = strtoul(optarg, NULL, 10); break;
+      case 'S': config.statsS = strtoul(optarg, NULL, 10); break;
+      case 'u': {
+        std::string upstream(optarg);
+        size_t colon = upstream.rfind(':');
+        config.upstreamHost = upstream.substr(0, colon);
+        if (colon != std::string::npos) config.upstreamPort = (uint16_t)atoi(upstream.c_str() + colon + 1);
+        break;
+      }
+      default: return false;
+    }
+  }
+  return !config.token.empty() && config.batchBytes > 0 && config.statsS > 0;
+}
+
+// ONE DESCRIPTOR PER TCP SENSOR, SO THE DEFAULT SOFT LIMIT OF 1024 WOULD BE THE FIRST BOTTLENECK
+static void raiseFileLimit() {
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == limit.rlim_max) return;
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+// THROUGHPUT OVER THE LAST PERIOD AND WHAT IS STILL WAITING
+static void printStats(double seconds) {
+  static BridgeStats last;
+  fprintf(stderr, "in %.1f samples/s, out %.1f samples/s in %.2f batches/s (%.1f kB/s), queue %zu samples / %.1f kB, "
+                  "%u clients, %llu rejected, upstream %s\n",
+          (stats.samplesIn - last.samplesIn) / seconds, (stats.samplesOut - last.samplesOut) / seconds,
+          (stats.batchesOut - last.batchesOut) / seconds, (stats.bytesOut - last.bytesOut) / seconds / 1024.0,
+          spool.depth(), spool.pendingBytes() / 1024.0, stats.clients, (unsigned long long)stats.rejected, upstreamState());
+  last = stats;
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// LOOP ENDPOINTS
+// ===========================================================================================================================================================
+// PERIODIC WORK: TIMEOUTS, BATCH FLUSHES, SPOOL SYNC AND STATISTICS
+class Ticker : public Endpoint {
+  public:
+    Ticker(int timerFd) : fd(timerFd) {}
+    void onEvent(uint32_t) override {
+      uint64_t expirations;
+      if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) return;
+
+      uint64_t now = nowMs();
+      listenersTick(now);
+      upstreamTick(now);
+      if (now - lastSyncMs >= 1000) {
+        spool.sync();
+        lastSyncMs = now;
+      }
+      if (now - lastStatsMs >= config.statsS * 1000ULL) {
+        printStats((now - lastStatsMs) / 1000.0);
+        lastStatsMs = now;
+      }
+    }
+
+  private:
+    int fd;
+    uint64_t lastSyncMs = nowMs();
+    uint64_t lastStatsMs = nowMs();
+};
+
+class Signals : public Endpoint {
+  public:
+    Signals(int signalFd) : fd(signalFd) {}
+    void onEvent(uint32_t) override {
+      signalfd_siginfo info;
+      if (read(fd, &info, sizeof(info)) == sizeof(info)) running = false;
+    }
+
+  private:
+    int fd;
+};
+// LOOP ENDPOINTS END ========================================================================================================================================
+
+// ===========================================================================================================================================================
+// MAIN
+// ===========================================================================================================================================================
+int main(int argc, char** argv) {
+  if (!parseOptions(argc, argv)) {
+    usage(argv[0]);
+    return 2;
+  }
+  signal(SIGPIPE, SIG_IGN);                                                                                      // A sensor going away mid-write must not kill the bridge
+  raiseFileLimit();
+
+  if (!spool.open(config.spoolDir, config.spoolMaxBytes)) {
+    perror(config.spoolDir.c_str());
+    return 1;
+  }
+  fprintf(stderr, "spool %s: %zu samples waiting\n", config.spoolDir.c_str(), spool.depth());
+
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd < 0 || !startListeners() || !upstreamStart()) return 1;
+
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  sigprocmask(SIG_BLOCK, &mask, NULL);
+  int sigFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  loopAdd(sigFd, EPOLLIN, new Signals(sigFd));
+
+  int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  itimerspec tick = {{0, TICK_MS * 1000000L}, {0, TICK_MS * 1000000L}};
+  timerfd_settime(timerFd, 0, &tick, NULL);
+  loopAdd(timerFd, EPOLLIN, new Ticker(timerFd));
+
+  epoll_event events[MAX_EVENTS];
+  while (running) {
+    int n = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+    for (int i = 0; i < n; i++) static_cast<Endpoint*>(events[i].data.ptr)->onEvent(events[i].events);
+    loopReap();
+  }
+
+  spool.sync();                                                                                                  // Whatever is still waiting goes out after the restart
+  fprintf(stderr, "stopped, %zu samples left in the spool\n", spool.depth());
+  return 0;
+}
+// MAIN END ==================================================================================================================================================
@@ -0,0 +1,176 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include "mqttPacket.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+static void put16(std::string& out, uint16_t v) {
+  out += (char)(v >> 8);
+  out += (char)(v & 0xFF);
+}
+
+static uint16_t get16(const uint8_t* p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static void putString(std::string& out, const std::string& s) {
+  put16(out, (uint16_t)s.size());
+  out += s;
+}
+
+// READ A LENGTH-PREFIXED STRING AT "*pos", ADVANCING IT. FALSE IF IT RUNS PAST THE BODY
+static bool getString(const uint8_t* body, size_t len, size_t* pos, std::string& s) {
+  if (*pos + 2 > len) return false;
+  size_t n = get16(body + *pos);
+  if (*pos + 2 + n > len) return false;
+  s.assign((const char*)body + *pos + 2, n);
+  *pos += 2 + n;
+  return true;
+}
+
+// FIXED HEADER: TYPE AND FLAGS, THEN THE REMAINING LENGTH AS A VARIABLE LENGTH INTEGER
+static std::string packet(uint8_t type, const std::string& body) {
+  std::string out(1, (char)type);
+  size_t len = body.size();
+  do {
+    uint8_t digit = len % 128;
+    len /= 128;
+    if (len > 0) digit |= 0x80;
+    out += (char)digit;
+  } while (len > 0);
+  return out + body;
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// FRAMING
+// ===========================================================================================================================================================
+// LENGTH OF THE FIRST PACKET IN "buf" IF IT IS COMPLETE, 0 IF MORE BYTES ARE NEEDED, -1 IF IT IS MALFORMED OR TOO LARGE
+long mqttFrame(const std::string& buf, size_t* bodyOffset) {
+  size_t len = 0;
+  size_t multiplier = 1;
+
+  for (size_t i = 1; i < 5; i++) {
+    if (i >= buf.size()) return 0;
+    uint8_t digit = (uint8_t)buf[i];
+    len += (digit & 0x7F) * multiplier;
+    multiplier *= 128;
+    if (!(digit & 0x80)) {
+      if (len > MQTT_MAX_PACKET) return -1;
+      *bodyOffset = i + 1;
+      return buf.size() < i + 1 + len ? 0 : (long)(i + 1 + len);
+    }
+  }
+  return -1;                                                                                                     // More than 4 length bytes
+}
+// FRAMING END ===============================================================================================================================================
+
+// ===========================================================================================================================================================
+// ENCODE FUNCTIONS
+// ===========================================================================================================================================================
+// CLEAN SESSION, USER NAME ONLY: THINGSBOARD TAKES THE ACCESS TOKEN AS THE USER NAME
+std::string mqttConnect(const std::string& clientId, const std::string& username, uint16_t keepAliveS) {
+  std::string body;
+  putString(body, "MQTT");
+  body += (char)0x04;                                                                                            // Protocol level 3.1.1
+  body += (char)(0x02 | (username.empty() ? 0 : 0x80));
+  put16(body, keepAliveS);
+  putString(body, clientId);
+  if (!username.empty()) putString(body, username);
+  return packet(MQTT_CONNECT, body);
+}
+
+// QOS 1 WHEN "packetId" IS SET, QOS 0 OTHERWISE
+std::string mqttPublish(const std::string& topic, const std::string& payload, uint16_t packetId) {
+  std::string body;
+  putString(body, topic);
+  if (packetId != 0) put16(body, packetId);
+  body += payload;
+  return packet(MQTT_PUBLISH | (packetId != 0 ? 0x02 : 0x00), body);
+}
+
+std::string mqttConnack(uint8_t returnCode) {
+  std::string body(1, (char)0x00);                                                                               // Session present: never, every session is clean
+  body += (char)returnCode;
+  return packet(MQTT_CONNACK, body);
+}
+
+std::string mqttPuback(uint16_t packetId) {
+  std::string body;
+  put16(body, packetId);
+  return packet(MQTT_PUBACK, body);
+}
+
+// EVERY SUBSCRIPTION IS REFUSED, THE BRIDGE ONLY CARRIES TELEMETRY UPSTREAM
+std::string mqttSuback(uint16_t packetId, size_t topics) {
+  std::string body;
+  put16(body, packetId);
+  body.append(topics, (char)0x80);
+  return packet(MQTT_SUBACK, body);
+}
+
+std::string mqttEmpty(uint8_t type) {
+  return packet(type, std::string());
+}
+// ENCODE FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// PARSE FUNCTIONS
+// ===========================================================================================================================================================
+bool mqttParseConnect(const uint8_t* body, size_t len, std::string& clientId, std::string& username, uint16_t& keepAliveS) {
+  std::string protocol, skip;
+  size_t pos = 0;
+
+  if (!getString(body, len, &pos, protocol) || protocol != "MQTT" || pos + 4 > len) return false;
+  uint8_t flags = body[pos + 1];
+  keepAliveS = get16(body + pos + 2);
+  pos += 4;
+
+  if (!getString(body, len, &pos, clientId)) return false;
+  if (flags & 0x04) {                                                                                            // Will topic and message, accepted but never published
+    if (!getString(body, len, &pos, skip) || !getString(body, len, &pos, skip)) return false;
+  }
+  username.clear();
+  if ((flags & 0x80) && !getString(body, len, &pos, username)) return false;
+  return true;
+}
+
+bool mqttParsePublish(uint8_t header, const uint8_t* body, size_t len, std::string& topic, std::string& payload, uint16_t& packetId) {
+  size_t pos = 0;
+  uint8_t qos = (header >> 1) & 0x03;
+
+  if (qos > 1 || !getString(body, len, &pos, topic)) return false;                                               // QoS 2 is not worth its extra round trip for telemetry
+  packetId = 0;
+  if (qos == 1) {
+    if (pos + 2 > len) return false;
+    packetId = get16(body + pos);
+    pos += 2;
+  }
+  payload.assign((const char*)body + pos, len - pos);
+  return true;
+}
+
+bool mqttParseSubscribe(const uint8_t* body, size_t len, uint16_t& packetId, size_t& topics) {
+  std::string filter;
+  size_t pos = 2;
+
+  if (len < 2) return false;
+  packetId = get16(body);
+  topics = 0;
+  while (pos < len) {
+    if (!getString(body, len, &pos, filter) || pos >= len) return false;
+    pos++;                                                                                                       // Requested QoS
+    topics++;
+  }
+  return topics > 0;
+}
+
+bool mqttParseId(const uint8_t* body, size_t len, uint16_t& packetId) {
+  if (len < 2) return false;
+  packetId = get16(body);
+  return true;
+}
+// PARSE FUNCTIONS END =======================================================================================================================================
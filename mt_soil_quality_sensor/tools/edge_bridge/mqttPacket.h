@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+// MQTT 3.1.1 PACKET TYPES (FIRST BYTE, FLAGS INCLUDED WHERE THEY ARE FIXED)
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBACK 0x40
+#define MQTT_SUBSCRIBE 0x82
+#define MQTT_SUBACK 0x90
+#define MQTT_PINGREQ 0xC0
+#define MQTT_PINGRESP 0xD0
+#define MQTT_DISCONNECT 0xE0
+
+#define MQTT_MAX_PACKET (256 * 1024)                                                                             // Anything larger is treated as a protocol error, sensors send a few hundred bytes
+#define MQTT_RC_ACCEPTED 0x00
+#define MQTT_RC_NOT_AUTHORIZED 0x05
+
+long mqttFrame(const std::string& buf, size_t* bodyOffset);
+
+std::string mqttConnect(const std::string& clientId, const std::string& username, uint16_t keepAliveS);
+std::string mqttPublish(const std::string& topic, const std::string& payload, uint16_t packetId);
+std::string mqttConnack(uint8_t returnCode);
+std::string mqttPuback(uint16_t packetId);
+std::string mqttSuback(uint16_t packetId, size_t topics);
+std::string mqttEmpty(uint8_t type);
+
+bool mqttParseConnect(const uint8_t* body, size_t len, std::string& clientId, std::string& username, uint16_t& keepAliveS);
+bool mqttParsePublish(uint8_t header, const uint8_t* body, size_t len, std::string& topic, std::string& payload, uint16_t& packetId);
+bool mqttParseSubscribe(const uint8_t* body, size_t len, uint16_t& packetId, size_t& topics);
+bool mqttParseId(const uint8_t* body, size_t len, uint16_t& packetId);
@@ -0,0 +1,171 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <vector>
+#include <openssl/err.h>
+#include "bridge.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+#define LINK_MAX_OUT (256 * 1024)                                                                                // A peer that lets this much pile up is too slow to keep
+
+int epollFd = -1;
+static std::vector<Endpoint*> graveyard;
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// EVENT LOOP
+// ===========================================================================================================================================================
+bool loopAdd(int fd, uint32_t events, Endpoint* endpoint) {
+  epoll_event ev = {};
+  ev.events = events;
+  ev.data.ptr = endpoint;
+  return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+void loopMod(int fd, uint32_t events, Endpoint* endpoint) {
+  epoll_event ev = {};
+  ev.events = events;
+  ev.data.ptr = endpoint;
+  epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void loopDel(int fd) {
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+// A LATER EVENT OF THE SAME "epoll_wait()" BATCH MAY STILL POINT TO AN ENDPOINT THAT WAS JUST CLOSED, SO IT IS FREED AFTERWARDS
+void loopDefer(Endpoint* endpoint) {
+  graveyard.push_back(endpoint);
+}
+
+void loopReap() {
+  for (Endpoint* endpoint : graveyard) delete endpoint;
+  graveyard.clear();
+}
+// EVENT LOOP END ============================================================================================================================================
+
+// ===========================================================================================================================================================
+// LINK FUNCTIONS
+// ===========================================================================================================================================================
+bool setNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// FALSE WHEN THE TLS SESSION FAILED FOR GOOD, "wantWrite" TELLS WHICH WAY IT IS WAITING OTHERWISE
+static bool sslRetry(Link& link, int ret) {
+  int err = SSL_get_error(link.ssl, ret);
+  link.wantWrite = err == SSL_ERROR_WANT_WRITE;
+  if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) return true;
+  ERR_clear_error();
+  return false;
+}
+
+// ONE STEP OF THE TLS HANDSHAKE, IN WHICHEVER DIRECTION THE SOCKET IS READY
+static bool handshake(Link& link) {
+  int ret = SSL_do_handshake(link.ssl);
+  if (ret != 1) return sslRetry(link, ret);
+  link.established = true;
+  link.wantWrite = false;
+  return true;
+}
+
+// READ EVERYTHING AVAILABLE INTO "in", DRIVING THE TLS HANDSHAKE FIRST IF NEEDED. FALSE WHEN THE LINK IS CLOSED OR BROKEN
+bool linkRead(Link& link) {
+  char buf[16384];
+
+  if (link.ssl == NULL) {
+    for (;;) {
+      ssize_t n = read(link.fd, buf, sizeof(buf));
+      if (n > 0) {
+        link.in.append(buf, n);
+        continue;
+      }
+      if (n < 0 && errno == EINTR) continue;
+      return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+  }
+
+  if (!link.established) return handshake(link) && (!link.established || linkRead(link));
+  for (;;) {
+    int n = SSL_read(link.ssl, buf, sizeof(buf));
+    if (n > 0) {
+      link.in.append(buf, n);
+      continue;
+    }
+    return sslRetry(link, n);
+  }
+}
+
+// WRITE AS MUCH OF "out" AS THE SOCKET TAKES. FALSE WHEN THE LINK IS BROKEN OR THE PEER IS NOT READING
+bool linkFlush(Link& link) {
+  if (link.out.size() > LINK_MAX_OUT) return false;
+  if (!link.established) return handshake(link);                                                                 // Nothing can be written before the handshake, it also progresses on writability
+
+  while (!link.out.empty()) {
+    ssize_t n;
+    if (link.ssl != NULL) {
+      n = SSL_write(link.ssl, link.out.data(), (int)link.out.size());
+      if (n <= 0) return sslRetry(link, (int)n);
+    } else {
+      n = write(link.fd, link.out.data(), link.out.size());
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    link.out.erase(0, n);
+  }
+  if (link.ssl != NULL) link.wantWrite = false;
+  return true;
+}
+
+// ONLY ASK FOR WRITABILITY WHILE SOMETHING IS WAITING, OTHERWISE A HEALTHY SOCKET WOULD WAKE THE LOOP ALL THE TIME
+void linkWatch(Link& link, Endpoint* endpoint) {
+  uint32_t events = EPOLLIN | EPOLLRDHUP;
+  if (!link.out.empty() || link.wantWrite) events |= EPOLLOUT;
+  if (events == link.watched) return;
+  loopMod(link.fd, events, endpoint);
+  link.watched = events;
+}
+
+void linkClose(Link& link) {
+  if (link.ssl != NULL) {
+    if (link.established) SSL_shutdown(link.ssl);                                                                // Best effort close_notify, the socket is closed right after
+    SSL_free(link.ssl);
+    link.ssl = NULL;
+  }
+  if (link.fd >= 0) {
+    loopDel(link.fd);
+    close(link.fd);
+    link.fd = -1;
+  }
+  link.established = false;
+  link.wantWrite = false;
+  link.watched = 0;
+  link.in.clear();
+  link.out.clear();
+}
+// LINK FUNCTIONS END ========================================================================================================================================
+
+// ===========================================================================================================================================================
+// TIME FUNCTIONS
+// ===========================================================================================================================================================
+uint64_t nowMs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+uint64_t epochMs() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+// TIME FUNCTIONS END ========================================================================================================================================
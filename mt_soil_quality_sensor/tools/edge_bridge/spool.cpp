@@ -0,0 +1,291 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "spool.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+#define SPOOL_COMPACT_BYTES (64ULL * 1024 * 1024)                                                                // Acknowledged bytes at the head of the file before they are reclaimed
+#define SPOOL_READ_CHUNK (64 * 1024)
+#define JSON_MAX_DEPTH 8                                                                                         // Telemetry is flat, a sensor never nests this deep
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// STRICT JSON SYNTAX OF ONE VALUE STARTING AT "p", WHICH IS LEFT PAST IT. NO DECODING, ONLY WHAT THINGSBOARD WOULD REJECT A WHOLE BATCH FOR
+static void skipSpace(const char*& p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+}
+
+static bool jsonValue(const char*& p, const char* end, int depth) {
+  skipSpace(p, end);
+  if (p == end || depth > JSON_MAX_DEPTH) return false;
+
+  if (*p == '"') {
+    for (p++; p < end && *p != '"'; p++) {
+      if ((unsigned char)*p < 0x20) return false;
+      if (*p == '\\' && (++p == end || *p == '\0' || strchr("\"\\/bfnrtu", *p) == NULL)) return false;
+    }
+    if (p == end) return false;
+    p++;
+    return true;
+  }
+  if (*p == '{' || *p == '[') {
+    char close = *p == '{' ? '}' : ']';
+    p++;
+    skipSpace(p, end);
+    if (p < end && *p == close) {
+      p++;
+      return true;
+    }
+    for (;;) {
+      if (close == '}') {
+        skipSpace(p, end);
+        if (p == end || *p != '"' || !jsonValue(p, end, depth + 1)) return false;                                // Key
+        skipSpace(p, end);
+        if (p == end || *p++ != ':') return false;
+      }
+      if (!jsonValue(p, end, depth + 1)) return false;
+      skipSpace(p, end);
+      if (p == end) return false;
+      if (*p == close) {
+        p++;
+        return true;
+      }
+      if (*p++ != ',') return false;
+    }
+  }
+  for (const char* word : {"true", "false", "null"}) {
+    size_t len = strlen(word);
+    if ((size_t)(end - p) >= len && strncmp(p, word, len) == 0) {
+      p += len;
+      return true;
+    }
+  }
+
+  const char* start = p;                                                                                         // Number: -?int(.digits)?([eE][+-]?digits)?
+  if (*p == '-') p++;
+  if (p == end || !isdigit((unsigned char)*p)) return false;
+  if (*p == '0') p++;
+  else while (p < end && isdigit((unsigned char)*p)) p++;
+  if (p < end && *p == '.') {
+    if (++p == end || !isdigit((unsigned char)*p)) return false;
+    while (p < end && isdigit((unsigned char)*p)) p++;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    if (++p < end && (*p == '+' || *p == '-')) p++;
+    if (p == end || !isdigit((unsigned char)*p)) return false;
+    while (p < end && isdigit((unsigned char)*p)) p++;
+  }
+  return p > start;
+}
+
+static bool writeAll(int fd, const char* buf, size_t len, off_t off) {
+  while (len > 0) {
+    ssize_t n = pwrite(fd, buf, len, off);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    buf += n;
+    len -= n;
+    off += n;
+  }
+  return true;
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// SPOOL
+// ===========================================================================================================================================================
+// OPEN OR CREATE THE SPOOL, RESUMING AT THE LAST ACKNOWLEDGED OFFSET AND DROPPING A LINE LEFT HALF-WRITTEN BY A CRASH
+bool Spool::open(const std::string& dir, uint64_t maxBytes) {
+  dataPath = dir + "/spool.dat";
+  offsetPath = dir + "/spool.off";
+  limit = maxBytes;
+
+  dataFd = ::open(dataPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  offsetFd = ::open(offsetPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (dataFd < 0 || offsetFd < 0) return false;
+
+  uint64_t saved = 0;
+  if (pread(offsetFd, &saved, sizeof(saved), 0) != sizeof(saved)) saved = 0;
+  writeOff = lseek(dataFd, 0, SEEK_END);
+  readOff = (off_t)saved > writeOff ? writeOff : (off_t)saved;
+
+  char buf[SPOOL_READ_CHUNK];
+  off_t lastLineEnd = readOff;
+  records = 0;
+  for (off_t off = readOff; off < writeOff;) {
+    ssize_t n = pread(dataFd, buf, sizeof(buf), off);
+    if (n <= 0) break;
+    for (ssize_t i = 0; i < n; i++) {
+      if (buf[i] != '\n') continue;
+      records++;
+      lastLineEnd = off + i + 1;
+    }
+    off += n;
+  }
+  if (lastLineEnd != writeOff) {
+    fprintf(stderr, "spool: dropping %lld bytes of a partial record\n", (long long)(writeOff - lastLineEnd));
+    if (ftruncate(dataFd, lastLineEnd) != 0) return false;
+    writeOff = lastLineEnd;
+  }
+  return true;
+}
+
+// DEVICE NAMES COME FROM THE SENSORS, A TAB OR A NEWLINE WOULD BREAK THE RECORD AND A QUOTE THE JSON
+std::string Spool::sanitize(const std::string& s) {
+  std::string out(s);
+  for (char& c : out) {
+    if ((unsigned char)c < 0x20 || c == '"' || c == '\\') c = '_';
+  }
+  return out;
+}
+
+// TRUE FOR ONE WELL-FORMED JSON OBJECT. THE VALUES ARE SPLICED RAW INTO A BATCH, AND ONE BROKEN SAMPLE WOULD GET THE WHOLE BATCH REFUSED, OVER AND OVER
+bool Spool::validValues(const std::string& values) {
+  const char* p = values.data();
+  const char* end = p + values.size();
+  skipSpace(p, end);
+  if (p == end || *p != '{' || !jsonValue(p, end, 0)) return false;
+  skipSpace(p, end);
+  return p == end;
+}
+
+// QUEUE ONE SAMPLE. WRITTEN TO THE PAGE CACHE ONLY, "sync()" MAKES IT DURABLE ONCE PER TICK.
+// A FULL SPOOL REFUSES NEW SAMPLES RATHER THAN FILL THE DISK: ONLY A QOS 1 SENSOR HEARS OF IT AND RETRIES, A QOS 0 ONE (E.G. PUBSUBCLIENT) LOSES THEM
+bool Spool::append(const std::string& device, uint64_t tsMs, const std::string& values) {
+  if (pendingBytes() >= limit || !validValues(values)) return false;
+
+  std::string line = sanitize(device);
+  line += '\t';
+  line += std::to_string(tsMs);
+  line += '\t';
+  line += values;
+  line += '\n';
+  if (!writeAll(dataFd, line.data(), line.size(), writeOff)) return false;
+
+  writeOff += line.size();
+  records++;
+  dirty = true;
+  return true;
+}
+
+// BUILD A THINGSBOARD GATEWAY PAYLOAD FROM THE OLDEST SAMPLES, {"device":[{"ts":...,"values":{...}},...],...}, UP TO ABOUT "maxBytes"
+// RETURNS THE NUMBER OF SAMPLES IN IT AND WHERE THEY END, NOTHING IS REMOVED UNTIL "commit()"
+size_t Spool::peek(size_t maxBytes, std::string& payload, off_t& endOff) {
+  std::unordered_map<std::string, size_t> index;                                                                 // Device name to its slot in "groups", so each device is listed once
+  std::vector<std::pair<std::string, std::string>> groups;
+  std::string chunk;
+  size_t count = 0;
+  size_t size = 2;
+
+  endOff = readOff;
+  chunk.resize(maxBytes + SPOOL_READ_CHUNK);
+  ssize_t n = pread(dataFd, &chunk[0], chunk.size(), readOff);
+  if (n <= 0) return 0;
+  chunk.resize(n);
+
+  for (size_t pos = 0; pos < chunk.size();) {
+    size_t eol = chunk.find('\n', pos);
+    if (eol == std::string::npos) break;
+    size_t tab1 = chunk.find('\t', pos);
+    size_t tab2 = tab1 == std::string::npos ? tab1 : chunk.find('\t', tab1 + 1);
+    size_t lineLen = eol + 1 - pos;
+
+    if (count > 0 && size + lineLen + 16 > maxBytes) break;                                                      // A single oversized sample still goes alone
+    if (tab2 != std::string::npos && tab2 < eol && validValues(chunk.substr(tab2 + 1, eol - tab2 - 1))) {        // Also checked here for spools written before "append()" validated
+      std::string device = chunk.substr(pos, tab1 - pos);
+      std::string sample = "{\"ts\":" + chunk.substr(tab1 + 1, tab2 - tab1 - 1) + ",\"values\":" + chunk.substr(tab2 + 1, eol - tab2 - 1) + "}";
+      auto it = index.find(device);
+      if (it == index.end()) {
+        index[device] = groups.size();
+        groups.emplace_back(device, sample);
+      } else {
+        groups[it->second].second += "," + sample;
+      }
+      size += lineLen + 16;
+    }
+    count++;                                                                                                     // A corrupt line is counted and skipped, it must not block the queue forever
+    pos = eol + 1;
+    endOff = readOff + pos;
+  }
+
+  payload = "{";
+  for (size_t i = 0; i < groups.size(); i++) {
+    if (i > 0) payload += ",";
+    payload += "\"" + groups[i].first + "\":[" + groups[i].second + "]";
+  }
+  payload += "}";
+  return count;
+}
+
+// THINGSBOARD ACKNOWLEDGED THE SAMPLES UP TO "endOff"
+void Spool::commit(off_t endOff, size_t committed) {
+  readOff = endOff;
+  records = committed > records ? 0 : records - committed;
+
+  if (readOff == writeOff) {                                                                                     // Drained: start the file over, the cheapest compaction there is
+    if (ftruncate(dataFd, 0) == 0) readOff = writeOff = 0;
+  } else if ((uint64_t)readOff >= SPOOL_COMPACT_BYTES && (uint64_t)readOff > pendingBytes()) {
+    compact();
+  }
+  saveOffset();
+}
+
+// COPY THE UNACKNOWLEDGED TAIL TO A NEW FILE AND SWAP IT IN, FOR WHEN THE QUEUE NEVER DRAINS COMPLETELY
+void Spool::compact() {
+  std::string tmpPath = dataPath + ".tmp";
+  int tmpFd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (tmpFd < 0) return;
+
+  char buf[SPOOL_READ_CHUNK];
+  off_t out = 0;
+  for (off_t off = readOff; off < writeOff;) {
+    ssize_t n = pread(dataFd, buf, sizeof(buf), off);
+    if (n <= 0 || !writeAll(tmpFd, buf, n, out)) {
+      ::close(tmpFd);
+      unlink(tmpPath.c_str());
+      return;
+    }
+    off += n;
+    out += n;
+  }
+  uint64_t zero = 0;                                                                                             // Offset first: a crash before the rename then resends acknowledged samples instead of skipping new ones
+  if (fdatasync(tmpFd) != 0 || !writeAll(offsetFd, (const char*)&zero, sizeof(zero), 0) || fdatasync(offsetFd) != 0
+      || rename(tmpPath.c_str(), dataPath.c_str()) != 0) {
+    ::close(tmpFd);
+    unlink(tmpPath.c_str());
+    return;
+  }
+  ::close(dataFd);
+  dataFd = tmpFd;
+  readOff = 0;
+  writeOff = out;
+}
+
+void Spool::saveOffset() {
+  uint64_t off = (uint64_t)readOff;
+  writeAll(offsetFd, (const char*)&off, sizeof(off), 0);
+  dirty = true;
+}
+
+// AT MOST ONE TICK OF SAMPLES CAN BE LOST ON A POWER CUT, A CRASH OF THE BRIDGE ALONE LOSES NOTHING
+void Spool::sync() {
+  if (!dirty) return;
+  fdatasync(dataFd);
+  fdatasync(offsetFd);
+  dirty = false;
+}
+// SPOOL END =================================================================================================================================================
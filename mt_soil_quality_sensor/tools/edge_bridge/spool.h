@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <string>
+
+// APPEND-ONLY DISK QUEUE OF SAMPLES WAITING FOR THINGSBOARD, ONE "device<TAB>ts<TAB>values" LINE EACH
+// "readOff" ONLY MOVES WHEN THINGSBOARD HAS ACKNOWLEDGED A BATCH, SO A RESTART OR A LOST CONNECTION RESENDS IT. ONLY VALID JSON GETS IN, SO A BATCH IS
+// NEVER REFUSED FOR ITS CONTENT AND CANNOT BLOCK THE QUEUE
+class Spool {
+  public:
+    static std::string sanitize(const std::string& device);
+    static bool validValues(const std::string& values);
+    bool open(const std::string& dir, uint64_t maxBytes);
+    bool append(const std::string& device, uint64_t tsMs, const std::string& values);
+    size_t peek(size_t maxBytes, std::string& payload, off_t& endOff);
+    void commit(off_t endOff, size_t records);
+    void sync();
+
+    size_t depth() const { return records; }                                                                     // Samples waiting
+    uint64_t pendingBytes() const { return (uint64_t)(writeOff - readOff); }
+
+  private:
+    void saveOffset();
+    void compact();
+
+    std::string dataPath;
+    std::string offsetPath;
+    int dataFd = -1;
+    int offsetFd = -1;
+    off_t readOff = 0;                                                                                           // First byte not yet acknowledged upstream
+    off_t writeOff = 0;
+    size_t records = 0;
+    uint64_t limit = 0;
+    bool dirty = false;                                                                                          // Appended or committed since the last sync()
+};
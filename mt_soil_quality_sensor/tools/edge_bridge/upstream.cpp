@@ -0,0 +1,315 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+#include "bridge.h"
+#include "mqttPacket.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+#define TOPIC_GATEWAY "v1/gateway/telemetry"                                                                     // MQTT_TOPIC_GATEWAY, payload keyed by device name
+#define TOPIC_GATEWAY_ATTRIBUTES "v1/gateway/attributes"                                                         // Client attributes, also keyed by device name
+#define KEEP_ALIVE_S 60
+#define ACK_TIMEOUT_MS 30000                                                                                     // CONNACK or PUBACK later than this means the connection is dead even if TCP has not noticed
+#define BACKOFF_MIN_MS 1000
+#define BACKOFF_MAX_MS 60000
+
+enum UpstreamState { UP_IDLE, UP_CONNECTING, UP_HANDSHAKE, UP_MQTT, UP_READY };
+static const char* stateNames[] = {"down", "connecting", "tls", "mqtt", "ready"};
+
+class UpstreamEndpoint : public Endpoint {
+  public:
+    void onEvent(uint32_t events) override;
+};
+
+static UpstreamEndpoint endpoint;
+static Link upLink;
+static SSL_CTX* ctx = NULL;
+static UpstreamState state = UP_IDLE;
+static uint64_t retryAtMs = 0;
+static uint64_t backoffMs = BACKOFF_MIN_MS;
+static uint64_t lastTxMs = 0;
+static uint64_t lastRxMs = 0;
+static uint64_t waitSinceMs = 0;                                                                                 // When the CONNECT or the batch in flight was sent
+static uint64_t lastFlushMs = 0;
+static uint16_t nextPacketId = 1;
+
+static bool inFlight = false;                                                                                    // One batch at a time: the spool can only move forward in order
+static uint16_t batchId = 0;
+static off_t batchEnd = 0;
+static size_t batchSamples = 0;
+static size_t batchBytes = 0;
+
+static std::unordered_map<std::string, std::string> attributesPending;                                           // Device to its latest client attributes, not sent yet
+static std::unordered_map<uint16_t, std::pair<std::string, std::string>> attributesInFlight;                     // Packet id to device and attributes, until the PUBACK
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// DROP THE CONNECTION AND RETRY LATER WITH EXPONENTIAL BACKOFF. A BATCH IN FLIGHT STAYS IN THE SPOOL AND IS SENT AGAIN,
+// HARMLESS AS EVERY SAMPLE CARRIES ITS "ts" AND THINGSBOARD STORES THE SAME KEY AND TIME ONLY ONCE
+static void fail(const char* reason) {
+  for (auto& sent : attributesInFlight) attributesPending.emplace(sent.second);                                  // Unless newer ones came in meanwhile
+  attributesInFlight.clear();
+
+  unsigned long err = ERR_peek_last_error();
+  fprintf(stderr, "upstream %s:%u: %s%s%s\n", config.upstreamHost.c_str(), config.upstreamPort, reason,
+          err != 0 ? ", " : "", err != 0 ? ERR_reason_error_string(err) : "");
+  ERR_clear_error();
+
+  linkClose(upLink);
+  state = UP_IDLE;
+  inFlight = false;
+  retryAtMs = nowMs() + backoffMs;
+  backoffMs = backoffMs * 2 > BACKOFF_MAX_MS ? BACKOFF_MAX_MS : backoffMs * 2;
+}
+
+static void queue(const std::string& packet) {
+  upLink.out += packet;
+  lastTxMs = nowMs();
+}
+
+static uint16_t takePacketId() {
+  uint16_t id = nextPacketId;
+  nextPacketId = nextPacketId == 0xFFFF ? 1 : nextPacketId + 1;
+  return id;
+}
+
+// NAME RESOLUTION BLOCKS THE LOOP, BUT ONLY ONCE PER RECONNECTION
+static void startConnect() {
+  addrinfo hints = {};
+  addrinfo* res = NULL;
+  char port[8];
+
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  snprintf(port, sizeof(port), "%u", config.upstreamPort);
+  if (getaddrinfo(config.upstreamHost.c_str(), port, &hints, &res) != 0 || res == NULL) {
+    fail("name resolution failed");
+    return;
+  }
+
+  upLink.fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  int ret = upLink.fd < 0 ? -1 : connect(upLink.fd, res->ai_addr, res->ai_addrlen);
+  freeaddrinfo(res);
+  if (upLink.fd < 0 || (ret != 0 && errno != EINPROGRESS)) {
+    fail("connect failed");
+    return;
+  }
+  int one = 1;
+  setsockopt(upLink.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  upLink.watched = EPOLLOUT;                                                                                     // Writable once the TCP handshake is over
+  loopAdd(upLink.fd, upLink.watched, &endpoint);
+  state = UP_CONNECTING;
+  waitSinceMs = nowMs();
+}
+
+// TCP IS UP: WRAP IT IN TLS, CHECKING THE CHAIN AND THE HOST NAME
+static void startTls() {
+  int err = 0;
+  socklen_t len = sizeof(err);
+  if (getsockopt(upLink.fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) {
+    fail(strerror(err));
+    return;
+  }
+
+  upLink.ssl = SSL_new(ctx);
+  SSL_set_fd(upLink.ssl, upLink.fd);
+  SSL_set_tlsext_host_name(upLink.ssl, config.upstreamHost.c_str());
+  SSL_set1_host(upLink.ssl, config.upstreamHost.c_str());
+  SSL_set_connect_state(upLink.ssl);
+  state = UP_HANDSHAKE;
+}
+
+// SEND THE NEXT BATCH IF ONE IS DUE: FULL, OR THE OLDEST SAMPLE HAS WAITED "flushMs"
+static void flush(bool force) {
+  std::string payload;
+
+  if (state != UP_READY || inFlight || spool.depth() == 0) return;
+  if (!force && spool.pendingBytes() < config.batchBytes && nowMs() - lastFlushMs < config.flushMs) return;
+
+  batchSamples = spool.peek(config.batchBytes, payload, batchEnd);
+  if (batchSamples == 0) return;
+  batchId = takePacketId();
+  batchBytes = payload.size();
+  queue(mqttPublish(TOPIC_GATEWAY, payload, batchId));
+  inFlight = true;
+  waitSinceMs = lastFlushMs = nowMs();
+}
+
+// SEND THE CLIENT ATTRIBUTES THAT CHANGED, ONE DEVICE PER PUBLISH. THEY ARE FEW AND RARE, SO THEY DO NOT WAIT FOR THE BATCH IN FLIGHT
+static void flushAttributes() {
+  if (state != UP_READY) return;
+  for (auto& entry : attributesPending) {
+    uint16_t id = takePacketId();
+    queue(mqttPublish(TOPIC_GATEWAY_ATTRIBUTES, "{\"" + entry.first + "\":" + entry.second + "}", id));
+    attributesInFlight[id] = entry;
+  }
+  attributesPending.clear();
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// PACKET HANDLING
+// ===========================================================================================================================================================
+static bool handlePacket(uint8_t header, const uint8_t* body, size_t len) {
+  uint16_t id;
+
+  switch (header & 0xF0) {
+    case MQTT_CONNACK:
+      if (state != UP_MQTT || len < 2 || body[1] != MQTT_RC_ACCEPTED) {
+        fail(len >= 2 && body[1] == MQTT_RC_NOT_AUTHORIZED ? "gateway token refused" : "CONNECT refused");
+        return false;
+      }
+      fprintf(stderr, "upstream %s:%u: connected\n", config.upstreamHost.c_str(), config.upstreamPort);
+      state = UP_READY;
+      lastRxMs = nowMs();
+      backoffMs = BACKOFF_MIN_MS;
+      flushAttributes();
+      flush(true);                                                                                               // Whatever piled up while disconnected
+      return true;
+
+    case MQTT_PUBACK:
+      if (mqttParseId(body, len, id) && attributesInFlight.erase(id) != 0) return true;
+      if (!inFlight || !mqttParseId(body, len, id) || id != batchId) return true;
+      spool.commit(batchEnd, batchSamples);
+      stats.samplesOut += batchSamples;
+      stats.batchesOut++;
+      stats.bytesOut += batchBytes;
+      inFlight = false;
+      flush(false);
+      return true;
+
+    default:
+      return true;                                                                                               // PINGRESP, nothing else is expected as nothing is subscribed
+  }
+}
+
+void UpstreamEndpoint::onEvent(uint32_t events) {
+  if (state == UP_CONNECTING) {
+    startTls();
+    if (state != UP_HANDSHAKE) return;
+  }
+  if (events & EPOLLERR) {
+    fail("socket error");
+    return;
+  }
+
+  size_t before = upLink.in.size();
+  bool open = linkRead(upLink);
+  if (upLink.in.size() != before) lastRxMs = nowMs();
+  if (state == UP_HANDSHAKE && upLink.established) {
+    state = UP_MQTT;
+    waitSinceMs = nowMs();
+    queue(mqttConnect("edge-bridge", config.token, KEEP_ALIVE_S));                                               // ThingsBoard takes the gateway access token as the user name
+  }
+
+  for (;;) {
+    size_t bodyOffset;
+    long len = mqttFrame(upLink.in, &bodyOffset);
+    if (len == 0) break;
+    if (len < 0) {
+      fail("malformed packet");
+      return;
+    }
+    if (!handlePacket((uint8_t)upLink.in[0], (const uint8_t*)upLink.in.data() + bodyOffset, len - bodyOffset)) return;
+    upLink.in.erase(0, len);
+  }
+
+  if (!open || (events & (EPOLLHUP | EPOLLRDHUP))) {
+    fail(upLink.established ? "connection closed" : "TLS handshake failed");
+    return;
+  }
+  if (!linkFlush(upLink)) {
+    fail("write failed");
+    return;
+  }
+  linkWatch(upLink, &endpoint);
+}
+// PACKET HANDLING END =======================================================================================================================================
+
+// ===========================================================================================================================================================
+// UPSTREAM FUNCTIONS
+// ===========================================================================================================================================================
+bool upstreamStart() {
+  ctx = SSL_CTX_new(TLS_client_method());
+  if (ctx == NULL) return false;
+  SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+  SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+  SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+  if (config.caFile.empty() ? SSL_CTX_set_default_verify_paths(ctx) != 1 : SSL_CTX_load_verify_locations(ctx, config.caFile.c_str(), NULL) != 1) {
+    fprintf(stderr, "upstream: cannot load the trusted CAs\n");
+    return false;
+  }
+  return true;
+}
+
+// RECONNECT, KEEP THE SESSION ALIVE, TIME OUT SILENT PEERS AND FLUSH DUE BATCHES
+void upstreamTick(uint64_t now) {
+  if (state == UP_IDLE) {
+    if (now >= retryAtMs) startConnect();
+    return;
+  }
+  if ((state != UP_READY || inFlight) && now - waitSinceMs > ACK_TIMEOUT_MS) {
+    fail(state == UP_READY ? "no PUBACK" : "connection timed out");
+    return;
+  }
+  if (state != UP_READY) return;
+  if (now - lastRxMs > KEEP_ALIVE_S * 1500ULL) {                                                                 // Not even a PINGRESP
+    fail("keep-alive timed out");
+    return;
+  }
+
+  if (now - lastTxMs > KEEP_ALIVE_S * 1000ULL / 2) queue(mqttEmpty(MQTT_PINGREQ));                               // Keeps NAT entries open and proves the link is alive, see the check above
+  flush(false);
+  if (!linkFlush(upLink)) {
+    fail("write failed");
+    return;
+  }
+  linkWatch(upLink, &endpoint);
+}
+
+// A SAMPLE WAS QUEUED: PUBLISH RIGHT AWAY IF THAT FILLED A BATCH, OTHERWISE THE TICK WILL
+void upstreamKick() {
+  if (state != UP_READY || inFlight || spool.pendingBytes() < config.batchBytes) return;
+  flush(true);
+  if (!linkFlush(upLink)) {
+    fail("write failed");
+    return;
+  }
+  linkWatch(upLink, &endpoint);
+}
+
+// CLIENT ATTRIBUTES OF A DEVICE, ONLY THE LATEST ONES ARE KEPT UNTIL ThingsBoard HAS THEM
+void upstreamAttributes(const std::string& device, const std::string& attributes) {
+  attributesPending[device] = attributes;
+  if (state != UP_READY) return;
+  flushAttributes();
+  if (!linkFlush(upLink)) {
+    fail("write failed");
+    return;
+  }
+  linkWatch(upLink, &endpoint);
+}
+
+const char* upstreamState() {
+  return stateNames[state];
+}
+// UPSTREAM FUNCTIONS END ====================================================================================================================================
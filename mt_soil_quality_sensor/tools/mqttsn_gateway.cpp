@@ -0,0 +1,204 @@
+// Host stand-in for the MQTT-SN gateway of the soil quality sensors (MqttSnUplink, MQTTSN_UPLINK in include/macros.h).
+// Decodes the binary sample frames published on the predefined topic and prints them for the ThingsBoard gateway API, one
+// "<topic> <json>" line each, so they can be piped to any MQTT client. Every tree is its own device, named GATEWAY_DEVICE_NAME
+// as the ESP-NOW gateway names it. Its "treeId" and probe depths come first on the attributes topic, and again only when they change:
+//
+//   g++ -std=c++17 -O2 -Iinclude tools/mqttsn_gateway.cpp src/mqttSnUtils.cpp src/frameUtils.cpp src/attributeUtils.cpp -o mqttsn_gateway
+//   ./mqttsn_gateway [port] [topicId] | while read -r topic json; do
+//     mosquitto_pub -h srv-iot.diatel.upm.es -p 8883 --capath /etc/ssl/certs -u "$GATEWAY_TOKEN" -t "$topic" -m "$json"; done
+//
+// GATEWAY_TOKEN is the access token of a ThingsBoard device created with "Is gateway" checked, the same kind soil_quality_gateway uses.
+//
+// Put MQTTSN_GATEWAY in macros.h to this machine's address. Diagnostics go to stderr.
+
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_map>
+#include "mqttSnUtils.h"
+#include "frameUtils.h"
+#include "attributeUtils.h"
+#include "macros.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+#define MAX_CLIENTS 64
+#define RC_INVALID_TOPIC 0x02
+#define RC_NOT_SUPPORTED 0x03
+
+struct Client {
+  sockaddr_in addr;
+  bool connected;
+  uint16_t lastMsgId;                                                                                            // A retried PUBLISH is acknowledged again but not forwarded twice
+  uint32_t lastActive;                                                                                           // "activity" at the last datagram from this client, the smallest one is evicted first
+};
+
+static Client clients[MAX_CLIENTS];
+static uint32_t activity = 0;                                                                                    // Datagrams received so far, orders the clients by their last activity
+static uint16_t topicId = 1;                                                                                     // MQTTSN_TOPIC_ID
+static std::unordered_map<int16_t, uint32_t> lastAttributes;                                                     // Hash of the attributes last printed, per treeId
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// CLIENTS ARE KEYED BY ADDRESS AND PORT, THE WAY A REAL GATEWAY TELLS UDP PEERS APART
+static Client* findClient(const sockaddr_in& addr, bool create) {
+  Client* free = NULL;
+  Client* idlest = &clients[0];
+  for (Client& c : clients) {
+    if (c.addr.sin_port == 0) {
+      if (free == NULL) free = &c;
+      continue;
+    }
+    if (c.addr.sin_addr.s_addr == addr.sin_addr.s_addr && c.addr.sin_port == addr.sin_port) {
+      c.lastActive = activity;
+      return &c;
+    }
+    if (c.lastActive < idlest->lastActive) idlest = &c;
+  }
+  if (!create) return NULL;
+  if (free == NULL) {                                                                                            // Full: the least recently active client goes, most likely a sensor already asleep
+    free = idlest;
+    fprintf(stderr, "%s:%u: evicted, client table full\n", inet_ntoa(free->addr.sin_addr), ntohs(free->addr.sin_port));
+  }
+  *free = {};
+  free->addr = addr;
+  free->lastActive = activity;
+  return free;
+}
+
+// TIME OF RECEPTION, FOR FRAMES FROM A NODE WHOSE CLOCK WAS NEVER SET
+static uint64_t epochMs() {
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void reply(int sock, const sockaddr_in& addr, const uint8_t* msg, size_t len) {
+  if (len > 0) sendto(sock, msg, len, 0, (const sockaddr*)&addr, sizeof(addr));
+}
+
+// DECODE THE FRAME AND PRINT IT FOR THE GATEWAY API UNDER THE DEVICE OF ITS TREE, RETURNS THE MQTT-SN RETURN CODE FOR THE PUBACK
+static uint8_t forward(uint16_t topic, const uint8_t* data, size_t len) {
+  SampleFrame frame;
+  char json[FRAME_JSON_MAX];
+  char name[32];
+
+  if (topic != topicId) return RC_INVALID_TOPIC;
+  if (!decodeFrame(data, len, frame)) {
+    fprintf(stderr, "frame of %zu bytes, version %u: rejected\n", len, len > 1 ? data[1] : 0);                   // Corrupt, or from a firmware with another frame layout
+    return RC_NOT_SUPPORTED;
+  }
+
+  snprintf(name, sizeof(name), GATEWAY_DEVICE_NAME, frame.treeId);
+  formatAttributesJson(json, sizeof(json), frame, false);
+  uint32_t hash = attributesHash(json);
+  if (lastAttributes[frame.treeId] != hash) {
+    lastAttributes[frame.treeId] = hash;
+    printf("%s {\"%s\":%s}\n", MQTT_TOPIC_GATEWAY_ATTRIBUTES, name, json);                                       // ThingsBoard creates the device on its first message
+  }
+  if (frame.tsMs == 0) frame.tsMs = epochMs();                                                                   // Same as gatewayAdd() on the ESP-NOW gateway
+  formatTelemetryJson(json, sizeof(json), frame);
+  printf("%s {\"%s\":[%s]}\n", MQTT_TOPIC_GATEWAY, name, json);
+  fflush(stdout);                                                                                                // Line by line, the consumer is usually a pipe
+  return MQTTSN_RC_ACCEPTED;
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// MESSAGE HANDLING
+// ===========================================================================================================================================================
+static void handle(int sock, const sockaddr_in& from, const uint8_t* buf, size_t len) {
+  uint8_t out[16];
+  uint8_t type, flags;
+  uint16_t topic, msgId;
+  const uint8_t* data;
+  size_t dataLen;
+  Client* client;
+
+  activity++;
+  if (mqttSnParse(buf, len, &type) == 0) {
+    fprintf(stderr, "%s:%u: malformed datagram of %zu bytes\n", inet_ntoa(from.sin_addr), ntohs(from.sin_port), len);
+    return;
+  }
+
+  switch (type) {
+    case MQTTSN_CONNECT:
+      client = findClient(from, true);
+      client->connected = true;
+      client->lastMsgId = 0;
+      reply(sock, from, out, mqttSnConnack(out, sizeof(out), MQTTSN_RC_ACCEPTED));
+      break;
+
+    case MQTTSN_PUBLISH: {
+      if (!mqttSnParsePublish(buf, len, &flags, &topic, &msgId, &data, &dataLen)) return;
+      uint8_t qos = flags & MQTTSN_FLAG_QOS_M1;
+      if (qos == MQTTSN_FLAG_QOS_M1) {                                                                           // No connection and no reply, the whole sample in this one datagram
+        forward(topic, data, dataLen);
+        return;
+      }
+      client = findClient(from, false);
+      if (client == NULL || !client->connected) return;                                                          // QoS 0 and 1 need a CONNECT first
+      if (qos == MQTTSN_FLAG_QOS_1 && msgId == client->lastMsgId) {                                              // Our PUBACK was lost, the sensor sent it again
+        reply(sock, from, out, mqttSnPuback(out, sizeof(out), topic, msgId, MQTTSN_RC_ACCEPTED));
+        return;
+      }
+      uint8_t rc = forward(topic, data, dataLen);
+      if (qos == MQTTSN_FLAG_QOS_1) {
+        if (rc == MQTTSN_RC_ACCEPTED) client->lastMsgId = msgId;
+        reply(sock, from, out, mqttSnPuback(out, sizeof(out), topic, msgId, rc));
+      }
+      break;
+    }
+
+    case MQTTSN_DISCONNECT:
+      client = findClient(from, false);
+      if (client != NULL) *client = {};
+      reply(sock, from, out, mqttSnDisconnect(out, sizeof(out)));
+      break;
+
+    default:
+      fprintf(stderr, "%s:%u: message type 0x%02X not supported\n", inet_ntoa(from.sin_addr), ntohs(from.sin_port), type);
+      break;
+  }
+}
+// MESSAGE HANDLING END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// MAIN
+// ===========================================================================================================================================================
+int main(int argc, char** argv) {
+  uint16_t port = argc > 1 ? (uint16_t)atoi(argv[1]) : 1884;                                                     // MQTTSN_PORT
+  if (argc > 2) topicId = (uint16_t)atoi(argv[2]);
+
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (sock < 0 || bind(sock, (const sockaddr*)&addr, sizeof(addr)) < 0) {
+    perror("mqttsn_gateway");
+    return 1;
+  }
+  fprintf(stderr, "MQTT-SN gateway on UDP port %u, topic id %u -> %s\n", port, topicId, MQTT_TOPIC_GATEWAY);
+
+  for (;;) {
+    uint8_t buf[512];
+    sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    ssize_t len = recvfrom(sock, buf, sizeof(buf), 0, (sockaddr*)&from, &fromLen);
+    if (len > 0) handle(sock, from, buf, (size_t)len);
+  }
+}
+// MAIN END ==================================================================================================================================================
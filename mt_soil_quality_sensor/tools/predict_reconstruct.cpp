@@ -0,0 +1,124 @@
+// Host side of the dual-prediction reporting of the soil quality sensors (PREDICTION_REPORTING in include/macros.h).
+// With it, a sensor only sends a sample when the shared trend model (src/predictUtils.cpp) mispredicts it by more than the tolerance.
+// This program runs the same model over the samples that did arrive and fills every wake in between with the value the sensor knew
+// the server would predict, within PREDICT_TEMP_TOLERANCE_C and PREDICT_MOIST_TOLERANCE of what it measured.
+//
+// Input, one delivered sample per line, oldest first, e.g. from a ThingsBoard export: "<ts in ms> <telemetry json>"
+// Output, one "<topic> <json>" line per sample, with "soilTemperaturePredicted" and "soilMoisturePredicted" for every slot of the sleep
+// grid (SLEEP_DURATION_S, which must match the sensor build). A slot that also had a button wake shows that sample instead:
+//
+//   g++ -std=c++17 -O2 -Iinclude tools/predict_reconstruct.cpp src/predictUtils.cpp -o predict_reconstruct
+//   ./predict_reconstruct < samples.txt | while read -r topic json; do
+//     mosquitto_pub -h srv-iot.diatel.upm.es -p 8883 --capath /etc/ssl/certs -u "$ACCESS_TOKEN" -t "$topic" -m "$json"; done
+//
+// The history should start at a power-on of the sensor (a "bootCnt" of 1): both models start from scratch there. Started in the
+// middle, or after samples sent before the sensor clock was set (their "ts" is the reception time), the trend differs at first and
+// converges within a few delivered samples. Diagnostics go to stderr.
+
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "predictUtils.h"
+#include "macros.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+#define TOPIC_TELEMETRY "v1/devices/me/telemetry"                                                                // MQTT_TOPIC_PUB
+
+struct Sample {
+  unsigned long long tsMs;
+  uint32_t bootCnt;
+  uint32_t step;                                                                                                 // Slot of the sleep grid, "predictStep()" of the time
+  bool hasTemp;                                                                                                  // Faulty values are left out of the telemetry, and out of the models
+  bool hasMoist;
+  int32_t temp;                                                                                                  // Hundredths, as the sensor rounded them
+  int32_t moist;
+};
+
+static Predictor tempModel;
+static Predictor moistModel;
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// NUMBER AFTER "key" IN A FLAT JSON OBJECT
+static bool jsonNumber(const char* json, const char* key, double* value) {
+  char pattern[48];
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+  const char* p = strstr(json, pattern);
+  if (p == NULL) return false;
+
+  char* end;
+  *value = strtod(p + strlen(pattern), &end);
+  return end != p + strlen(pattern);
+}
+
+static bool parseSample(const char* line, Sample& sample) {
+  char* json;
+  double value;
+
+  sample.tsMs = strtoull(line, &json, 10);
+  if (json == line || !jsonNumber(json, "bootCnt", &value)) return false;
+  sample.bootCnt = (uint32_t)value;
+  sample.step = predictStep(sample.tsMs);
+  sample.hasTemp = jsonNumber(json, "soilTemperature", &value);
+  sample.temp = sample.hasTemp ? predictToHundredths((float)value) : 0;
+  sample.hasMoist = jsonNumber(json, "soilMoisture", &value);
+  sample.moist = sample.hasMoist ? predictToHundredths((float)value) : 0;
+  return true;
+}
+
+static void print(unsigned long long tsMs, int32_t temp, int32_t moist) {
+  printf("%s {\"ts\":%llu,\"values\":{\"soilTemperaturePredicted\":%.2f,\"soilMoisturePredicted\":%.2f}}\n",
+         TOPIC_TELEMETRY, tsMs, temp / 100.0, moist / 100.0);
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// MAIN
+// ===========================================================================================================================================================
+int main() {
+  char line[1024];
+  Sample last = {};
+  bool haveLast = false;
+  unsigned long filled = 0, delivered = 0;
+
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    Sample sample;
+    if (!parseSample(line, sample)) {
+      fprintf(stderr, "skipped: %s", line);
+      continue;
+    }
+
+    if (haveLast && sample.bootCnt <= last.bootCnt) {                                                            // Power-on: the sensor dropped its models too
+      tempModel = {};
+      moistModel = {};
+      haveLast = false;
+    }
+
+    if (haveLast && tempModel.valid && moistModel.valid) {                                                       // Slots the sensor kept quiet about
+      for (uint32_t step = last.step + 1; (int32_t)(sample.step - step) > 0; step++) {
+        print(step * PREDICT_STEP_MS, predictAt(tempModel, step), predictAt(moistModel, step));
+        filled++;
+      }
+    }
+
+    if (sample.hasTemp) predictUpdate(tempModel, sample.step, sample.temp);                                      // Same rule as "predictionDelivered()"
+    if (sample.hasMoist) predictUpdate(moistModel, sample.step, sample.moist);
+    print(sample.tsMs, predictAt(tempModel, sample.step), predictAt(moistModel, sample.step));
+    fflush(stdout);                                                                                              // Line by line, the consumer is usually a pipe
+    delivered++;
+    last = sample;
+    haveLast = true;
+  }
+
+  fprintf(stderr, "%lu delivered samples, %lu predicted ones filled in\n", delivered, filled);
+  return 0;
+}
+// MAIN END ==================================================================================================================================================
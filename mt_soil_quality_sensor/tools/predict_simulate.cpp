@@ -0,0 +1,103 @@
+// Host simulation of the dual-prediction reporting (PREDICTION_REPORTING in include/macros.h), to size the tolerances before a deployment.
+// Three days of samples on the sleep grid: a diurnal soil temperature curve and a slow moisture decline, with a little sensor noise.
+// The second day has every third slot skipped by a stretched sleep, and a button wake comes every few hours, so neither "bootCnt" nor the
+// wake count follows the grid. The sensor side runs the firmware code itself, the server side the same model as tools/predict_reconstruct.cpp:
+//
+//   g++ -std=c++17 -O2 -Iinclude -DPREDICTION_REPORTING=true tools/predict_simulate.cpp src/predictUtils.cpp -o predict_simulate
+//   ./predict_simulate | ./predict_reconstruct > /dev/null
+//
+// The delivered samples go to stdout in the input format of the reconstructor, the summary to stderr.
+
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "predictUtils.h"
+#include "macros.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+#define SIM_DAYS 3
+#define SIM_START_MS 1767225600000ULL                                                                            // 2026-01-01 00:00 UTC, any time on the grid will do
+#define SIM_BUTTON_EVERY 457                                                                                     // Slots between two button wakes, prime so they wander over the day
+#define SIM_BUTTON_OFFSET_MS 12345                                                                               // Button wakes fall between two slots of the grid
+
+static Predictor tempModel;                                                                                      // The server's copy, only fed with delivered samples
+static Predictor moistModel;
+static uint32_t noiseState = 1;
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// HELPER FUNCTIONS
+// ===========================================================================================================================================================
+// UNIFORM NOISE IN [-amplitude, amplitude], A FIXED LCG SO EVERY RUN GIVES THE SAME NUMBERS
+static float noise(float amplitude) {
+  noiseState = noiseState * 1103515245u + 12345u;
+  return amplitude * (((noiseState >> 16) & 0x7FFF) / 16383.5f - 1.0f);
+}
+
+static SampleFrame measure(uint64_t tsMs, uint32_t bootCnt) {
+  double days = (tsMs - SIM_START_MS) / 86400000.0;
+  SampleFrame frame = {};
+  frame.bootCnt = bootCnt;
+  frame.tsMs = tsMs;
+  frame.soilTemp = (float)(16.0 + 4.0 * sin(2.0 * M_PI * (days - 0.375))) + noise(0.05f);                        // Coldest at 3:00, warmest at 15:00
+  frame.soilMoist = (float)(42.0 - 6.0 * days / SIM_DAYS) + noise(0.3f);
+  return frame;
+}
+
+// DELIVER A SAMPLE TO BOTH SIDES AND PRINT IT AS THE RECONSTRUCTOR READS IT
+static void deliver(const SampleFrame& frame) {
+  predictionDelivered(frame);
+  predictUpdate(tempModel, predictStep(frame.tsMs), predictToHundredths(frame.soilTemp));
+  predictUpdate(moistModel, predictStep(frame.tsMs), predictToHundredths(frame.soilMoist));
+  printf("%llu {\"bootCnt\":%lu,\"soilTemperature\":%4.2f,\"soilMoisture\":%5.2f}\n", (unsigned long long)frame.tsMs,
+         (unsigned long)frame.bootCnt, frame.soilTemp, frame.soilMoist);
+}
+// HELPER FUNCTIONS END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// MAIN
+// ===========================================================================================================================================================
+int main() {
+  uint32_t slots = SIM_DAYS * 86400000ULL / PREDICT_STEP_MS;
+  uint32_t bootCnt = 0;
+  unsigned long samples = 0, sent = 0, stubbed = 0;
+  int32_t tempWorst = 0, moistWorst = 0;
+
+  for (uint32_t slot = 0; slot < slots; slot++) {
+    uint64_t tsMs = SIM_START_MS + slot * PREDICT_STEP_MS;
+    if (slot * PREDICT_STEP_MS / 86400000ULL == 1 && slot % 3 == 0) {                                            // The node slept on, no boot and no sample
+      stubbed++;
+      continue;
+    }
+
+    SampleFrame frame = measure(tsMs, ++bootCnt);
+    samples++;
+    if (predictionShouldSend(frame)) {
+      deliver(frame);
+      sent++;
+    } else {                                                                                                     // What the dashboard shows for this slot instead of the measurement
+      int32_t tempError = abs(predictToHundredths(frame.soilTemp) - predictAt(tempModel, predictStep(tsMs)));
+      int32_t moistError = abs(predictToHundredths(frame.soilMoist) - predictAt(moistModel, predictStep(tsMs)));
+      if (tempError > tempWorst) tempWorst = tempError;
+      if (moistError > moistWorst) moistWorst = moistError;
+    }
+
+    if (slot % SIM_BUTTON_EVERY == SIM_BUTTON_EVERY - 1) {                                                       // Button wake: a boot off the grid, always sent
+      deliver(measure(tsMs + SIM_BUTTON_OFFSET_MS, ++bootCnt));
+      samples++;
+      sent++;
+    }
+  }
+
+  fprintf(stderr, "%lu samples (%lu slots slept over), %lu sent (%.1f%%)\n", samples, stubbed, sent, 100.0 * sent / samples);
+  fprintf(stderr, "worst prediction error: %.2f C (tolerance %.2f), %.2f %% (tolerance %.2f)\n", tempWorst / 100.0,
+          PREDICT_TEMP_TOLERANCE_C, moistWorst / 100.0, PREDICT_MOIST_TOLERANCE);
+  return tempWorst <= predictToHundredths(PREDICT_TEMP_TOLERANCE_C) && moistWorst <= predictToHundredths(PREDICT_MOIST_TOLERANCE) ? 0 : 1;
+}
+// MAIN END ==================================================================================================================================================